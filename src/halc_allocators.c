@@ -1,5 +1,6 @@
 #include "halc_allocators.h"
 #include "halc_strings.h"
+#include "halc_threads.h"
 
 #include <inttypes.h>
 #include <stdlib.h>
@@ -9,19 +10,194 @@
 struct allocator gDefaultAllocator;
 
 #if TRACK_ALLOCATIONS
-b8 gTrackAllocations;
+HALC_THREAD_LOCAL b8 gTrackAllocations;
 b8 gAllowTrackAllocations;
-const char* gContextString = "Unnamed";
+HALC_THREAD_LOCAL const char* gContextString = "Unnamed";
 #endif
 
-struct allocatorStats gAllocatorStats;
+// process wide totals, every thread updates these with relaxed atomics
+// so allocating never has to take a lock.
+struct shared_allocator_stats {
+    volatile i64 allocations;
+    volatile i64 peakAllocationsCount;
+    volatile i64 freeEventCount;
+    volatile i64 allocEventCount;
+    volatile i64 reallocEventCount;
+    volatile i64 allocatedSize;
+    volatile i64 peakAllocatedSize;
+};
+
+static struct shared_allocator_stats gSharedStats;
+
+// what the current thread allocated and freed. 
+// a thread freeing memory another thread allocated can go negative.
+static HALC_THREAD_LOCAL struct allocatorStats gThreadStats;
+
+static HALC_THREAD_LOCAL struct arena* gActiveArena;
+static HALC_THREAD_LOCAL struct memory_budget* gActiveBudget;
+
+// the profiler and debug heap tables are shared by every thread,
+// this is only taken while one of them is enabled.
+static struct halc_mutex gHeapDebugLock = HALC_MUTEX_INITIALIZER;
+
+static void debug_heap_forget_live();
+
+struct arena_block {
+    struct arena_block* next;
+    usize cap;
+    usize used;
+};
 
 static void init_allocator_stats()
 {
-    gAllocatorStats.allocations = 0;
-    gAllocatorStats.allocatedSize = 0;
-    gAllocatorStats.peakAllocatedSize = 0;
-    gAllocatorStats.peakAllocationsCount = 0;
+    halc_atomic_store_i64(&gSharedStats.allocations, 0);
+    halc_atomic_store_i64(&gSharedStats.allocatedSize, 0);
+    halc_atomic_store_i64(&gSharedStats.peakAllocatedSize, 0);
+    halc_atomic_store_i64(&gSharedStats.peakAllocationsCount, 0);
+
+    gThreadStats.allocations = 0;
+    gThreadStats.allocatedSize = 0;
+    gThreadStats.peakAllocatedSize = 0;
+    gThreadStats.peakAllocationsCount = 0;
+}
+
+void get_allocator_stats(struct allocatorStats* outStats)
+{
+    outStats->allocations = (i32) halc_atomic_load_i64(&gSharedStats.allocations);
+    outStats->peakAllocationsCount = (i32) halc_atomic_load_i64(&gSharedStats.peakAllocationsCount);
+    outStats->freeEventCount = halc_atomic_load_i64(&gSharedStats.freeEventCount);
+    outStats->allocEventCount = halc_atomic_load_i64(&gSharedStats.allocEventCount);
+    outStats->reallocEventCount = halc_atomic_load_i64(&gSharedStats.reallocEventCount);
+    outStats->allocatedSize = halc_atomic_load_i64(&gSharedStats.allocatedSize);
+    outStats->peakAllocatedSize = halc_atomic_load_i64(&gSharedStats.peakAllocatedSize);
+}
+
+void get_thread_allocator_stats(struct allocatorStats* outStats)
+{
+    *outStats = gThreadStats;
+}
+
+static void stats_record_alloc(i64 size)
+{
+    i64 allocations = halc_atomic_add_i64(&gSharedStats.allocations, 1) + 1;
+    i64 allocatedSize = halc_atomic_add_i64(&gSharedStats.allocatedSize, size) + size;
+    halc_atomic_add_i64(&gSharedStats.allocEventCount, 1);
+    halc_atomic_max_i64(&gSharedStats.peakAllocatedSize, allocatedSize);
+    halc_atomic_max_i64(&gSharedStats.peakAllocationsCount, allocations);
+
+    gThreadStats.allocEventCount += 1;
+    gThreadStats.allocations += 1;
+    gThreadStats.allocatedSize += size;
+    gThreadStats.peakAllocatedSize = HALC_MAX(gThreadStats.peakAllocatedSize, gThreadStats.allocatedSize);
+    gThreadStats.peakAllocationsCount = HALC_MAX(gThreadStats.peakAllocationsCount, gThreadStats.allocations);
+}
+
+static void stats_record_free(i64 size)
+{
+    halc_atomic_add_i64(&gSharedStats.allocations, -1);
+    halc_atomic_add_i64(&gSharedStats.allocatedSize, -size);
+    halc_atomic_add_i64(&gSharedStats.freeEventCount, 1);
+
+    gThreadStats.freeEventCount += 1;
+    gThreadStats.allocations -= 1;
+    gThreadStats.allocatedSize -= size;
+}
+
+static void stats_record_realloc(i64 size, i64 newSize)
+{
+    i64 allocatedSize = halc_atomic_add_i64(&gSharedStats.allocatedSize, newSize - size) + newSize - size;
+    halc_atomic_add_i64(&gSharedStats.allocEventCount, 1);
+    halc_atomic_add_i64(&gSharedStats.freeEventCount, 1);
+    halc_atomic_add_i64(&gSharedStats.reallocEventCount, 1);
+    halc_atomic_max_i64(&gSharedStats.peakAllocatedSize, allocatedSize);
+
+    gThreadStats.allocEventCount += 1;
+    gThreadStats.freeEventCount += 1;
+    gThreadStats.reallocEventCount += 1;
+    gThreadStats.allocatedSize += newSize - size;
+    gThreadStats.peakAllocatedSize = HALC_MAX(gThreadStats.peakAllocatedSize, gThreadStats.allocatedSize);
+}
+
+// ---- memory budgets ----
+
+void memory_budget_init(struct memory_budget* budget, const char* name, i64 limit)
+{
+    budget->name = name;
+    budget->limit = limit;
+    budget->current = 0;
+    budget->peak = 0;
+    budget->failedAllocations = 0;
+    budget->previous = NULL;
+}
+
+void get_memory_budget_stats(const struct memory_budget* budget, struct memory_budget_stats* outStats)
+{
+    outStats->limit = budget->limit;
+    outStats->current = halc_atomic_load_i64(&budget->current);
+    outStats->peak = halc_atomic_load_i64(&budget->peak);
+    outStats->failedAllocations = halc_atomic_load_i64(&budget->failedAllocations);
+}
+
+void memory_budget_reset_peak(struct memory_budget* budget)
+{
+    halc_atomic_store_i64(&budget->peak, halc_atomic_load_i64(&budget->current));
+}
+
+void memory_budget_push(struct memory_budget* budget)
+{
+    budget->previous = gActiveBudget;
+    gActiveBudget = budget;
+}
+
+void memory_budget_pop()
+{
+    if(gActiveBudget)
+    {
+        gActiveBudget = gActiveBudget->previous;
+    }
+}
+
+struct memory_budget* memory_budget_active()
+{
+    return gActiveBudget;
+}
+
+// reserves (size) bytes from the active budget, the limit is checked with a cas loop
+// so threads sharing a budget can't push each other over it.
+static errc budget_charge(i64 size)
+{
+    struct memory_budget* budget = gActiveBudget;
+    if(!budget || size <= 0)
+    {
+        return ERR_OK;
+    }
+
+    i64 current = halc_atomic_load_i64(&budget->current);
+    while(1)
+    {
+        if(budget->limit > 0 && current + size > budget->limit)
+        {
+            halc_atomic_add_i64(&budget->failedAllocations, 1);
+            return ERR_OUT_OF_MEMORY;
+        }
+
+        if(halc_atomic_cas_i64(&budget->current, current, current + size))
+        {
+            break;
+        }
+        current = halc_atomic_load_i64(&budget->current);
+    }
+
+    halc_atomic_max_i64(&budget->peak, current + size);
+    return ERR_OK;
+}
+
+static void budget_refund(i64 size)
+{
+    if(gActiveBudget && size > 0)
+    {
+        halc_atomic_add_i64(&gActiveBudget->current, -size);
+    }
 }
 
 void track_allocs(const char* contextString) 
@@ -39,17 +215,27 @@ void track_allocs(const char* contextString)
 
 errc untrack_allocs(struct allocatorStats* outTrackedAllocationStats)
 {
+    // cached scratch blocks are not leaks
+    scratch_release();
 
-    *outTrackedAllocationStats = gAllocatorStats;
+    get_allocator_stats(outTrackedAllocationStats);
 
-    if(gAllocatorStats.allocations > 0)
+    if(outTrackedAllocationStats->allocations > 0)
     {
         fprintf(stderr, "untrack called, leaked memory: %" PRId64 
                 " bytes in %" PRId32 
                 " allocations (peakAllocatedSize: %" PRId64 ")\n", 
-                gAllocatorStats.allocatedSize,
-                gAllocatorStats.allocations,
-                gAllocatorStats.peakAllocatedSize);
+                outTrackedAllocationStats->allocatedSize,
+                outTrackedAllocationStats->allocations,
+                outTrackedAllocationStats->peakAllocatedSize);
+
+        if(debug_heap_enabled())
+        {
+            debug_heap_report_leaks(stderr);
+            halc_mutex_lock(&gHeapDebugLock);
+            debug_heap_forget_live();
+            halc_mutex_unlock(&gHeapDebugLock);
+        }
 
         halc_raiseCleanup(ERR_TEST_LEAKED_MEMORY);
     }
@@ -65,11 +251,53 @@ cleanup:
     halc_end;
 }
 
+// ---- libc backed default allocator ----
+static void* libc_malloc(void* ctx, size_t size)
+{
+    return malloc(size);
+}
+
+static void* libc_realloc(void* ctx, void* ptr, size_t size, size_t newSize)
+{
+    return realloc(ptr, newSize);
+}
+
+static void libc_free(void* ctx, void* ptr, size_t size)
+{
+    free(ptr);
+}
+
+#if !defined(_WIN32)
+// memory from posix_memalign can be released with free() so this fits the free_fn contract,
+// on windows _aligned_malloc needs _aligned_free so we use the generic fallback there instead.
+static void* libc_aligned_alloc(void* ctx, size_t size, size_t alignment)
+{
+    void* ptr = NULL;
+    if(alignment < sizeof(void*))
+    {
+        alignment = sizeof(void*);
+    }
+
+    if(posix_memalign(&ptr, alignment, size) != 0)
+    {
+        return NULL;
+    }
+    return ptr;
+}
+#endif
+
 errc setup_default_allocator() 
 {
     init_allocator_stats();
-    gDefaultAllocator.malloc_fn = malloc;
-    gDefaultAllocator.free_fn = free;
+    gDefaultAllocator.ctx = NULL;
+    gDefaultAllocator.malloc_fn = libc_malloc;
+    gDefaultAllocator.realloc_fn = libc_realloc;
+#if !defined(_WIN32)
+    gDefaultAllocator.aligned_alloc_fn = libc_aligned_alloc;
+#else
+    gDefaultAllocator.aligned_alloc_fn = NULL;
+#endif
+    gDefaultAllocator.free_fn = libc_free;
     gTrackAllocations = FALSE;
     gAllowTrackAllocations = FALSE;
 
@@ -82,117 +310,1791 @@ errc enable_allocation_tracking()
     halc_end;
 }
 
-errc setup_default_custom_allocator(
-    void* (*malloc_fn) (size_t),
-    void (*free_fn) (void*))
+errc setup_default_custom_allocator(const struct allocator* allocator)
 {
-    gDefaultAllocator.malloc_fn = malloc;
-    gDefaultAllocator.free_fn = free;
+    halc_assert(allocator->malloc_fn != NULL);
+    halc_assert(allocator->free_fn != NULL);
+
+    gDefaultAllocator = *allocator;
     gTrackAllocations = FALSE;
     gAllowTrackAllocations = FALSE;
 
     halc_end;
 }
 
-errc halloc_advanced(void** ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+// ======================= live pointer table =================
+//
+// open addressed pointer -> record map shared by the profiler and the debug heap.
+// its memory comes from a copy of the allocator that was current when the owner
+// was enabled, it doesn't show up in the allocator statistics.
+
+#if PROFILE_ALLOCATIONS || DEBUG_HEAP
+
+#define POINTER_TABLE_INITIAL_CAP 1024
+#define POINTER_TOMBSTONE ((void*) 1)
+
+struct pointer_record {
+    void* ptr; // NULL is an empty slot
+    usize size;
+    const char* file;
+    const char* func;
+    i32 lineNumber;
+    u32 site; // profiler site that currently owns the pointer
+    b8 freed; // the debug heap keeps freed pointers around to catch double frees
+};
+
+struct pointer_table {
+    struct allocator backing;
+    struct pointer_record* records;
+    u32 cap;
+    u32 used; // records + tombstones
+};
+
+static u32 hash_pointer(const void* ptr)
 {
-    if (size == 0)
+    u64 x = (u64)(usize) ptr;
+    x ^= x >> 33;
+    x *= 0xff51afd7ed558ccdULL;
+    x ^= x >> 33;
+    return (u32) x;
+}
+
+static void* backing_alloc(const struct allocator* backing, usize size)
+{
+    void* ptr = backing->malloc_fn(backing->ctx, size);
+    if(ptr)
     {
-        halc_raise(ERR_OUT_OF_MEMORY);
+        memset(ptr, 0, size);
     }
-    *ptr = gDefaultAllocator.malloc_fn(size);
-    if(!*ptr)
+    return ptr;
+}
+
+static void backing_free(const struct allocator* backing, void* ptr, usize size)
+{
+    if(ptr)
     {
-        halc_raiseCleanup(ERR_OUT_OF_MEMORY);
+        backing->free_fn(backing->ctx, ptr, size);
     }
+}
 
-#if TRACK_ALLOCATIONS
-    if(gTrackAllocations)
+static void pointer_table_init(struct pointer_table* table)
+{
+    table->backing = gDefaultAllocator;
+    table->records = NULL;
+    table->cap = 0;
+    table->used = 0;
+}
+
+static void pointer_table_free(struct pointer_table* table)
+{
+    backing_free(&table->backing, table->records, sizeof(struct pointer_record) * table->cap);
+    table->records = NULL;
+    table->cap = 0;
+    table->used = 0;
+}
+
+static struct pointer_record* pointer_table_find(struct pointer_table* table, const void* ptr)
+{
+    if(!table->cap)
     {
-        fprintf(stderr, YELLOW("alloc(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, *ptr, gContextString, func, file, lineNumber);
+        return NULL;
+    }
+
+    u32 mask = table->cap - 1;
+    u32 slot = hash_pointer(ptr) & mask;
+    while(table->records[slot].ptr)
+    {
+        if(table->records[slot].ptr == ptr)
+        {
+            return &table->records[slot];
+        }
+        slot = (slot + 1) & mask;
+    }
+    return NULL;
+}
+
+static b8 pointer_table_grow(struct pointer_table* table)
+{
+    u32 newCap = table->cap ? table->cap * 2 : POINTER_TABLE_INITIAL_CAP;
+    struct pointer_record* records = (struct pointer_record*) backing_alloc(&table->backing, sizeof(struct pointer_record) * newCap);
+    if(!records)
+    {
+        return FALSE;
+    }
+
+    u32 mask = newCap - 1;
+    u32 used = 0;
+    for(u32 i = 0; i < table->cap; i += 1)
+    {
+        struct pointer_record* record = &table->records[i];
+        if(!record->ptr || record->ptr == POINTER_TOMBSTONE)
+        {
+            continue;
+        }
+
+        u32 slot = hash_pointer(record->ptr) & mask;
+        while(records[slot].ptr)
+        {
+            slot = (slot + 1) & mask;
+        }
+        records[slot] = *record;
+        used += 1;
+    }
+
+    backing_free(&table->backing, table->records, sizeof(struct pointer_record) * table->cap);
+    table->records = records;
+    table->cap = newCap;
+    table->used = used;
+    return TRUE;
+}
+
+// returns the record for ptr, an existing record for the same address is reused.
+// returns NULL if the table couldn't grow.
+static struct pointer_record* pointer_table_insert(struct pointer_table* table, void* ptr)
+{
+    struct pointer_record* existing = pointer_table_find(table, ptr);
+    if(existing)
+    {
+        existing->freed = FALSE;
+        return existing;
+    }
+
+    // keep the table at most 3/4 full, tombstones included
+    if((table->used + 1) * 4 > table->cap * 3 && !pointer_table_grow(table))
+    {
+        return NULL;
+    }
+
+    u32 mask = table->cap - 1;
+    u32 slot = hash_pointer(ptr) & mask;
+    while(table->records[slot].ptr && table->records[slot].ptr != POINTER_TOMBSTONE)
+    {
+        slot = (slot + 1) & mask;
+    }
+
+    struct pointer_record* record = &table->records[slot];
+    if(!record->ptr)
+    {
+        table->used += 1;
     }
+    record->ptr = ptr;
+    record->freed = FALSE;
+    return record;
+}
+
+static void pointer_table_remove(struct pointer_record* record)
+{
+    record->ptr = POINTER_TOMBSTONE;
+}
+
 #endif
 
-    gAllocatorStats.allocEventCount += 1;
-    gAllocatorStats.allocations += 1;
-    gAllocatorStats.allocatedSize += size;
-    if(gAllocatorStats.allocatedSize > gAllocatorStats.peakAllocatedSize)
+// ======================= allocation profiler =================
+//
+// sites are stored densely and found through an open addressed index,
+// live pointers map back to the site that owns them so frees can be charged.
+
+#if PROFILE_ALLOCATIONS
+
+#define PROFILE_INITIAL_SITES 64
+
+struct alloc_profiler {
+    b8 enabled;
+
+    struct alloc_site_stats* sites;
+    u32 sitesLen;
+    u32 sitesCap;
+
+    u32* siteIndex; // site + 1, 0 is an empty slot
+    u32 siteIndexCap;
+
+    struct pointer_table pointers;
+};
+
+static struct alloc_profiler gProfiler;
+
+// __FILE__ strings are pooled within a translation unit, so the pointer is enough to hash on
+static u32 profile_hash_site(const char* file, i32 lineNumber)
+{
+    return hash_pointer(file) ^ ((u32) lineNumber * 2654435761u);
+}
+
+static void* profile_alloc(usize size)
+{
+    return backing_alloc(&gProfiler.pointers.backing, size);
+}
+
+static void profile_free(void* ptr, usize size)
+{
+    backing_free(&gProfiler.pointers.backing, ptr, size);
+}
+
+static void profile_release_all()
+{
+    profile_free(gProfiler.sites, sizeof(struct alloc_site_stats) * gProfiler.sitesCap);
+    profile_free(gProfiler.siteIndex, sizeof(u32) * gProfiler.siteIndexCap);
+    pointer_table_free(&gProfiler.pointers);
+
+    gProfiler.sites = NULL;
+    gProfiler.sitesLen = 0;
+    gProfiler.sitesCap = 0;
+    gProfiler.siteIndex = NULL;
+    gProfiler.siteIndexCap = 0;
+}
+
+// the profiler can't report errors from inside halloc, so if it runs out of memory it turns itself off
+static void profile_out_of_memory()
+{
+    fprintf(stderr, RED("allocation profiler ran out of memory, profiling disabled") "\n");
+    profile_release_all();
+    gProfiler.enabled = FALSE;
+}
+
+static b8 profile_grow_sites()
+{
+    u32 newCap = gProfiler.sitesCap ? gProfiler.sitesCap * 2 : PROFILE_INITIAL_SITES;
+    struct alloc_site_stats* sites = (struct alloc_site_stats*) profile_alloc(sizeof(struct alloc_site_stats) * newCap);
+    u32* siteIndex = (u32*) profile_alloc(sizeof(u32) * newCap * 2);
+    if(!sites || !siteIndex)
     {
-        gAllocatorStats.peakAllocatedSize = gAllocatorStats.allocatedSize;
+        profile_free(sites, sizeof(struct alloc_site_stats) * newCap);
+        profile_free(siteIndex, sizeof(u32) * newCap * 2);
+        return FALSE;
     }
 
-    if(gAllocatorStats.allocations > gAllocatorStats.peakAllocationsCount)
+    if(gProfiler.sitesLen)
     {
-        gAllocatorStats.peakAllocationsCount = gAllocatorStats.allocations;
+        memcpy(sites, gProfiler.sites, sizeof(struct alloc_site_stats) * gProfiler.sitesLen);
     }
 
-cleanup:
-    halc_end;
+    u32 mask = newCap * 2 - 1;
+    for(u32 i = 0; i < gProfiler.sitesLen; i += 1)
+    {
+        u32 slot = profile_hash_site(sites[i].file, sites[i].lineNumber) & mask;
+        while(siteIndex[slot])
+        {
+            slot = (slot + 1) & mask;
+        }
+        siteIndex[slot] = i + 1;
+    }
+
+    profile_free(gProfiler.sites, sizeof(struct alloc_site_stats) * gProfiler.sitesCap);
+    profile_free(gProfiler.siteIndex, sizeof(u32) * gProfiler.siteIndexCap);
+    gProfiler.sites = sites;
+    gProfiler.sitesCap = newCap;
+    gProfiler.siteIndex = siteIndex;
+    gProfiler.siteIndexCap = newCap * 2;
+    return TRUE;
 }
 
-// ======================= hash allocator =================
+static struct alloc_site_stats* profile_find_site(const char* file, i32 lineNumber, const char* func, u32* outSite)
+{
+    if(gProfiler.sitesLen == gProfiler.sitesCap && !profile_grow_sites())
+    {
+        return NULL;
+    }
+
+    u32 mask = gProfiler.siteIndexCap - 1;
+    u32 slot = profile_hash_site(file, lineNumber) & mask;
+    while(gProfiler.siteIndex[slot])
+    {
+        u32 site = gProfiler.siteIndex[slot] - 1;
+        struct alloc_site_stats* stats = &gProfiler.sites[site];
+        if(stats->lineNumber == lineNumber && stats->file == file)
+        {
+            *outSite = site;
+            return stats;
+        }
+        slot = (slot + 1) & mask;
+    }
+
+    u32 site = gProfiler.sitesLen;
+    gProfiler.sitesLen += 1;
+    gProfiler.siteIndex[slot] = site + 1;
+
+    struct alloc_site_stats* stats = &gProfiler.sites[site];
+    stats->file = file;
+    stats->lineNumber = lineNumber;
+    stats->func = func;
 
-void hfree_advanced(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+    *outSite = site;
+    return stats;
+}
+
+static void profile_add_live(struct alloc_site_stats* stats, usize size)
 {
-#if TRACK_ALLOCATIONS
-    if(gTrackAllocations)
+    stats->totalBytes += size;
+    stats->liveBytes += size;
+    if(stats->liveBytes > stats->peakLiveBytes)
     {
-        fprintf(stderr, GREEN("free(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, ptr, gContextString, func, file, lineNumber);
+        stats->peakLiveBytes = stats->liveBytes;
+    }
+    if((i64) size > stats->largestAllocation)
+    {
+        stats->largestAllocation = size;
     }
-#endif
-    gAllocatorStats.allocatedSize -= size;
-    gAllocatorStats.allocations -= 1;
-    gAllocatorStats.freeEventCount += 1;
-    gDefaultAllocator.free_fn(ptr);
 }
 
-void print_memory_statistics()
+// releases ptr from whichever site owns it, pointers from before profiling was enabled are ignored
+static void profile_remove_pointer(void* ptr, usize size, b8 isFree)
+{
+    struct pointer_record* record = pointer_table_find(&gProfiler.pointers, ptr);
+    if(!record)
+    {
+        return;
+    }
+
+    struct alloc_site_stats* owner = &gProfiler.sites[record->site];
+    owner->liveBytes -= size;
+    if(isFree)
+    {
+        owner->freeCount += 1;
+    }
+    pointer_table_remove(record);
+}
+
+static struct alloc_site_stats* profile_claim_pointer(void* ptr, const char* file, i32 lineNumber, const char* func)
 {
+    u32 site;
+    struct alloc_site_stats* stats = profile_find_site(file, lineNumber, func, &site);
+    struct pointer_record* record = stats ? pointer_table_insert(&gProfiler.pointers, ptr) : NULL;
+    if(!record)
+    {
+        profile_out_of_memory();
+        return NULL;
+    }
+
+    record->site = site;
+    return stats;
 }
 
-#define MEM_MIN(A, B) (A < B ? A : B)
+static void profile_record_alloc(void* ptr, usize size, const char* file, i32 lineNumber, const char* func)
+{
+    if(!gProfiler.enabled)
+    {
+        return;
+    }
 
-errc hrealloc_advanced(void** ptr, size_t size, size_t newSize, b8 allowShrink,const char* file, i32 lineNumber, const char* func)
+    struct alloc_site_stats* stats = profile_claim_pointer(ptr, file, lineNumber, func);
+    if(!stats)
+    {
+        return;
+    }
+
+    stats->allocCount += 1;
+    profile_add_live(stats, size);
+}
+
+static void profile_record_free(void* ptr, usize size)
 {
-    if (newSize == size && newSize == 0)
+    if(!gProfiler.enabled)
     {
-        halc_raise(ERR_BAD_REALLOC_PARAMETERS);
+        return;
     }
 
-    if(newSize == size)
+    profile_remove_pointer(ptr, size, TRUE);
+}
+
+static void profile_record_realloc(void* oldPtr, void* newPtr, usize size, usize newSize, const char* file, i32 lineNumber, const char* func)
+{
+    if(!gProfiler.enabled)
     {
-        halc_end;
+        return;
     }
 
-    if(!allowShrink && (newSize < size))
+    profile_remove_pointer(oldPtr, size, FALSE);
+
+    struct alloc_site_stats* stats = profile_claim_pointer(newPtr, file, lineNumber, func);
+    if(!stats)
     {
-        halc_raise(ERR_REALLOC_SHRUNK_WHEN_NOT_ALLOWED);
+        return;
     }
 
-    if (size == 0)
+    stats->reallocCount += 1;
+    stats->reallocBytes += newSize;
+    profile_add_live(stats, newSize);
+}
+
+#else
+
+#define profile_record_alloc(ptr, size, file, lineNumber, func)
+#define profile_record_free(ptr, size)
+#define profile_record_realloc(oldPtr, newPtr, size, newSize, file, lineNumber, func)
+
+#endif
+
+// ======================= debug heap =================
+//
+// every live heap pointer is recorded with its size and origin, frees and reallocs 
+// are validated against it. freed pointers keep their record (now pointing at the 
+// site that freed them) until the address is handed out again.
+
+#if DEBUG_HEAP
+
+struct debug_heap {
+    b8 enabled;
+    struct pointer_table pointers;
+};
+
+static struct debug_heap gDebugHeap;
+
+static void debug_heap_out_of_memory()
+{
+    fprintf(stderr, RED("debug heap ran out of memory, pointer tracking disabled") "\n");
+    pointer_table_free(&gDebugHeap.pointers);
+    gDebugHeap.enabled = FALSE;
+}
+
+static void debug_heap_record_alloc(void* ptr, usize size, const char* file, i32 lineNumber, const char* func)
+{
+    if(!gDebugHeap.enabled)
     {
-        halloc_advanced(ptr, newSize, file, lineNumber, func);
-        halc_end;
+        return;
     }
 
-    // allocate new memory
-    void* new = gDefaultAllocator.malloc_fn(newSize);
-    if(!new)
+    struct pointer_record* record = pointer_table_insert(&gDebugHeap.pointers, ptr);
+    if(!record)
     {
-        halc_raise(ERR_OUT_OF_MEMORY);
+        debug_heap_out_of_memory();
+        return;
     }
-    // copy from old to new
-    memcpy(new, *ptr, MEM_MIN(size, newSize));
-    
-    // clean up old ptr
-    gDefaultAllocator.free_fn(*ptr);
-    *ptr = new;
 
-    gAllocatorStats.allocEventCount += 1;
-    gAllocatorStats.freeEventCount += 1;
-    gAllocatorStats.reallocEventCount += 1;
-    gAllocatorStats.allocatedSize -= size;
-    gAllocatorStats.allocatedSize += newSize;
+    record->size = size;
+    record->file = file;
+    record->lineNumber = lineNumber;
+    record->func = func;
+}
 
-    halc_end;
+// validates a free or realloc of ptr. 
+// if the caller passed the wrong size it's reported and *size is corrected to the recorded one.
+static errc debug_heap_check(void* ptr, usize* size, const char* operation, const char* file, i32 lineNumber, const char* func)
+{
+    if(!gDebugHeap.enabled)
+    {
+        return ERR_OK;
+    }
+
+    // pointers from before the debug heap was enabled can't be checked
+    struct pointer_record* record = pointer_table_find(&gDebugHeap.pointers, ptr);
+    if(!record)
+    {
+        return ERR_OK;
+    }
+
+    if(record->freed)
+    {
+        if(!is_supressed_errors())
+        {
+            fprintf(stderr, RED("%s(0x%p) of freed memory") " at %s() %s:%d, previously freed at %s() %s:%d\n", 
+                    operation, ptr, func, file, lineNumber, record->func, record->file, record->lineNumber);
+        }
+        halc_raise(ERR_DOUBLE_FREE);
+    }
+
+    if(record->size != *size)
+    {
+        if(!is_supressed_errors())
+        {
+            fprintf(stderr, RED("%s(0x%p) with size %" PRId64 ", allocated with size %" PRId64) " at %s() %s:%d, allocated at %s() %s:%d\n", 
+                    operation, ptr, (i64) *size, (i64) record->size, func, file, lineNumber, record->func, record->file, record->lineNumber);
+        }
+        *size = record->size;
+        halc_raise(ERR_BAD_FREE_SIZE);
+    }
+
+    return ERR_OK;
+}
+
+static void debug_heap_record_free(void* ptr, const char* file, i32 lineNumber, const char* func)
+{
+    if(!gDebugHeap.enabled)
+    {
+        return;
+    }
+
+    struct pointer_record* record = pointer_table_find(&gDebugHeap.pointers, ptr);
+    if(!record)
+    {
+        return;
+    }
+
+    record->freed = TRUE;
+    record->file = file;
+    record->lineNumber = lineNumber;
+    record->func = func;
+}
+
+static void debug_heap_record_realloc(void* oldPtr, void* newPtr, usize newSize, const char* file, i32 lineNumber, const char* func)
+{
+    if(oldPtr != newPtr)
+    {
+        debug_heap_record_free(oldPtr, file, lineNumber, func);
+    }
+    debug_heap_record_alloc(newPtr, newSize, file, lineNumber, func);
+}
+
+// the runner expects every test to clean up after itself, once leaks are reported they're dropped
+static void debug_heap_forget_live()
+{
+    for(u32 i = 0; i < gDebugHeap.pointers.cap; i += 1)
+    {
+        struct pointer_record* record = &gDebugHeap.pointers.records[i];
+        if(record->ptr && record->ptr != POINTER_TOMBSTONE && !record->freed)
+        {
+            pointer_table_remove(record);
+        }
+    }
+}
+
+#else
+
+#define debug_heap_record_alloc(ptr, size, file, lineNumber, func)
+#define debug_heap_check(ptr, size, operation, file, lineNumber, func) ERR_OK
+#define debug_heap_record_free(ptr, file, lineNumber, func)
+#define debug_heap_record_realloc(oldPtr, newPtr, newSize, file, lineNumber, func)
+
+static void debug_heap_forget_live()
+{
+}
+
+#endif
+
+static b8 heap_debugging_enabled()
+{
+#if PROFILE_ALLOCATIONS
+    if(gProfiler.enabled)
+    {
+        return TRUE;
+    }
+#endif
+#if DEBUG_HEAP
+    if(gDebugHeap.enabled)
+    {
+        return TRUE;
+    }
+#endif
+    return FALSE;
+}
+
+static void heap_record_alloc(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+{
+    if(heap_debugging_enabled())
+    {
+        halc_mutex_lock(&gHeapDebugLock);
+        profile_record_alloc(ptr, size, file, lineNumber, func);
+        debug_heap_record_alloc(ptr, size, file, lineNumber, func);
+        halc_mutex_unlock(&gHeapDebugLock);
+    }
+
+    stats_record_alloc(size);
+}
+
+static errc heap_alloc(void** ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+{
+    if (size == 0)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    if(budget_charge(size) != ERR_OK)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    *ptr = gDefaultAllocator.malloc_fn(gDefaultAllocator.ctx, size);
+    if(!*ptr)
+    {
+        budget_refund(size);
+        halc_raiseCleanup(ERR_OUT_OF_MEMORY);
+    }
+
+#if TRACK_ALLOCATIONS
+    if(gTrackAllocations)
+    {
+        fprintf(stderr, YELLOW("alloc(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, *ptr, gContextString, func, file, lineNumber);
+    }
+#endif
+
+    heap_record_alloc(*ptr, size, file, lineNumber, func);
+
+cleanup:
+    halc_end;
+}
+
+errc halloc_advanced(void** ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+{
+    if(gActiveArena)
+    {
+        halc_try(arena_alloc(gActiveArena, ptr, size));
+        halc_end;
+    }
+
+    halc_try(heap_alloc(ptr, size, file, lineNumber, func));
+    halc_end;
+}
+
+// ======================= hash allocator =================
+
+static errc heap_free(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+{
+    // double frees never reach the allocator, a free with the wrong size is reported 
+    // and then goes through with the size the memory was allocated with.
+    //
+    // the pointer is marked freed before it's released, once free_fn returns another
+    // thread can be handed the same address.
+    errc check = ERR_OK;
+    if(heap_debugging_enabled())
+    {
+        halc_mutex_lock(&gHeapDebugLock);
+        check = debug_heap_check(ptr, &size, "free", file, lineNumber, func);
+        if(check != ERR_DOUBLE_FREE)
+        {
+            profile_record_free(ptr, size);
+            debug_heap_record_free(ptr, file, lineNumber, func);
+        }
+        halc_mutex_unlock(&gHeapDebugLock);
+
+        if(check == ERR_DOUBLE_FREE)
+        {
+            return check;
+        }
+    }
+
+#if TRACK_ALLOCATIONS
+    if(gTrackAllocations)
+    {
+        fprintf(stderr, GREEN("free(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, ptr, gContextString, func, file, lineNumber);
+    }
+#endif
+    stats_record_free(size);
+    budget_refund(size);
+    gDefaultAllocator.free_fn(gDefaultAllocator.ctx, ptr, size);
+
+    return check;
+}
+
+errc hfree_advanced(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func)
+{
+    if(gActiveArena && arena_owns(gActiveArena, ptr))
+    {
+        // only the most recent allocation can actually be given back
+        if(ptr == gActiveArena->last)
+        {
+            gActiveArena->head->used -= gActiveArena->lastSize;
+            gActiveArena->used -= gActiveArena->lastSize;
+            gActiveArena->last = NULL;
+            gActiveArena->lastSize = 0;
+        }
+        return ERR_OK;
+    }
+
+    return heap_free(ptr, size, file, lineNumber, func);
+}
+
+// ---- aligned allocations ----
+//
+// if the allocator doesn't supply an aligned_alloc_fn we over-allocate from malloc_fn 
+// and stash the original pointer just in front of the aligned one.
+
+static size_t aligned_fallback_size(size_t size, size_t alignment)
+{
+    return size + alignment + sizeof(void*);
+}
+
+errc halloc_aligned_advanced(void** ptr, size_t size, size_t alignment, const char* file, i32 lineNumber, const char* func)
+{
+    if(size == 0)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    if(alignment == 0 || (alignment & (alignment - 1)) != 0)
+    {
+        halc_raise(ERR_BAD_ALIGNMENT);
+    }
+
+    if(gDefaultAllocator.aligned_alloc_fn)
+    {
+        if(budget_charge(size) != ERR_OK)
+        {
+            halc_raise(ERR_OUT_OF_MEMORY);
+        }
+
+        *ptr = gDefaultAllocator.aligned_alloc_fn(gDefaultAllocator.ctx, size, alignment);
+        if(!*ptr)
+        {
+            budget_refund(size);
+            halc_raise(ERR_OUT_OF_MEMORY);
+        }
+        heap_record_alloc(*ptr, size, file, lineNumber, func);
+    }
+    else 
+    {
+        void* raw;
+        halc_try(heap_alloc(&raw, aligned_fallback_size(size, alignment), file, lineNumber, func));
+
+        usize aligned = ((usize) raw + sizeof(void*) + alignment - 1) & ~((usize) alignment - 1);
+        ((void**) aligned)[-1] = raw;
+        *ptr = (void*) aligned;
+    }
+
+#if TRACK_ALLOCATIONS
+    if(gTrackAllocations)
+    {
+        fprintf(stderr, YELLOW("aligned_alloc(%" PRId64 ", %" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, (i64)alignment, *ptr, gContextString, func, file, lineNumber);
+    }
+#endif
+
+    halc_end;
+}
+
+errc hfree_aligned_advanced(void* ptr, size_t size, size_t alignment, const char* file, i32 lineNumber, const char* func)
+{
+    if(gDefaultAllocator.aligned_alloc_fn)
+    {
+        return heap_free(ptr, size, file, lineNumber, func);
+    }
+
+    return heap_free(((void**) ptr)[-1], aligned_fallback_size(size, alignment), file, lineNumber, func);
+}
+
+void print_memory_statistics()
+{
+    struct allocatorStats stats;
+    get_allocator_stats(&stats);
+
+    printf("memory: %" PRId64 " bytes in %" PRId32 " allocations (peak: %" PRId64 " bytes in %" PRId32 " allocations)\n",
+            stats.allocatedSize,
+            stats.allocations,
+            stats.peakAllocatedSize,
+            stats.peakAllocationsCount);
+    printf("events: %" PRId64 " allocs %" PRId64 " frees %" PRId64 " reallocs\n",
+            stats.allocEventCount,
+            stats.freeEventCount,
+            stats.reallocEventCount);
+
+    if(allocation_profiling_enabled())
+    {
+        write_allocation_report(stdout, ALLOC_REPORT_TEXT);
+    }
+}
+
+// ---- profiler control and reports ----
+
+#if PROFILE_ALLOCATIONS
+
+errc enable_allocation_profiling()
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    if(!gProfiler.enabled)
+    {
+        pointer_table_init(&gProfiler.pointers);
+        gProfiler.enabled = TRUE;
+    }
+    halc_mutex_unlock(&gHeapDebugLock);
+    return ERR_OK;
+}
+
+void disable_allocation_profiling()
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    if(gProfiler.enabled)
+    {
+        profile_release_all();
+    }
+    gProfiler.enabled = FALSE;
+    halc_mutex_unlock(&gHeapDebugLock);
+}
+
+b8 allocation_profiling_enabled()
+{
+    return gProfiler.enabled;
+}
+
+u32 allocation_profile_sites(const struct alloc_site_stats** outSites)
+{
+    *outSites = gProfiler.sites;
+    return gProfiler.sitesLen;
+}
+
+static int compare_site_pointers(const void* a, const void* b)
+{
+    const struct alloc_site_stats* left = *(const struct alloc_site_stats**) a;
+    const struct alloc_site_stats* right = *(const struct alloc_site_stats**) b;
+
+    if(left->peakLiveBytes != right->peakLiveBytes)
+    {
+        return left->peakLiveBytes < right->peakLiveBytes ? 1 : -1;
+    }
+
+    if(left->totalBytes != right->totalBytes)
+    {
+        return left->totalBytes < right->totalBytes ? 1 : -1;
+    }
+
+    return 0;
+}
+
+static void write_json_string(FILE* out, const char* str)
+{
+    fputc('"', out);
+    for(const char* c = str; *c; c += 1)
+    {
+        if(*c == '"' || *c == '\\')
+        {
+            fputc('\\', out);
+        }
+        fputc(*c, out);
+    }
+    fputc('"', out);
+}
+
+static errc write_allocation_report_locked(FILE* out, enum alloc_report_format format)
+{
+    halc_assert(gProfiler.enabled);
+
+    const struct alloc_site_stats** sorted = NULL;
+    u32 sortedCount = HALC_MAX(gProfiler.sitesLen, 1);
+    usize sortedSize = sizeof(struct alloc_site_stats*) * sortedCount;
+    sorted = (const struct alloc_site_stats**) profile_alloc(sortedSize);
+    if(!sorted)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    for(u32 i = 0; i < gProfiler.sitesLen; i += 1)
+    {
+        sorted[i] = &gProfiler.sites[i];
+    }
+    qsort(sorted, gProfiler.sitesLen, sizeof(sorted[0]), compare_site_pointers);
+
+    if(format == ALLOC_REPORT_JSON)
+    {
+        fprintf(out, "{\"sites\":[");
+        for(u32 i = 0; i < gProfiler.sitesLen; i += 1)
+        {
+            const struct alloc_site_stats* site = sorted[i];
+            fprintf(out, "%s\n{\"file\":", i ? "," : "");
+            write_json_string(out, site->file);
+            fprintf(out, ",\"line\":%" PRId32 ",\"func\":", site->lineNumber);
+            write_json_string(out, site->func);
+            fprintf(out, ",\"allocs\":%" PRId64 ",\"frees\":%" PRId64 ",\"reallocs\":%" PRId64
+                    ",\"totalBytes\":%" PRId64 ",\"largestAllocation\":%" PRId64 ",\"reallocBytes\":%" PRId64
+                    ",\"liveBytes\":%" PRId64 ",\"peakLiveBytes\":%" PRId64 "}",
+                    site->allocCount, site->freeCount, site->reallocCount,
+                    site->totalBytes, site->largestAllocation, site->reallocBytes,
+                    site->liveBytes, site->peakLiveBytes);
+        }
+        fprintf(out, "\n]}\n");
+    }
+    else
+    {
+        fprintf(out, "allocation profile: %" PRIu32 " sites\n", gProfiler.sitesLen);
+        fprintf(out, "%12s %12s %12s %8s %8s %8s %12s  %s\n",
+                "peak live", "live", "total", "allocs", "frees", "reallocs", "realloc b", "site");
+        for(u32 i = 0; i < gProfiler.sitesLen; i += 1)
+        {
+            const struct alloc_site_stats* site = sorted[i];
+            fprintf(out, "%12" PRId64 " %12" PRId64 " %12" PRId64 " %8" PRId64 " %8" PRId64 " %8" PRId64 " %12" PRId64 "  %s() %s:%" PRId32 "\n",
+                    site->peakLiveBytes, site->liveBytes, site->totalBytes,
+                    site->allocCount, site->freeCount, site->reallocCount, site->reallocBytes,
+                    site->func, site->file, site->lineNumber);
+        }
+    }
+
+    profile_free(sorted, sortedSize);
+    halc_end;
+}
+
+errc write_allocation_report(FILE* out, enum alloc_report_format format)
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    errc result = write_allocation_report_locked(out, format);
+    halc_mutex_unlock(&gHeapDebugLock);
+    return result;
+}
+
+#else
+
+errc enable_allocation_profiling()
+{
+    halc_raise(ERR_PROFILING_DISABLED);
+}
+
+void disable_allocation_profiling()
+{
+}
+
+b8 allocation_profiling_enabled()
+{
+    return FALSE;
+}
+
+u32 allocation_profile_sites(const struct alloc_site_stats** outSites)
+{
+    *outSites = NULL;
+    return 0;
+}
+
+errc write_allocation_report(FILE* out, enum alloc_report_format format)
+{
+    halc_raise(ERR_PROFILING_DISABLED);
+}
+
+#endif
+
+// ---- debug heap control and leak reports ----
+
+#if DEBUG_HEAP
+
+errc enable_debug_heap()
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    if(!gDebugHeap.enabled)
+    {
+        pointer_table_init(&gDebugHeap.pointers);
+        gDebugHeap.enabled = TRUE;
+    }
+    halc_mutex_unlock(&gHeapDebugLock);
+    return ERR_OK;
+}
+
+void disable_debug_heap()
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    pointer_table_free(&gDebugHeap.pointers);
+    gDebugHeap.enabled = FALSE;
+    halc_mutex_unlock(&gHeapDebugLock);
+}
+
+b8 debug_heap_enabled()
+{
+    return gDebugHeap.enabled;
+}
+
+static int compare_records_by_site(const void* a, const void* b)
+{
+    const struct pointer_record* left = *(const struct pointer_record**) a;
+    const struct pointer_record* right = *(const struct pointer_record**) b;
+
+    int fileOrder = strcmp(left->file, right->file);
+    if(fileOrder)
+    {
+        return fileOrder;
+    }
+
+    return left->lineNumber - right->lineNumber;
+}
+
+static i64 debug_heap_report_leaks_locked(FILE* out)
+{
+    if(!gDebugHeap.enabled)
+    {
+        return 0;
+    }
+
+    i64 liveCount = 0;
+    for(u32 i = 0; i < gDebugHeap.pointers.cap; i += 1)
+    {
+        struct pointer_record* record = &gDebugHeap.pointers.records[i];
+        if(record->ptr && record->ptr != POINTER_TOMBSTONE && !record->freed)
+        {
+            liveCount += 1;
+        }
+    }
+
+    if(!liveCount)
+    {
+        return 0;
+    }
+
+    usize liveSize = sizeof(struct pointer_record*) * liveCount;
+    struct pointer_record** live = (struct pointer_record**) backing_alloc(&gDebugHeap.pointers.backing, liveSize);
+    if(!live)
+    {
+        fprintf(out, "%" PRId64 " live allocations, not enough memory to group them by call site\n", liveCount);
+        return liveCount;
+    }
+
+    i64 liveIndex = 0;
+    for(u32 i = 0; i < gDebugHeap.pointers.cap; i += 1)
+    {
+        struct pointer_record* record = &gDebugHeap.pointers.records[i];
+        if(record->ptr && record->ptr != POINTER_TOMBSTONE && !record->freed)
+        {
+            live[liveIndex] = record;
+            liveIndex += 1;
+        }
+    }
+    qsort(live, liveCount, sizeof(live[0]), compare_records_by_site);
+
+    fprintf(out, RED("%" PRId64 " live allocations") ":\n", liveCount);
+    i64 siteStart = 0;
+    while(siteStart < liveCount)
+    {
+        i64 siteEnd = siteStart;
+        i64 bytes = 0;
+        while(siteEnd < liveCount && compare_records_by_site(&live[siteStart], &live[siteEnd]) == 0)
+        {
+            bytes += live[siteEnd]->size;
+            siteEnd += 1;
+        }
+
+        fprintf(out, "  %8" PRId64 " allocations %12" PRId64 " bytes  %s() %s:%d\n", 
+                siteEnd - siteStart, bytes, live[siteStart]->func, live[siteStart]->file, live[siteStart]->lineNumber);
+        siteStart = siteEnd;
+    }
+
+    backing_free(&gDebugHeap.pointers.backing, live, liveSize);
+    return liveCount;
+}
+
+i64 debug_heap_report_leaks(FILE* out)
+{
+    halc_mutex_lock(&gHeapDebugLock);
+    i64 liveCount = debug_heap_report_leaks_locked(out);
+    halc_mutex_unlock(&gHeapDebugLock);
+    return liveCount;
+}
+
+#else
+
+errc enable_debug_heap()
+{
+    halc_raise(ERR_DEBUG_HEAP_DISABLED);
+}
+
+void disable_debug_heap()
+{
+}
+
+b8 debug_heap_enabled()
+{
+    return FALSE;
+}
+
+i64 debug_heap_report_leaks(FILE* out)
+{
+    return 0;
+}
+
+#endif
+
+#define MEM_MIN(A, B) (A < B ? A : B)
+
+static errc heap_realloc(void** ptr, size_t size, size_t newSize)
+{
+    // growing is charged up front, shrinking is given back once it went through
+    i64 growth = (i64) newSize - (i64) size;
+    if(budget_charge(growth) != ERR_OK)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    void* new = NULL;
+    if(gDefaultAllocator.realloc_fn)
+    {
+        // let the underlying heap grow the block in place if it can
+        new = gDefaultAllocator.realloc_fn(gDefaultAllocator.ctx, *ptr, size, newSize);
+        if(!new)
+        {
+            budget_refund(growth);
+            halc_raise(ERR_OUT_OF_MEMORY);
+        }
+    }
+    else 
+    {
+        // allocate new memory
+        new = gDefaultAllocator.malloc_fn(gDefaultAllocator.ctx, newSize);
+        if(!new)
+        {
+            budget_refund(growth);
+            halc_raise(ERR_OUT_OF_MEMORY);
+        }
+        // copy from old to new
+        memcpy(new, *ptr, MEM_MIN(size, newSize));
+
+        // clean up old ptr
+        gDefaultAllocator.free_fn(gDefaultAllocator.ctx, *ptr, size);
+    }
+    *ptr = new;
+    budget_refund(-growth);
+
+    return ERR_OK;
+}
+
+errc hrealloc_advanced(void** ptr, size_t size, size_t newSize, b8 allowShrink,const char* file, i32 lineNumber, const char* func)
+{
+    if (newSize == size && newSize == 0)
+    {
+        halc_raise(ERR_BAD_REALLOC_PARAMETERS);
+    }
+
+    if(newSize == size)
+    {
+        halc_end;
+    }
+
+    if(!allowShrink && (newSize < size))
+    {
+        halc_raise(ERR_REALLOC_SHRUNK_WHEN_NOT_ALLOWED);
+    }
+
+    if (size == 0)
+    {
+        halc_try(halloc_advanced(ptr, newSize, file, lineNumber, func));
+        halc_end;
+    }
+
+    if(gActiveArena && arena_owns(gActiveArena, *ptr))
+    {
+        halc_try(arena_realloc(gActiveArena, ptr, size, newSize));
+        halc_end;
+    }
+
+    if(!heap_debugging_enabled())
+    {
+        halc_try(heap_realloc(ptr, size, newSize));
+        stats_record_realloc(size, newSize);
+        halc_end;
+    }
+
+    // the lock is held across the realloc, otherwise another thread could be handed 
+    // the old address and record it before we get to mark it freed.
+    void* old = *ptr;
+    usize checkedSize = size;
+    halc_mutex_lock(&gHeapDebugLock);
+
+    halc_tryCleanup(debug_heap_check(old, &checkedSize, "realloc", file, lineNumber, func));
+    halc_tryCleanup(heap_realloc(ptr, size, newSize));
+    profile_record_realloc(old, *ptr, size, newSize, file, lineNumber, func);
+    debug_heap_record_realloc(old, *ptr, newSize, file, lineNumber, func);
+    stats_record_realloc(size, newSize);
+
+cleanup:
+    halc_mutex_unlock(&gHeapDebugLock);
+    halc_end;
+}
+
+// ======================= arena allocator =================
+
+#define ARENA_ALIGN_UP(X) (((X) + ARENA_ALIGNMENT - 1) & ~((usize)ARENA_ALIGNMENT - 1))
+#define ARENA_HEADER_SIZE ARENA_ALIGN_UP(sizeof(struct arena_block))
+
+static char* arena_block_data(struct arena_block* block)
+{
+    return ((char*) block) + ARENA_HEADER_SIZE;
+}
+
+errc arena_init(struct arena* arena, usize blockSize)
+{
+    arena->head = NULL;
+    arena->blockSize = blockSize ? blockSize : ARENA_DEFAULT_BLOCK_SIZE;
+    arena->used = 0;
+    arena->peakUsed = 0;
+    arena->blockCount = 0;
+    arena->last = NULL;
+    arena->lastSize = 0;
+    arena->previous = NULL;
+
+    halc_end;
+}
+
+static errc arena_new_block(struct arena* arena, usize minimumSize)
+{
+    usize cap = HALC_MAX(arena->blockSize, minimumSize);
+    struct arena_block* block;
+
+    halc_try(heap_alloc((void**) &block, ARENA_HEADER_SIZE + cap, __FILE__, __LINE__, __func__));
+
+    block->next = arena->head;
+    block->cap = cap;
+    block->used = 0;
+
+    arena->head = block;
+    arena->blockCount += 1;
+
+    halc_end;
+}
+
+errc arena_alloc(struct arena* arena, void** ptr, usize size)
+{
+    if(size == 0)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    usize alignedSize = ARENA_ALIGN_UP(size);
+
+    if(!arena->head || arena->head->cap - arena->head->used < alignedSize)
+    {
+        halc_try(arena_new_block(arena, alignedSize));
+    }
+
+    *ptr = arena_block_data(arena->head) + arena->head->used;
+    arena->head->used += alignedSize;
+
+    arena->last = *ptr;
+    arena->lastSize = alignedSize;
+
+    arena->used += alignedSize;
+    if(arena->used > arena->peakUsed)
+    {
+        arena->peakUsed = arena->used;
+    }
+
+    halc_end;
+}
+
+errc arena_realloc(struct arena* arena, void** ptr, usize size, usize newSize)
+{
+    usize alignedSize = ARENA_ALIGN_UP(newSize);
+
+    // most recent allocation, try to grow or shrink it in place
+    if(*ptr == arena->last)
+    {
+        usize start = (usize)((char*) arena->last - arena_block_data(arena->head));
+        if(start + alignedSize <= arena->head->cap)
+        {
+            arena->head->used = start + alignedSize;
+            arena->used = arena->used - arena->lastSize + alignedSize;
+            arena->lastSize = alignedSize;
+
+            if(arena->used > arena->peakUsed)
+            {
+                arena->peakUsed = arena->used;
+            }
+            halc_end;
+        }
+    }
+
+    void* newPtr;
+    halc_try(arena_alloc(arena, &newPtr, newSize));
+    memcpy(newPtr, *ptr, MEM_MIN(size, newSize));
+    *ptr = newPtr;
+
+    halc_end;
+}
+
+b8 arena_owns(const struct arena* arena, const void* ptr)
+{
+    const struct arena_block* block = arena->head;
+    while(block)
+    {
+        const char* data = arena_block_data((struct arena_block*) block);
+        if((const char*) ptr >= data && (const char*) ptr < data + block->cap)
+        {
+            return TRUE;
+        }
+        block = block->next;
+    }
+
+    return FALSE;
+}
+
+static void arena_release_blocks(struct arena* arena)
+{
+    struct arena_block* block = arena->head;
+    while(block)
+    {
+        struct arena_block* next = block->next;
+        heap_free(block, ARENA_HEADER_SIZE + block->cap, __FILE__, __LINE__, __func__);
+        block = next;
+    }
+
+    arena->head = NULL;
+    arena->blockCount = 0;
+}
+
+void arena_reset(struct arena* arena)
+{
+    if(arena->blockCount > 1)
+    {
+        // we spilled over, size the next block so this workload fits in one.
+        usize totalCap = 0;
+        struct arena_block* block = arena->head;
+        while(block)
+        {
+            totalCap += block->cap;
+            block = block->next;
+        }
+
+        arena_release_blocks(arena);
+        arena->blockSize = HALC_MAX(arena->blockSize, totalCap);
+    }
+    else if(arena->head)
+    {
+        arena->head->used = 0;
+    }
+
+    arena->used = 0;
+    arena->last = NULL;
+    arena->lastSize = 0;
+}
+
+void arena_free(struct arena* arena)
+{
+    arena_release_blocks(arena);
+    arena->used = 0;
+    arena->last = NULL;
+    arena->lastSize = 0;
+}
+
+void arena_push(struct arena* arena)
+{
+    arena->previous = gActiveArena;
+    gActiveArena = arena;
+}
+
+void arena_pop()
+{
+    if(gActiveArena)
+    {
+        gActiveArena = gActiveArena->previous;
+    }
+}
+
+void arena_get_mark(const struct arena* arena, struct arena_mark* outMark)
+{
+    outMark->block = arena->head;
+    outMark->blockUsed = arena->head ? arena->head->used : 0;
+    outMark->used = arena->used;
+}
+
+void arena_rewind(struct arena* arena, const struct arena_mark* mark)
+{
+    while(arena->head && arena->head != mark->block)
+    {
+        struct arena_block* block = arena->head;
+        if(!mark->block && !block->next)
+        {
+            block->used = 0;
+            break;
+        }
+
+        arena->head = block->next;
+        arena->blockCount -= 1;
+        heap_free(block, ARENA_HEADER_SIZE + block->cap, __FILE__, __LINE__, __func__);
+    }
+
+    if(mark->block)
+    {
+        mark->block->used = mark->blockUsed;
+    }
+
+    arena->used = mark->used;
+    arena->last = NULL;
+    arena->lastSize = 0;
+}
+
+// ======================= scratch allocator =================
+
+static HALC_THREAD_LOCAL struct arena gScratch = {NULL, SCRATCH_BLOCK_SIZE, 0, 0, 0, NULL, 0, NULL};
+
+void scratch_begin(struct arena_mark* outMark)
+{
+    arena_get_mark(&gScratch, outMark);
+}
+
+void scratch_end(const struct arena_mark* mark)
+{
+    struct memory_budget* budget = gActiveBudget;
+    gActiveBudget = NULL;
+    arena_rewind(&gScratch, mark);
+    gActiveBudget = budget;
+}
+
+errc scratch_alloc(void** ptr, usize size)
+{
+    // scratch blocks outlive whatever budget happens to be active
+    struct memory_budget* budget = gActiveBudget;
+    gActiveBudget = NULL;
+    errc result = arena_alloc(&gScratch, ptr, size);
+    gActiveBudget = budget;
+
+    return result;
+}
+
+usize scratch_remaining()
+{
+    if(!gScratch.head)
+    {
+        return 0;
+    }
+    return gScratch.head->cap - gScratch.head->used;
+}
+
+void scratch_release()
+{
+    struct memory_budget* budget = gActiveBudget;
+    gActiveBudget = NULL;
+    arena_free(&gScratch);
+    gActiveBudget = budget;
+    gScratch.peakUsed = 0;
+}
+
+// ======================= pool allocator =================
+
+errc pool_init(struct pool* pool, usize elementSize, u32 elementsPerSlab)
+{
+    if(elementsPerSlab == 0)
+    {
+        elementsPerSlab = POOL_DEFAULT_SLAB_CAPACITY;
+    }
+
+    pool->slabShift = 0;
+    pool->slabCapacity = 1;
+    while(pool->slabCapacity < elementsPerSlab)
+    {
+        pool->slabCapacity <<= 1;
+        pool->slabShift += 1;
+    }
+
+    // free slots store the free list link inline. The element size is kept exact 
+    // so typed pointer arithmetic over a slab matches pool_at, which means the 
+    // link may be unaligned and is always accessed through memcpy.
+    pool->elementSize = HALC_MAX(elementSize, sizeof(struct pool_free_slot));
+
+    pool->slabs = NULL;
+    pool->slabsLen = 0;
+    pool->slabsCap = 0;
+    pool->len = 0;
+    pool->liveCount = 0;
+    pool->freeList = NULL;
+
+    halc_end;
+}
+
+static errc pool_new_slab(struct pool* pool)
+{
+    if(pool->slabsLen == pool->slabsCap)
+    {
+        u32 newCap = HALC_MAX(pool->slabsCap * 2, 8);
+        hrealloc(&pool->slabs, pool->slabsCap * sizeof(void*), newCap * sizeof(void*), FALSE);
+        pool->slabsCap = newCap;
+    }
+
+    void* slab;
+    halloc(&slab, pool->elementSize * pool->slabCapacity);
+    pool->slabs[pool->slabsLen] = slab;
+    pool->slabsLen += 1;
+
+    halc_end;
+}
+
+errc pool_alloc_indexed(struct pool* pool, void** out, u32* outIndex)
+{
+    if(pool->len == pool->slabsLen * pool->slabCapacity)
+    {
+        halc_try(pool_new_slab(pool));
+    }
+
+    *out = pool_at(pool, pool->len);
+    if(outIndex)
+    {
+        *outIndex = pool->len;
+    }
+
+    pool->len += 1;
+    pool->liveCount += 1;
+
+    halc_end;
+}
+
+errc pool_alloc(struct pool* pool, void** out)
+{
+    if(pool->freeList)
+    {
+        *out = pool->freeList;
+        memcpy(&pool->freeList, *out, sizeof(pool->freeList));
+        pool->liveCount += 1;
+        halc_end;
+    }
+
+    halc_try(pool_alloc_indexed(pool, out, NULL));
+    halc_end;
+}
+
+void pool_release(struct pool* pool, void* ptr)
+{
+    memcpy(ptr, &pool->freeList, sizeof(pool->freeList));
+    pool->freeList = (struct pool_free_slot*) ptr;
+    pool->liveCount -= 1;
+}
+
+void pool_free(struct pool* pool)
+{
+    for(u32 i = 0; i < pool->slabsLen; i += 1)
+    {
+        hfree(pool->slabs[i], pool->elementSize * pool->slabCapacity);
+    }
+
+    if(pool->slabsCap > 0)
+    {
+        hfree(pool->slabs, pool->slabsCap * sizeof(void*));
+    }
+
+    pool->slabs = NULL;
+    pool->slabsLen = 0;
+    pool->slabsCap = 0;
+    pool->len = 0;
+    pool->liveCount = 0;
+    pool->freeList = NULL;
+}
+
+// ======================= string allocator =================
+
+struct string_page {
+    struct string_page* next;
+    struct allocator backing; // default allocator at the time the page was made
+};
+
+#define STRING_PAGE_HEADER_SIZE ARENA_ALIGN_UP(sizeof(struct string_page))
+
+struct string_size_class {
+    struct halc_mutex lock;
+    usize slotSize;
+
+    struct pool_free_slot* freeList;
+    char* bump; // unused tail of the newest page
+    char* bumpEnd;
+
+    struct string_page* pages;
+    i64 liveCount;
+    i64 slotCount;
+    i64 pageCount;
+};
+
+static struct string_size_class gStringClasses[STRING_SIZE_CLASS_COUNT] = {
+    {HALC_MUTEX_INITIALIZER, 16},
+    {HALC_MUTEX_INITIALIZER, 32},
+    {HALC_MUTEX_INITIALIZER, 64},
+    {HALC_MUTEX_INITIALIZER, 128},
+    {HALC_MUTEX_INITIALIZER, 256},
+};
+
+// returns -1 for sizes that don't fit in any class
+static i32 string_size_class(usize size)
+{
+    for(i32 i = 0; i < STRING_SIZE_CLASS_COUNT; i += 1)
+    {
+        if(size <= gStringClasses[i].slotSize)
+        {
+            return i;
+        }
+    }
+    return -1;
+}
+
+static errc string_class_take(struct string_size_class* sizeClass, void** out)
+{
+    errc result = ERR_OK;
+    halc_mutex_lock(&sizeClass->lock);
+
+    if(sizeClass->freeList)
+    {
+        *out = sizeClass->freeList;
+        sizeClass->freeList = sizeClass->freeList->next;
+    }
+    else
+    {
+        if(sizeClass->bump == sizeClass->bumpEnd)
+        {
+            struct string_page* page = (struct string_page*) gDefaultAllocator.malloc_fn(
+                    gDefaultAllocator.ctx, STRING_PAGE_HEADER_SIZE + STRING_SLAB_PAGE_SIZE);
+            if(!page)
+            {
+                result = ERR_OUT_OF_MEMORY;
+                goto unlock;
+            }
+
+            page->next = sizeClass->pages;
+            page->backing = gDefaultAllocator;
+            sizeClass->pages = page;
+            sizeClass->pageCount += 1;
+
+            sizeClass->bump = ((char*) page) + STRING_PAGE_HEADER_SIZE;
+            sizeClass->bumpEnd = sizeClass->bump + STRING_SLAB_PAGE_SIZE;
+        }
+
+        *out = sizeClass->bump;
+        sizeClass->bump += sizeClass->slotSize;
+        sizeClass->slotCount += 1;
+    }
+
+    sizeClass->liveCount += 1;
+
+unlock:
+    halc_mutex_unlock(&sizeClass->lock);
+    return result;
+}
+
+static void string_class_give(struct string_size_class* sizeClass, void* ptr)
+{
+    halc_mutex_lock(&sizeClass->lock);
+    struct pool_free_slot* slot = (struct pool_free_slot*) ptr;
+    slot->next = sizeClass->freeList;
+    sizeClass->freeList = slot;
+    sizeClass->liveCount -= 1;
+    halc_mutex_unlock(&sizeClass->lock);
+}
+
+errc halloc_string_advanced(void** ptr, usize size, const char* file, i32 lineNumber, const char* func)
+{
+    i32 index = string_size_class(size);
+    if(gActiveArena || index < 0 || size == 0)
+    {
+        halc_try(halloc_advanced(ptr, size, file, lineNumber, func));
+        halc_end;
+    }
+
+    struct string_size_class* sizeClass = &gStringClasses[index];
+    if(budget_charge(sizeClass->slotSize) != ERR_OK)
+    {
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+    if(string_class_take(sizeClass, ptr) != ERR_OK)
+    {
+        budget_refund(sizeClass->slotSize);
+        halc_raise(ERR_OUT_OF_MEMORY);
+    }
+
+#if TRACK_ALLOCATIONS
+    if(gTrackAllocations)
+    {
+        fprintf(stderr, YELLOW("string_alloc(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, *ptr, gContextString, func, file, lineNumber);
+    }
+#endif
+
+    heap_record_alloc(*ptr, sizeClass->slotSize, file, lineNumber, func);
+    halc_end;
+}
+
+errc hfree_string_advanced(void* ptr, usize size, const char* file, i32 lineNumber, const char* func)
+{
+    i32 index = string_size_class(size);
+    if(index < 0 || (gActiveArena && arena_owns(gActiveArena, ptr)))
+    {
+        return hfree_advanced(ptr, size, file, lineNumber, func);
+    }
+
+    usize slotSize = gStringClasses[index].slotSize;
+
+    // same checks as heap_free, the debug heap knows each string by its slot size
+    errc check = ERR_OK;
+    if(heap_debugging_enabled())
+    {
+        halc_mutex_lock(&gHeapDebugLock);
+        check = debug_heap_check(ptr, &slotSize, "free", file, lineNumber, func);
+        if(check != ERR_DOUBLE_FREE)
+        {
+            profile_record_free(ptr, slotSize);
+            debug_heap_record_free(ptr, file, lineNumber, func);
+        }
+        halc_mutex_unlock(&gHeapDebugLock);
+
+        if(check == ERR_DOUBLE_FREE)
+        {
+            return check;
+        }
+
+        // the recorded size may put the string in a different class, or outside of them
+        index = string_size_class(slotSize);
+    }
+
+#if TRACK_ALLOCATIONS
+    if(gTrackAllocations)
+    {
+        fprintf(stderr, GREEN("string_free(%" PRId64 ")->\"0x%p\" # %s %s() %s:%d\n"), (i64)size, ptr, gContextString, func, file, lineNumber);
+    }
+#endif
+
+    stats_record_free(slotSize);
+    budget_refund(slotSize);
+
+    if(index < 0)
+    {
+        gDefaultAllocator.free_fn(gDefaultAllocator.ctx, ptr, slotSize);
+        return check;
+    }
+
+    string_class_give(&gStringClasses[index], ptr);
+    return check;
+}
+
+errc hrealloc_string_advanced(void** ptr, usize size, usize newSize, const char* file, i32 lineNumber, const char* func)
+{
+    if(size == 0)
+    {
+        halc_try(halloc_string_advanced(ptr, newSize, file, lineNumber, func));
+        halc_end;
+    }
+
+    i32 from = string_size_class(size);
+    i32 to = string_size_class(newSize);
+
+    if((from < 0 && to < 0) || (gActiveArena && arena_owns(gActiveArena, *ptr)))
+    {
+        halc_try(hrealloc_advanced(ptr, size, newSize, TRUE, file, lineNumber, func));
+        halc_end;
+    }
+
+    if(from == to)
+    {
+        // still fits in the same slot
+        return ERR_OK;
+    }
+
+    void* newPtr;
+    halc_try(halloc_string_advanced(&newPtr, newSize, file, lineNumber, func));
+    memcpy(newPtr, *ptr, MEM_MIN(size, newSize));
+    halc_try(hfree_string_advanced(*ptr, size, file, lineNumber, func));
+    *ptr = newPtr;
+
+    halc_end;
+}
+
+void get_string_class_stats(struct string_class_stats* outStats)
+{
+    for(i32 i = 0; i < STRING_SIZE_CLASS_COUNT; i += 1)
+    {
+        struct string_size_class* sizeClass = &gStringClasses[i];
+        halc_mutex_lock(&sizeClass->lock);
+        outStats[i].slotSize = sizeClass->slotSize;
+        outStats[i].liveCount = sizeClass->liveCount;
+        outStats[i].slotCount = sizeClass->slotCount;
+        outStats[i].pageCount = sizeClass->pageCount;
+        halc_mutex_unlock(&sizeClass->lock);
+    }
+}
+
+void release_string_pages()
+{
+    for(i32 i = 0; i < STRING_SIZE_CLASS_COUNT; i += 1)
+    {
+        struct string_size_class* sizeClass = &gStringClasses[i];
+        halc_mutex_lock(&sizeClass->lock);
+
+        if(sizeClass->liveCount == 0)
+        {
+            struct string_page* page = sizeClass->pages;
+            while(page)
+            {
+                struct string_page* next = page->next;
+                struct allocator backing = page->backing;
+                backing.free_fn(backing.ctx, page, STRING_PAGE_HEADER_SIZE + STRING_SLAB_PAGE_SIZE);
+                page = next;
+            }
+
+            sizeClass->pages = NULL;
+            sizeClass->freeList = NULL;
+            sizeClass->bump = NULL;
+            sizeClass->bumpEnd = NULL;
+            sizeClass->slotCount = 0;
+            sizeClass->pageCount = 0;
+        }
+
+        halc_mutex_unlock(&sizeClass->lock);
+    }
 }
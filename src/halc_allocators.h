@@ -2,6 +2,7 @@
 #define _HALC_ALLOCATORS_H_
 
 #include <stdlib.h>
+#include <stdio.h>
 #include "halc_errors.h"
 
 EXTERN_C_BEGIN
@@ -12,6 +13,10 @@ EXTERN_C_BEGIN
 
 
 // == statistics ==
+//
+// the process wide totals are kept with relaxed atomics, so any thread can allocate
+// without taking a lock and peaks still cover every thread. each thread also keeps
+// its own counters, eg. to see the peak of a single worker.
 struct allocatorStats{
     i32 allocations;
     i32 peakAllocationsCount;
@@ -22,15 +27,36 @@ struct allocatorStats{
     i64 peakAllocatedSize;
 };
 
+void get_allocator_stats(struct allocatorStats* outStats);
+
+// counters for allocations made and freed on the calling thread only
+void get_thread_allocator_stats(struct allocatorStats* outStats);
+
 // ==================== Allocators ======================
 
 // uses default C allocator that comes with your os support package.
 errc setup_default_allocator(); // NAME_TODO
 
 // allocator interface
+//
+// every callback receives the allocator's ctx pointer back, so engine heaps, 
+// tagged memory budgets and so on can be plugged in without globals.
+//
+// malloc_fn and free_fn are required.
+//
+// realloc_fn is optional, when it's NULL hrealloc falls back to malloc + copy + free.
+// it should behave like realloc: return NULL and leave ptr alone on failure.
+//
+// aligned_alloc_fn is optional, when it's NULL aligned allocations are carved out of 
+// a larger malloc_fn allocation. Memory returned by aligned_alloc_fn is released through free_fn.
+//
+// free_fn is a sized free, size is always the size the allocation was made (or last reallocated) with.
 struct allocator{
-    void* (*malloc_fn) (size_t);
-    void (*free_fn) (void*);
+    void* ctx;
+    void* (*malloc_fn) (void* ctx, size_t size);
+    void* (*realloc_fn) (void* ctx, void* ptr, size_t size, size_t newSize);
+    void* (*aligned_alloc_fn) (void* ctx, size_t size, size_t alignment);
+    void (*free_fn) (void* ctx, void* ptr, size_t size);
 };
 
 
@@ -38,14 +64,15 @@ struct allocator{
 // unless a special allocator is needed
 extern struct allocator gDefaultAllocator;
 
-// overrides gDefaultAllocator with a custom malloc and free function
-errc setup_default_custom_allocator(void* (*malloc_fn) (size_t), void (*free_fn) (void*)); // NAME_TODO
-
+// overrides gDefaultAllocator with a custom allocator, the allocator is copied.
+// should be called before anything is allocated, memory allocated by the previous 
+// allocator can not be freed after the swap.
+errc setup_default_custom_allocator(const struct allocator* allocator); // NAME_TODO
 
 // Will go to cleanup if alloc fails for any reason.
 #define halloc(ptr, size) halc_try(halloc_advanced((void**) ptr, size, __FILE__, __LINE__, __func__))
 
-#define halloc_cleanup(ptr, size) try_cleanup(halloc_advanced((void**) ptr, size))
+#define halloc_cleanup(ptr, size) halc_tryCleanup(halloc_advanced((void**) ptr, size, __FILE__, __LINE__, __func__))
 
 // deletes selected pointer
 // size of old allocation is needed for potential perf optimizations and debugging
@@ -57,15 +84,362 @@ errc setup_default_custom_allocator(void* (*malloc_fn) (size_t), void (*free_fn)
 // modifies existing pointer, on failure no reallocation happens
 #define hrealloc(ptr, size, newSize, allowShrink) halc_try(hrealloc_advanced((void**)ptr, size, newSize, allowShrink, __FILE__, __LINE__, __func__))
 
+// allocates memory aligned to (alignment) bytes, alignment must be a power of two.
+// memory from halloc_aligned must be released with hfree_aligned
+#define halloc_aligned(ptr, size, alignment) halc_try(halloc_aligned_advanced((void**) ptr, size, alignment, __FILE__, __LINE__, __func__))
+#define hfree_aligned(ptr, size, alignment) hfree_aligned_advanced(ptr, size, alignment, __FILE__, __LINE__, __func__)
+
 // backing code for halloc
 errc halloc_advanced(void** ptr, size_t size, const char* file, i32 lineNumber, const char* func);
-void hfree_advanced(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func);
+errc hfree_advanced(void* ptr, size_t size, const char* file, i32 lineNumber, const char* func);
 errc hrealloc_advanced(void** ptr, size_t size, size_t newSize, b8 allowShrink, const char* file, i32 lineNumber, const char* func);
+errc halloc_aligned_advanced(void** ptr, size_t size, size_t alignment, const char* file, i32 lineNumber, const char* func);
+errc hfree_aligned_advanced(void* ptr, size_t size, size_t alignment, const char* file, i32 lineNumber, const char* func);
+
+// tracking printouts and their context string are per thread.
+// untrack_allocs checks and resets the process wide totals, so it should only be 
+// called while no other thread is allocating.
 void track_allocs(const char* contextString); // NAME_TODO
 errc untrack_allocs(struct allocatorStats* outTrackedAllocationStats); // NAME_TODO
 void print_memory_statistics(); // NAME_TODO
 errc enable_allocation_tracking(); // NAME_TODO
 
+// ==================== Allocation Profiler ======================
+//
+// aggregates heap traffic per call site (the file/line/func halloc already receives).
+// off by default, when enabled every heap allocation does one extra hash lookup 
+// under a lock shared with the debug heap.
+//
+// a pointer is owned by the site that last allocated or reallocated it, so
+// liveBytes/peakLiveBytes show what a site is holding on to, while reallocBytes
+// shows how much resizing churn it caused.
+//
+// allocations made inside an arena are charged to the arena's blocks.
+//
+// eg.
+//
+//  enable_allocation_profiling();
+//  halc_try(tokenize(&ts, &source, &filename));
+//  halc_try(parse_tokens(&graph, &ts));
+//  write_allocation_report(stdout, ALLOC_REPORT_TEXT);
+//  disable_allocation_profiling();
+//
+#ifndef PROFILE_ALLOCATIONS
+#define PROFILE_ALLOCATIONS 1
+#endif
+
+struct alloc_site_stats {
+    const char* file;
+    i32 lineNumber;
+    const char* func;
+
+    i64 allocCount;
+    i64 freeCount;
+    i64 reallocCount;
+
+    i64 totalBytes; // every byte requested through this site, including reallocs
+    i64 largestAllocation;
+    i64 reallocBytes; // sum of the new sizes of every realloc made here
+
+    i64 liveBytes;
+    i64 peakLiveBytes;
+};
+
+enum alloc_report_format {
+    ALLOC_REPORT_TEXT,
+    ALLOC_REPORT_JSON
+};
+
+// profiler bookkeeping comes from the default allocator that was set when profiling
+// was enabled, it is not counted in the allocator statistics.
+errc enable_allocation_profiling();
+
+// releases the profile and everything collected so far
+void disable_allocation_profiling();
+b8 allocation_profiling_enabled();
+
+// returns the number of sites recorded so far, the sites are in no particular order
+// and are only valid until the next allocation.
+u32 allocation_profile_sites(const struct alloc_site_stats** outSites);
+
+// writes every site, sorted by peak live bytes then total bytes
+errc write_allocation_report(FILE* out, enum alloc_report_format format);
+
+// ==================== Debug Heap ======================
+//
+// records every live heap pointer with its size and the call site that made it.
+//
+// - hfree/hrealloc of memory that was already freed raises ERR_DOUBLE_FREE and 
+//   never reaches the allocator.
+// - hfree/hrealloc with a size that doesn't match the allocation raises ERR_BAD_FREE_SIZE,
+//   frees still go through with the recorded size so the statistics stay correct.
+// - leaks are reported grouped by call site, untrack_allocs does this automatically.
+//
+// every heap operation pays for a table lookup, it's meant for leak hunts and tests
+// in builds without a sanitizer. enable it before anything is allocated, pointers 
+// from before it was enabled are not checked.
+#ifndef DEBUG_HEAP
+#define DEBUG_HEAP 1
+#endif
+
+errc enable_debug_heap();
+void disable_debug_heap();
+b8 debug_heap_enabled();
+
+// prints every live allocation grouped by call site, returns the number of live allocations
+i64 debug_heap_report_leaks(FILE* out);
+
+// ==================== Memory Budgets ======================
+//
+// a budget is a hard limit on how much heap memory a subsystem (a compile, a story, 
+// a world) may hold at once. While a budget is pushed on a thread every heap allocation
+// made by that thread is charged to it, and an allocation that would go over the limit
+// fails with ERR_OUT_OF_MEMORY before the default allocator is ever called.
+//
+// - frees and shrinking reallocs give the memory back to the budget that is active 
+//   at the time, so memory charged to a budget has to be freed while it's pushed, 
+//   same as with arenas.
+// - arena blocks are charged when the block is created, allocations inside the
+//   arena are not. scratch memory is never charged.
+// - a budget can be pushed on several threads at once, the counters are atomic.
+//
+// eg.
+//
+//  struct memory_budget worldBudget;
+//  memory_budget_init(&worldBudget, "world 0", 4 * 1024 * 1024);
+//
+//  memory_budget_push(&worldBudget);
+//  halc_tryCleanup(tokenize(&ts, &source, &filename)); // ERR_OUT_OF_MEMORY past 4MB
+//  ...
+//  memory_budget_pop();
+//
+struct memory_budget {
+    const char* name;
+    i64 limit; // 0 means unlimited, the budget only keeps count
+
+    volatile i64 current;
+    volatile i64 peak;
+    volatile i64 failedAllocations; // allocations refused for going over the limit
+
+    struct memory_budget* previous; // budget that was active before this one was pushed
+};
+
+struct memory_budget_stats {
+    i64 limit;
+    i64 current;
+    i64 peak;
+    i64 failedAllocations;
+};
+
+void memory_budget_init(struct memory_budget* budget, const char* name, i64 limit);
+void get_memory_budget_stats(const struct memory_budget* budget, struct memory_budget_stats* outStats);
+
+// the peak is set back to the current usage, eg. to measure a single frame
+void memory_budget_reset_peak(struct memory_budget* budget);
+
+// charges every heap allocation made on this thread to the budget until the matching memory_budget_pop()
+void memory_budget_push(struct memory_budget* budget);
+void memory_budget_pop();
+struct memory_budget* memory_budget_active();
+
+// ==================== Arena Allocator ======================
+//
+// bump allocator intended to be owned by a single compile.
+//
+// while an arena is pushed, every halloc/hrealloc lands in one of the arena's
+// blocks and hfree on arena memory is a no-op (unless it was the most recent
+// allocation, then it gets rolled back). The entire compile is then released 
+// with one arena_reset().
+//
+// blocks come from the default allocator so they show up in allocator statistics, 
+// individual allocations made inside the arena do not.
+//
+// note: memory handed out by an arena must not be hfree'd after the arena is popped.
+//
+// eg.
+//
+//  struct arena compileArena;
+//  halc_try(arena_init(&compileArena, 0));
+//
+//  arena_push(&compileArena);
+//  halc_tryCleanup(tokenize(&ts, &source, &filename));
+//  halc_tryCleanup(parse_tokens(&graph, &ts));
+//  arena_pop();
+//
+//  arena_reset(&compileArena); // everything from the compile is gone
+//
+#define ARENA_DEFAULT_BLOCK_SIZE (64 * 1024)
+#define ARENA_ALIGNMENT 16
+
+struct arena_block;
+
+struct arena {
+    struct arena_block* head; // most recently allocated block, this is the one we bump from
+    usize blockSize; // minimum size of a new block
+    usize used; // bytes handed out across all blocks
+    usize peakUsed; 
+    i32 blockCount;
+
+    // last allocation, can be grown or rolled back in place
+    void* last;
+    usize lastSize;
+
+    struct arena* previous; // arena that was active before this one was pushed
+};
+
+// blockSize of 0 uses ARENA_DEFAULT_BLOCK_SIZE, no memory is allocated until first use
+errc arena_init(struct arena* arena, usize blockSize);
+errc arena_alloc(struct arena* arena, void** ptr, usize size);
+errc arena_realloc(struct arena* arena, void** ptr, usize size, usize newSize);
+b8 arena_owns(const struct arena* arena, const void* ptr);
+
+// releases every allocation in the arena, if the arena had spilled into multiple blocks
+// they are coalesced so the next compile of the same size fits in a single block.
+void arena_reset(struct arena* arena);
+
+// returns all blocks back to the default allocator
+void arena_free(struct arena* arena);
+
+// routes halloc/hfree/hrealloc into the arena until the matching arena_pop()
+void arena_push(struct arena* arena);
+void arena_pop();
+
+// position inside an arena, everything allocated after the mark can be dropped
+// in one go with arena_rewind.
+struct arena_mark {
+    struct arena_block* block;
+    usize blockUsed;
+    usize used;
+};
+
+void arena_get_mark(const struct arena* arena, struct arena_mark* outMark);
+
+// blocks that were added after the mark are released, when the mark was taken on an 
+// empty arena the oldest block is kept around for reuse.
+void arena_rewind(struct arena* arena, const struct arena_mark* mark);
+
+// ==================== Scratch Allocator ======================
+//
+// per thread LIFO stack for short lived buffers, eg. the raw bytes of a file before
+// it's decoded or a line being formatted for a diagnostic.
+//
+// scratch_begin() takes a mark, scratch_end() throws away everything allocated since
+// the matching scratch_begin(). Marks must be ended in reverse order. When a buffer 
+// does not fit the stack grows by another block, blocks that were added are released 
+// again once the stack is rewound past them.
+//
+// scratch memory is never routed through the active arena and is never hfree'd.
+// the first block is kept cached by each thread until scratch_release(), untrack_allocs
+// does this for the calling thread, worker threads should call it before they exit.
+//
+// eg.
+//
+//  struct arena_mark mark;
+//  scratch_begin(&mark);
+//  char* line;
+//  halc_tryCleanup(scratch_alloc((void**) &line, lineLength));
+//  ...
+// cleanup:
+//  scratch_end(&mark);
+//
+#define SCRATCH_BLOCK_SIZE (64 * 1024)
+
+void scratch_begin(struct arena_mark* outMark);
+void scratch_end(const struct arena_mark* mark);
+errc scratch_alloc(void** ptr, usize size);
+
+// bytes that can be allocated before the scratch stack has to grow
+usize scratch_remaining();
+
+// frees the calling thread's scratch blocks, there must be no open marks.
+void scratch_release();
+
+// ==================== Pool Allocator ======================
+//
+// fixed size slot allocator, slots are handed out of slabs of (slabCapacity) elements.
+//
+// - slot addresses are stable, slabs are never moved or resized.
+// - pool_alloc and pool_release are O(1), released slots go on a free list and get reused.
+// - slots are also numbered in the order they were bumped out of the slabs, 
+//   pool_alloc_indexed always bumps and hands back that number so array-like users 
+//   (parser ast, graph nodes) can keep addressing by index with pool_at.
+//
+// the parser, the graph and long lived runtime objects use this to avoid the copy 
+// spikes that come with doubling a flat array.
+#define POOL_DEFAULT_SLAB_CAPACITY 256
+
+struct pool_free_slot {
+    struct pool_free_slot* next;
+};
+
+struct pool {
+    usize elementSize;
+    u32 slabCapacity; // always a power of two
+    u32 slabShift;
+
+    void** slabs;
+    u32 slabsLen;
+    u32 slabsCap;
+
+    u32 len; // number of slots bumped out of the slabs so far
+    u32 liveCount; // number of slots currently handed out
+
+    struct pool_free_slot* freeList;
+};
+
+// elementsPerSlab is rounded up to a power of two, 0 uses POOL_DEFAULT_SLAB_CAPACITY
+errc pool_init(struct pool* pool, usize elementSize, u32 elementsPerSlab);
+errc pool_alloc(struct pool* pool, void** out);
+errc pool_alloc_indexed(struct pool* pool, void** out, u32* outIndex);
+void pool_release(struct pool* pool, void* ptr);
+void pool_free(struct pool* pool);
+
+static inline void* pool_at(const struct pool* pool, u32 index)
+{
+    return ((char*) pool->slabs[index >> pool->slabShift]) + 
+        (usize)(index & (pool->slabCapacity - 1)) * pool->elementSize;
+}
+
+// ==================== String Allocator ======================
+//
+// hstr buffers are mostly short (labels, speakers, single lines of speech) so they 
+// come out of size classes instead of individual heap allocations. Requests up to 
+// 256 bytes are rounded up to the next 16/32/64/128/256 byte slot, anything larger 
+// falls back to halloc.
+//
+// - slots are carved out of 64K pages and recycled through a free list per class, 
+//   each class has its own lock so any thread can allocate strings.
+// - a reallocation that stays within its class is free.
+// - while an arena is pushed strings are allocated from the arena like everything else.
+// - statistics, budgets, the profiler and the debug heap see every string at the size 
+//   of its slot. the pages themselves come straight from the default allocator and 
+//   are not counted.
+//
+// like hfree, the size passed to hfree_string must be the size the string was allocated with.
+#define STRING_SIZE_CLASS_COUNT 5
+#define STRING_SLAB_PAGE_SIZE (64 * 1024)
+
+#define halloc_string(ptr, size) halc_try(halloc_string_advanced((void**) ptr, size, __FILE__, __LINE__, __func__))
+#define hfree_string(ptr, size) hfree_string_advanced(ptr, size, __FILE__, __LINE__, __func__)
+#define hrealloc_string(ptr, size, newSize) halc_try(hrealloc_string_advanced((void**) ptr, size, newSize, __FILE__, __LINE__, __func__))
+
+errc halloc_string_advanced(void** ptr, usize size, const char* file, i32 lineNumber, const char* func);
+errc hfree_string_advanced(void* ptr, usize size, const char* file, i32 lineNumber, const char* func);
+errc hrealloc_string_advanced(void** ptr, usize size, usize newSize, const char* file, i32 lineNumber, const char* func);
+
+struct string_class_stats {
+    usize slotSize;
+    i64 liveCount;
+    i64 slotCount; // slots carved out of pages so far, live or on the free list
+    i64 pageCount;
+};
+
+// fills in STRING_SIZE_CLASS_COUNT entries, smallest class first
+void get_string_class_stats(struct string_class_stats* outStats);
+
+// returns the pages of every class that has no live strings left
+void release_string_pages();
+
 EXTERN_C_END
 
 #endif
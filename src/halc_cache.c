@@ -0,0 +1,455 @@
+#include "halc_cache.h"
+#include "halc_allocators.h"
+#include "halc_files.h"
+#include "halc_hash.h"
+#include "halc_parser.h"
+#include "halc_threads.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#define CACHE_MAGIC 0x43434c48 // "HLCC"
+#define CACHE_FORMAT 2
+#define CACHE_EXTENSION ".htok"
+#define CACHE_TEMP_EXTENSION ".tmp"
+
+// an artifact is the header, then the file's distinct labels, then its tokens. Labels
+// are interned once per artifact instead of once per token, most tokens are labels.
+struct cache_header {
+    u32 magic;
+    u32 format;
+    u64 key;
+    u64 check;      // the source hashed with another seed, a colliding key still has to get past this
+    u32 sourceLen;
+    u32 tokenCount;
+    u32 labelCount;
+    u32 reserved;
+};
+
+// where the label first shows up in the source
+struct cache_label {
+    u32 offset;
+    u32 len;
+};
+
+struct cache_token {
+    u32 offset;     // into the source
+    u32 len;
+    i32 lineNumber;
+    u32 typeAndLabel; // token type in the low byte, the index of its label above that
+};
+
+// temp names carry the pid and this counter, so neither processes nor threads sharing a directory collide
+static volatile i64 gCacheTempCounter = 0;
+
+static u64 cache_check_seed(const struct compile_cache* cache)
+{
+    return cache->seed ^ 0x9e3779b97f4a7c15ull;
+}
+
+static b8 is_cache_file(const char* name)
+{
+    usize len = strlen(name);
+    usize extLen = sizeof(CACHE_EXTENSION) - 1;
+    usize tempLen = sizeof(CACHE_TEMP_EXTENSION) - 1;
+    return (len > extLen && memcmp(name + len - extLen, CACHE_EXTENSION, extLen) == 0) ||
+        (len > tempLen && memcmp(name + len - tempLen, CACHE_TEMP_EXTENSION, tempLen) == 0);
+}
+
+errc compile_cache_open(struct compile_cache* cache, const hstr* dirPath)
+{
+    memset(cache, 0, sizeof(*cache));
+    cache->seed = halc_hash64(HALC_COMPILER_VERSION, sizeof(HALC_COMPILER_VERSION) - 1, CACHE_FORMAT);
+
+    halc_try(copy_root_path(&cache->dir, dirPath));
+
+#if defined(_WIN32)
+    if(!CreateDirectoryA(cache->dir.buffer, NULL) && GetLastError() != ERROR_ALREADY_EXISTS)
+#else
+    if(mkdir(cache->dir.buffer, 0777) != 0 && errno != EEXIST)
+#endif
+    {
+        fprintf(stderr, "\n  Unable to create cache directory: %s\n", cache->dir.buffer);
+        hstr_free(&cache->dir);
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    halc_end;
+}
+
+void compile_cache_close(struct compile_cache* cache)
+{
+    hstr_free(&cache->dir);
+}
+
+static errc cache_artifact_path(const struct compile_cache* cache, u64 key, hstr* out)
+{
+    char name[32];
+    snprintf(name, sizeof(name), "/%016" PRIx64 CACHE_EXTENSION, key);
+
+    hstr_init(out);
+    halc_try(hstr_append(out, &cache->dir));
+    halc_try(hstr_append_cstr(out, name));
+
+    halc_end;
+}
+
+// the same setup tokenize_raw does for the stream, before any tokens are added
+static errc cache_init_stream(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols)
+{
+    ts->source = *source;
+    ts->filename = *filename;
+
+    ts->symbols = symbols;
+    ts->ownsSymbols = FALSE;
+    if(!symbols)
+    {
+        halloc(&ts->symbols, sizeof(struct symbol_table));
+        ts->ownsSymbols = TRUE;
+        halc_try(symbol_table_init(ts->symbols));
+    }
+
+    halc_end;
+}
+
+// FALSE if anything about the artifact doesn't check out
+static b8 cache_validate(const u8* body, const struct cache_header* header, const hstr* source)
+{
+    const struct cache_label* labels = (const struct cache_label*) body;
+    const struct cache_token* tokens = (const struct cache_token*) (labels + header->labelCount);
+
+    for(u32 i = 0; i < header->labelCount; i += 1)
+    {
+        if(labels[i].offset > source->len || labels[i].len > source->len - labels[i].offset)
+        {
+            return FALSE;
+        }
+    }
+
+    for(u32 i = 0; i < header->tokenCount; i += 1)
+    {
+        u32 tokenType = tokens[i].typeAndLabel & 0xff;
+        if(tokenType > COMMENT || tokens[i].offset > source->len || tokens[i].len > source->len - tokens[i].offset)
+        {
+            return FALSE;
+        }
+        if(tokenType == LABEL && (tokens[i].typeAndLabel >> 8) >= header->labelCount)
+        {
+            return FALSE;
+        }
+    }
+
+    return TRUE;
+}
+
+// builds the stream from an artifact if there's a usable one, anything that doesn't 
+// check out is a miss. Only fails if the stream can't be built.
+static errc cache_load(const hstr* path, const struct cache_header* expected, struct tokenStream* ts, 
+    const hstr* source, const hstr* filename, struct symbol_table* symbols, b8* outHit)
+{
+    u8* body = NULL;
+    usize bodySize = 0;
+    u32* labelSymbols = NULL;
+    struct cache_header header;
+
+    *outHit = FALSE;
+    FILE* file = h_fopen(path->buffer, "rb");
+    if(!file)
+    {
+        halc_end_ok;
+        halc_end;
+    }
+
+    if(fread(&header, sizeof(header), 1, file) != 1 || header.magic != expected->magic || 
+        header.format != expected->format || header.key != expected->key || 
+        header.check != expected->check || header.sourceLen != expected->sourceLen)
+    {
+        goto miss;
+    }
+
+    // a damaged count mustn't turn into a huge allocation, check it against the file first
+    bodySize = (usize) header.labelCount * sizeof(struct cache_label) + (usize) header.tokenCount * sizeof(struct cache_token);
+    {
+        isize fileSize = -1;
+        if(fseek(file, 0, SEEK_END) == 0)
+        {
+            fileSize = ftell(file);
+        }
+        if(fileSize != (isize) (sizeof(header) + bodySize) || fseek(file, sizeof(header), SEEK_SET) != 0)
+        {
+            goto miss;
+        }
+    }
+
+    // one read for the whole artifact, and room after it to map its labels to symbols
+    halloc_cleanup(&body, bodySize + header.labelCount * sizeof(u32) + 1);
+    labelSymbols = (u32*) (body + bodySize);
+    if(fread(body, 1, bodySize, file) != bodySize || !cache_validate(body, &header, source))
+    {
+        goto miss;
+    }
+    fclose(file);
+    file = NULL;
+
+    halc_tryCleanup(cache_init_stream(ts, source, filename, symbols));
+    {
+        i32 capacity = header.tokenCount ? (i32) header.tokenCount : 1;
+        halloc_cleanup(&ts->tokens, capacity * sizeof(struct token));
+        ts->capacity = capacity;
+    }
+
+    {
+        const struct cache_label* labels = (const struct cache_label*) body;
+        const struct cache_token* tokens = (const struct cache_token*) (labels + header.labelCount);
+
+        // symbol ids belong to the table, not the file. intern every label again
+        for(u32 i = 0; i < header.labelCount; i += 1)
+        {
+            hstr view = {source->buffer + labels[i].offset, labels[i].len};
+            halc_tryCleanup(symbol_intern(ts->symbols, &view, &labelSymbols[i]));
+        }
+
+        for(u32 i = 0; i < header.tokenCount; i += 1)
+        {
+            struct token* tok = &ts->tokens[i];
+            tok->tokenType = (enum tokenType) (tokens[i].typeAndLabel & 0xff);
+            tok->tokenView.buffer = source->buffer + tokens[i].offset;
+            tok->tokenView.len = tokens[i].len;
+            tok->tokenView.cap = 0;
+            tok->lineNumber = tokens[i].lineNumber;
+            tok->symbol = tok->tokenType == LABEL ? labelSymbols[tokens[i].typeAndLabel >> 8] : HALC_SYM_NONE;
+        }
+        ts->len = (i32) header.tokenCount;
+    }
+
+    hfree(body, bodySize + header.labelCount * sizeof(u32) + 1);
+    *outHit = TRUE;
+    halc_end;
+
+miss:
+    halc_end_ok;
+cleanup:
+    if(file)
+        fclose(file);
+    if(body)
+        hfree(body, bodySize + header.labelCount * sizeof(u32) + 1);
+    halc_end;
+}
+
+// best effort, a cache that can't be written just means compiling again next time
+static void cache_write(const hstr* path, struct cache_header* header, const struct tokenStream* ts)
+{
+    u32 symbolCount = ts->symbols->len;
+    u32* localLabels = NULL;
+    u8* body = NULL;
+    usize bodyCap = (usize) ts->len * (sizeof(struct cache_label) + sizeof(struct cache_token));
+    FILE* file = NULL;
+    char tempPath[1024];
+
+    // the artifact is built in memory and written with one call
+    if(halloc_advanced((void**) &localLabels, symbolCount * sizeof(u32) + 1, __FILE__, __LINE__, __func__) != ERR_OK ||
+        halloc_advanced((void**) &body, bodyCap + 1, __FILE__, __LINE__, __func__) != ERR_OK)
+    {
+        goto done;
+    }
+    memset(localLabels, 0xff, symbolCount * sizeof(u32));
+
+    // labels go first, count them before placing the tokens after them
+    header->labelCount = 0;
+    for(i32 i = 0; i < ts->len; i += 1)
+    {
+        const struct token* tok = &ts->tokens[i];
+        if(tok->tokenType == LABEL && localLabels[tok->symbol] == 0xffffffff)
+        {
+            struct cache_label* label = ((struct cache_label*) body) + header->labelCount;
+            label->offset = (u32) (tok->tokenView.buffer - ts->source.buffer);
+            label->len = tok->tokenView.len;
+            localLabels[tok->symbol] = header->labelCount;
+            header->labelCount += 1;
+        }
+    }
+
+    header->tokenCount = (u32) ts->len;
+    struct cache_token* tokens = (struct cache_token*) (((struct cache_label*) body) + header->labelCount);
+    for(i32 i = 0; i < ts->len; i += 1)
+    {
+        const struct token* tok = &ts->tokens[i];
+        tokens[i].offset = (u32) (tok->tokenView.buffer - ts->source.buffer);
+        tokens[i].len = tok->tokenView.len;
+        tokens[i].lineNumber = tok->lineNumber;
+        tokens[i].typeAndLabel = (u32) tok->tokenType | (tok->tokenType == LABEL ? localLabels[tok->symbol] << 8 : 0);
+    }
+    usize bodySize = (u8*) (tokens + ts->len) - body;
+
+    i64 counter = halc_atomic_add_i64(&gCacheTempCounter, 1);
+#if defined(_WIN32)
+    u32 pid = (u32) GetCurrentProcessId();
+#else
+    u32 pid = (u32) getpid();
+#endif
+    if(snprintf(tempPath, sizeof(tempPath), "%s.%u.%" PRId64 CACHE_TEMP_EXTENSION, path->buffer, pid, counter) >= (int) sizeof(tempPath))
+    {
+        goto done;
+    }
+
+    file = h_fopen(tempPath, "wb");
+    if(!file)
+    {
+        goto done;
+    }
+
+    b8 ok = fwrite(header, sizeof(*header), 1, file) == 1 && fwrite(body, 1, bodySize, file) == bodySize;
+    if(fclose(file) != 0)
+    {
+        ok = FALSE;
+    }
+
+#if defined(_WIN32)
+    if(!ok || !MoveFileExA(tempPath, path->buffer, MOVEFILE_REPLACE_EXISTING))
+#else
+    if(!ok || rename(tempPath, path->buffer) != 0)
+#endif
+    {
+        remove(tempPath);
+    }
+
+done:
+    halc_end_ok;
+    if(body)
+        hfree(body, bodyCap + 1);
+    if(localLabels)
+        hfree(localLabels, symbolCount * sizeof(u32) + 1);
+}
+
+// what a miss costs, only a clean parse is worth remembering
+static errc cache_compile(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols)
+{
+    struct s_graph graph;
+    halc_try(tokenize_raw(ts, source, filename, symbols));
+    halc_tryCleanup(graph_init(&graph));
+
+    errc result = parse_tokens(&graph, ts);
+    graph_free(&graph);
+    halc_tryCleanup(result);
+    halc_end;
+
+cleanup:
+    ts_free(ts);
+    halc_end;
+}
+
+errc compile_cached(struct compile_cache* cache, struct tokenStream* ts, const hstr* source,
+    const hstr* filename, struct symbol_table* symbols, b8* outHit)
+{
+    struct cache_header header;
+    hstr path;
+    b8 hit;
+
+    memset(&header, 0, sizeof(header));
+    header.magic = CACHE_MAGIC;
+    header.format = CACHE_FORMAT;
+    header.key = hstr_hash64(source, cache->seed);
+    header.check = hstr_hash64(source, cache_check_seed(cache));
+    header.sourceLen = source->len;
+
+    memset(ts, 0, sizeof(*ts));
+    halc_try(cache_artifact_path(cache, header.key, &path));
+
+    halc_tryCleanup(cache_load(&path, &header, ts, source, filename, symbols, &hit));
+    if(hit)
+    {
+        halc_atomic_add_i64(&cache->hits, 1);
+    }
+    else
+    {
+        halc_tryCleanup(cache_compile(ts, source, filename, symbols));
+        cache_write(&path, &header, ts);
+        halc_atomic_add_i64(&cache->misses, 1);
+    }
+
+    if(outHit)
+    {
+        *outHit = hit;
+    }
+
+    hstr_free(&path);
+    halc_end;
+
+cleanup:
+    ts_free(ts);
+    hstr_free(&path);
+    halc_end;
+}
+
+errc compile_cache_clear(struct compile_cache* cache)
+{
+    hstr path;
+    hstr_init(&path);
+    halc_try(hstr_append(&path, &cache->dir));
+    u32 baseLen = path.len;
+
+#if defined(_WIN32)
+    halc_tryCleanup(hstr_append_cstr(&path, "/*"));
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(path.buffer, &entry);
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        halc_raiseCleanup(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    do
+    {
+        if(!(entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) && is_cache_file(entry.cFileName))
+        {
+            path.len = baseLen;
+            if(hstr_append_char(&path, '/') != ERR_OK || hstr_append_cstr(&path, entry.cFileName) != ERR_OK)
+            {
+                FindClose(find);
+                halc_raiseCleanup(ERR_OUT_OF_MEMORY);
+            }
+            DeleteFileA(path.buffer);
+        }
+    } while(FindNextFileA(find, &entry));
+    FindClose(find);
+#else
+    DIR* dir = opendir(cache->dir.buffer);
+    if(!dir)
+    {
+        fprintf(stderr, "\n  Unable to open directory: %s\n", cache->dir.buffer);
+        halc_raiseCleanup(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(!is_cache_file(entry->d_name))
+        {
+            continue;
+        }
+
+        path.len = baseLen;
+        if(hstr_append_char(&path, '/') != ERR_OK || hstr_append_cstr(&path, entry->d_name) != ERR_OK)
+        {
+            closedir(dir);
+            halc_raiseCleanup(ERR_OUT_OF_MEMORY);
+        }
+        unlink(path.buffer);
+    }
+    closedir(dir);
+#endif
+
+cleanup:
+    hstr_free(&path);
+    halc_end;
+}
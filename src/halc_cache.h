@@ -0,0 +1,63 @@
+#ifndef _HALC_CACHE_H_
+#define _HALC_CACHE_H_
+
+#include "halc_types.h"
+#include "halc_errors.h"
+#include "halc_strings.h"
+#include "halc_tokenizer.h"
+
+EXTERN_C_BEGIN
+
+// ==================== Compile Cache ======================
+//
+// remembers the compiled form of every source it has seen, so unchanged files skip
+// tokenize and parse_tokens on the next launch. Artifacts live in a directory, one
+// file per source, named after a hash of the source bytes seeded with the compiler
+// version. An edited file simply hashes to a new artifact, and a new compiler never
+// reads artifacts from an old one.
+//
+// an artifact is the token stream of a file that tokenized and parsed cleanly, stored
+// as offsets into the source. A hit rebuilds the stream over the caller's source and
+// re-interns its labels, the tokens come out the same as tokenize_raw's. Files that
+// fail aren't cached, so their diagnostics show up on every run.
+//
+// any number of threads can compile through one cache. Artifacts are written to a
+// temporary file and renamed into place, a reader never sees half of one. A missing,
+// stale or damaged artifact is just a miss.
+//
+// eg.
+//
+//  struct compile_cache cache;
+//  halc_try(compile_cache_open(&cache, &cacheDir));
+//  halc_tryCleanup(compile_cached(&cache, &ts, &source, &filename, NULL, &hit));
+//  ...
+//  compile_cache_close(&cache);
+//
+
+// bump whenever the tokenizer or parser output changes, it invalidates every artifact
+#define HALC_COMPILER_VERSION "halcyon 0.2"
+
+struct compile_cache {
+    hstr dir;   // null terminated, no trailing slash
+    u64 seed;   // from HALC_COMPILER_VERSION and the artifact format
+
+    volatile i64 hits;
+    volatile i64 misses;
+};
+
+// creates the directory if it doesn't exist yet, its parent has to
+errc compile_cache_open(struct compile_cache* cache, const hstr* dirPath);
+void compile_cache_close(struct compile_cache* cache);
+
+// tokenizes source like tokenize_raw and checks it with parse_tokens, unless the same
+// bytes were compiled before, then the tokens come straight from the cache.
+// symbols works the same as for tokenize_raw. outHit can be NULL.
+errc compile_cached(struct compile_cache* cache, struct tokenStream* ts, const hstr* source,
+    const hstr* filename, struct symbol_table* symbols, b8* outHit);
+
+// deletes every artifact in the cache directory
+errc compile_cache_clear(struct compile_cache* cache);
+
+EXTERN_C_END
+
+#endif
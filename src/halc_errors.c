@@ -2,8 +2,9 @@
 #include "halc_errors.h"
 #include "halc_strings.h"
 
-errc gErrorCatch = ERR_OK;
-b8 gErrorFirst = FALSE;
+// every thread has its own error state, so workers can use halc_try independently
+HALC_THREAD_LOCAL errc gErrorCatch = ERR_OK;
+HALC_THREAD_LOCAL b8 gErrorFirst = FALSE;
 
 const char* errc_to_string(errc code)
 {
@@ -20,12 +21,24 @@ const char* errc_to_string(errc code)
             return "Attempted to free memory that was already freed";
         case ERR_BAD_REALLOC_PARAMETERS:
             return "Realloc failed with really bad arguments";
+        case ERR_BAD_ALIGNMENT:
+            return "Alignment must be a non-zero power of two";
+        case ERR_PROFILING_DISABLED:
+            return "Allocation profiling was compiled out (PROFILE_ALLOCATIONS is 0)";
+        case ERR_BAD_FREE_SIZE:
+            return "Size passed to free/realloc doesn't match the size the memory was allocated with";
+        case ERR_DEBUG_HEAP_DISABLED:
+            return "Debug heap was compiled out (DEBUG_HEAP is 0)";
+        case ERR_THREAD_FAILURE:
+            return "Unable to create a thread or synchronization primitive";
 
         // string errors
         case ERR_STR_BAD_RESIZE:
             return "Bad String Resize arguments, new size must be equal or larger.";
         case ERR_STR_OPERATION_ON_STATIC_HSTR:
             return "Attempted a mutating string operation on a statically allocated hstr";
+        case ERR_STR_INVALID_UTF8:
+            return "String is not well formed utf8.";
 
         // File IO errors
         case ERR_UNABLE_TO_OPEN_FILE:
@@ -34,6 +47,10 @@ const char* errc_to_string(errc code)
             return "File Seek error";
         case ERR_INCONSISTENT_FILE_FORMAT:
             return "Inconsistent file format";
+        case ERR_FILE_READ_ERROR:
+            return "File read error";
+        case ERR_FILE_WRITE_ERROR:
+            return "File write error";
         case ERR_REALLOC_SHRUNK_WHEN_NOT_ALLOWED:
             return "Realloc shrunk allocation when not allowed to.";
 
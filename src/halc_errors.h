@@ -153,15 +153,23 @@ typedef int errc;
 #define ERR_DOUBLE_FREE 200
 #define ERR_REALLOC_SHRUNK_WHEN_NOT_ALLOWED 300
 #define ERR_BAD_REALLOC_PARAMETERS 400
+#define ERR_BAD_ALIGNMENT 500
+#define ERR_PROFILING_DISABLED 600
+#define ERR_BAD_FREE_SIZE 700
+#define ERR_DEBUG_HEAP_DISABLED 800
+#define ERR_THREAD_FAILURE 900
 
 // string errors
 #define ERR_STR_BAD_RESIZE 1000
 #define ERR_STR_OPERATION_ON_STATIC_HSTR 1100
+#define ERR_STR_INVALID_UTF8 1200
 
 // File IO errors
 #define ERR_UNABLE_TO_OPEN_FILE 2000
 #define ERR_FILE_SEEK_ERROR 2100
 #define ERR_INCONSISTENT_FILE_FORMAT 2200
+#define ERR_FILE_READ_ERROR 2300
+#define ERR_FILE_WRITE_ERROR 2400
 
 
 // assertions
@@ -224,8 +232,8 @@ void error_print(errc code, const char* C, const char* F, int L);
 
 #define assertMsg(X, FMT, ...) if(!(X)) { fprintf(stderr, "Assertion failed: " RED(#X) "\n with message:\n " FMT, __VA_ARGS__); halc_raise(ERR_ASSERTION_FAILED); }
 
-extern errc gErrorCatch;
-extern b8 gErrorFirst;
+extern HALC_THREAD_LOCAL errc gErrorCatch;
+extern HALC_THREAD_LOCAL b8 gErrorFirst;
 
 void setup_error_context();
 
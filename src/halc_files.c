@@ -1,8 +1,52 @@
 #include <inttypes.h>
+#include <stdint.h>
+#include <string.h>
 
 #include "halc_files.h"
 #include "halc_allocators.h"
 #include "halc_strings.h"
+#include "halc_threads.h"
+
+#if !defined(HALC_NO_MMAP) && !defined(_WIN32) && (defined(__unix__) || defined(__APPLE__))
+#define HALC_HAS_MMAP 1
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+#if !defined(HALC_NO_IO_URING) && defined(__linux__) && defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+// openat, statx and close on the ring arrived together in 5.6
+#if defined(IORING_FEAT_CUR_PERSONALITY)
+#define HALC_HAS_IO_URING 1
+#include <errno.h>
+#include <fcntl.h>
+#include <linux/stat.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#endif
+#endif
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <dirent.h>
+#include <errno.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+#endif
+
+#if !defined(HALC_NO_INOTIFY) && defined(__linux__)
+#define HALC_HAS_INOTIFY 1
+#include <poll.h>
+#include <sys/inotify.h>
+#endif
 
 FILE* h_fopen(const char* filePath, const char* opts) 
 {
@@ -19,7 +63,26 @@ FILE* h_fopen(const char* filePath, const char* opts)
     return file;
 }
 
-errc load_file(hstr* out, const hstr* filePath)
+// everything past loading treats the file as utf8, catch bad encodings at the door
+static errc validate_file_contents(const hstr* contents, const hstr* filePath)
+{
+    struct utf8_error utf8Error;
+    if(hstr_validate_utf8(contents, &utf8Error) != ERR_OK)
+    {
+        if(!is_supressed_errors())
+        {
+            fprintf(stderr, "\n  %s:%d: invalid utf8 at byte offset %u\n", 
+                filePath->buffer, utf8Error.lineNumber, utf8Error.offset);
+        }
+        halc_raise(ERR_STR_INVALID_UTF8);
+    }
+
+    halc_end;
+}
+
+// reads the whole file into a heap buffer owned by the caller, also what map_file
+// falls back to
+static errc read_file(hstr* out, const hstr* filePath, b8 validate)
 {
     errc error_code = ERR_OK; 
 
@@ -44,8 +107,23 @@ errc load_file(hstr* out, const hstr* filePath)
         goto exitCloseFile;
     }
 
+    // directories report a nonsense size on some platforms, and hstrs can't hold more than this anyway
+    if(fileSize > 0x7fffffff)
+    {
+        error_code = ERR_FILE_READ_ERROR;
+        goto exitCloseFile;
+    }
+
+    // empty files are fine, there's just nothing to allocate
+    if(fileSize == 0)
+    {
+        hstr_init(out);
+        fclose(file);
+        halc_end;
+    }
+
     char* buffer;
-    halloc(&buffer, fileSize);
+    halloc_string(&buffer, fileSize);
 
     if(fseek(file, 0, SEEK_SET) != 0)
     {
@@ -66,19 +144,1215 @@ errc load_file(hstr* out, const hstr* filePath)
     out->cap = (u32) fileSize;
 
     fclose(file);
+
+    if(validate && validate_file_contents(out, filePath) != ERR_OK)
+    {
+        hstr_free(out);
+        halc_raise(ERR_STR_INVALID_UTF8);
+    }
+
     halc_end;
     
 exitCloseFile:
     fclose(file);
-    halc_end;
+    halc_raise(error_code);
+}
+
+errc load_file(hstr* out, const hstr* filePath)
+{
+    return read_file(out, filePath, TRUE);
 }
 
 errc load_and_decode_from_file(hstr* out, const hstr* filePath)
 {
-    hstr file;
-    halc_try(load_file(&file, filePath));
-    halc_try(hstr_normalize(&file, out));
+    // normalize straight out of the mapping, the raw file is never copied
+    struct mapped_file file;
+    halc_try(map_file(&file, filePath));
+    halc_tryCleanup(hstr_normalize(&file.contents, out));
+
+cleanup:
+    unmap_file(&file);
+    halc_end;
+}
+
+static errc map_file_contents(struct mapped_file* out, const hstr* filePath, b8 text)
+{
+    static const hstr empty = HSTR("");
+
+    out->contents = empty;
+    out->mapping = NULL;
+    out->mappingSize = 0;
+    hstr_init(&out->readBuffer);
+
+#if defined(HALC_HAS_MMAP)
+    int fd = open(filePath->buffer, O_RDONLY);
+    if(fd < 0)
+    {
+        fprintf(stderr, "\n  Unable to open file: %s\n", filePath->buffer);
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    struct stat fileStat;
+    if(fstat(fd, &fileStat) != 0)
+    {
+        close(fd);
+        halc_raise(ERR_FILE_SEEK_ERROR);
+    }
+
+    // the same limit read_file has, contents.len can't hold more
+    if(S_ISREG(fileStat.st_mode) && fileStat.st_size > 0x7fffffff)
+    {
+        close(fd);
+        halc_raise(ERR_FILE_READ_ERROR);
+    }
+
+    // pipes and other special files can't be mapped, and empty files don't need to be
+    if(S_ISREG(fileStat.st_mode) && fileStat.st_size > 0)
+    {
+        usize size = (usize) fileStat.st_size;
+        void* mapping = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        close(fd);
+
+        if(mapping != MAP_FAILED)
+        {
+#if defined(MADV_SEQUENTIAL)
+            // text is read front to back once, read ahead aggressively
+            if(text)
+            {
+                madvise(mapping, size, MADV_SEQUENTIAL);
+            }
+#endif
+            out->mapping = mapping;
+            out->mappingSize = size;
+            out->contents.buffer = (hchar*) mapping;
+            out->contents.len = (u32) size;
+            out->contents.cap = -1;
+
+            if(text && validate_file_contents(&out->contents, filePath) != ERR_OK)
+            {
+                unmap_file(out);
+                halc_raise(ERR_STR_INVALID_UTF8);
+            }
+            halc_end;
+        }
+    }
+    else
+    {
+        close(fd);
+        if(S_ISREG(fileStat.st_mode))
+        {
+            halc_end;
+        }
+    }
+#endif
+
+    halc_try(read_file(&out->readBuffer, filePath, text));
+    out->contents.buffer = out->readBuffer.buffer;
+    out->contents.len = out->readBuffer.len;
+    out->contents.cap = -1;
+
+    halc_end;
+}
+
+errc map_file(struct mapped_file* out, const hstr* filePath)
+{
+    return map_file_contents(out, filePath, TRUE);
+}
+
+errc map_file_binary(struct mapped_file* out, const hstr* filePath)
+{
+    return map_file_contents(out, filePath, FALSE);
+}
+
+void unmap_file(struct mapped_file* file)
+{
+#if defined(HALC_HAS_MMAP)
+    if(file->mapping)
+    {
+        munmap(file->mapping, file->mappingSize);
+    }
+#endif
+    hstr_free(&file->readBuffer);
+
+    file->mapping = NULL;
+    file->mappingSize = 0;
+    file->contents.buffer = NULL;
+    file->contents.len = 0;
+}
+
+// ======================= batched loading =================
+
+#if defined(HALC_HAS_IO_URING)
+
+// enough to keep the disk busy, every file has at most two operations in flight
+#define FILE_BATCH_RING_ENTRIES 64
+
+enum file_batch_op {
+    FILE_BATCH_OPEN,
+    FILE_BATCH_STATX,
+    FILE_BATCH_READ,
+    FILE_BATCH_CLOSE,
+};
+
+struct uring {
+    i32 fd;
+    u32 entries;
+
+    void* sqRing;
+    usize sqRingSize;
+    void* cqRing;
+    usize cqRingSize;
+    struct io_uring_sqe* sqes;
+    usize sqesSize;
+
+    u32* sqTail;
+    u32 sqMask;
+    u32* sqArray;
+    u32 sqPending; // filled in but not handed to the kernel yet
+    u32 sqUnsubmitted; // published in the tail, but the kernel hasn't taken them yet
+
+    u32* cqHead;
+    u32* cqTail;
+    u32 cqMask;
+    struct io_uring_cqe* cqes;
+};
+
+struct batch_file {
+    i32 fd;
+    u32 pending;     // open and statx go out together, both have to land before the read
+    b8 failed;       // retried with load_file
+    b8 done;         // handed to onLoaded
+    struct statx stat;
+    hstr contents;
+    u32 size;
+};
+
+struct file_batch {
+    struct uring ring;
+    struct batch_file* files;
+    const hstr* paths;
+    u32 count;
+    u32 started;
+    u32 inFlight;
+    file_batch_callback onLoaded;
+    void* ctx;
+};
+
+// there's no glibc wrapper for these
+static int uring_setup(u32 entries, struct io_uring_params* params)
+{
+    return (int) syscall(__NR_io_uring_setup, entries, params);
+}
+
+static int uring_enter(i32 fd, u32 toSubmit, u32 minComplete, u32 flags)
+{
+    return (int) syscall(__NR_io_uring_enter, fd, toSubmit, minComplete, flags, NULL, 0);
+}
+
+static void uring_free(struct uring* ring)
+{
+    if(ring->sqes)
+    {
+        munmap(ring->sqes, ring->sqesSize);
+    }
+    if(ring->cqRing && ring->cqRing != ring->sqRing)
+    {
+        munmap(ring->cqRing, ring->cqRingSize);
+    }
+    if(ring->sqRing)
+    {
+        munmap(ring->sqRing, ring->sqRingSize);
+    }
+    if(ring->fd >= 0)
+    {
+        close(ring->fd);
+    }
+    memset(ring, 0, sizeof(*ring));
+    ring->fd = -1;
+}
+
+// FALSE when the kernel doesn't have io_uring or won't give us one, nothing to report
+static b8 uring_init(struct uring* ring, u32 entries)
+{
+    struct io_uring_params params;
+    memset(ring, 0, sizeof(*ring));
+    memset(&params, 0, sizeof(params));
+
+    ring->fd = uring_setup(entries, &params);
+    if(ring->fd < 0)
+    {
+        ring->fd = -1;
+        return FALSE;
+    }
+
+    ring->entries = params.sq_entries;
+    ring->sqRingSize = params.sq_off.array + params.sq_entries * sizeof(u32);
+    ring->cqRingSize = params.cq_off.cqes + params.cq_entries * sizeof(struct io_uring_cqe);
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->sqRingSize = HALC_MAX(ring->sqRingSize, ring->cqRingSize);
+        ring->cqRingSize = ring->sqRingSize;
+    }
+
+    ring->sqRing = mmap(NULL, ring->sqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQ_RING);
+    if(ring->sqRing == MAP_FAILED)
+    {
+        ring->sqRing = NULL;
+        uring_free(ring);
+        return FALSE;
+    }
+
+    if(params.features & IORING_FEAT_SINGLE_MMAP)
+    {
+        ring->cqRing = ring->sqRing;
+    }
+    else
+    {
+        ring->cqRing = mmap(NULL, ring->cqRingSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_CQ_RING);
+        if(ring->cqRing == MAP_FAILED)
+        {
+            ring->cqRing = NULL;
+            uring_free(ring);
+            return FALSE;
+        }
+    }
+
+    ring->sqesSize = params.sq_entries * sizeof(struct io_uring_sqe);
+    ring->sqes = (struct io_uring_sqe*) mmap(NULL, ring->sqesSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, ring->fd, IORING_OFF_SQES);
+    if(ring->sqes == MAP_FAILED)
+    {
+        ring->sqes = NULL;
+        uring_free(ring);
+        return FALSE;
+    }
+
+    u8* sq = (u8*) ring->sqRing;
+    ring->sqTail = (u32*) (sq + params.sq_off.tail);
+    ring->sqMask = *(u32*) (sq + params.sq_off.ring_mask);
+    ring->sqArray = (u32*) (sq + params.sq_off.array);
+
+    u8* cq = (u8*) ring->cqRing;
+    ring->cqHead = (u32*) (cq + params.cq_off.head);
+    ring->cqTail = (u32*) (cq + params.cq_off.tail);
+    ring->cqMask = *(u32*) (cq + params.cq_off.ring_mask);
+    ring->cqes = (struct io_uring_cqe*) (cq + params.cq_off.cqes);
+
+    return TRUE;
+}
+
+// the caller keeps the number of operations in flight under the ring size, so there's always room
+static struct io_uring_sqe* uring_next_sqe(struct uring* ring)
+{
+    u32 tail = *ring->sqTail + ring->sqPending;
+    u32 index = tail & ring->sqMask;
+    struct io_uring_sqe* sqe = &ring->sqes[index];
+
+    memset(sqe, 0, sizeof(*sqe));
+    ring->sqArray[index] = index;
+    ring->sqPending += 1;
+    return sqe;
+}
+
+// publishes the pending entries and waits for at least one completion. The kernel
+// can take fewer entries than it was offered, the rest go out with the next call.
+static errc uring_submit_and_wait(struct uring* ring)
+{
+    __atomic_store_n(ring->sqTail, *ring->sqTail + ring->sqPending, __ATOMIC_RELEASE);
+
+    ring->sqUnsubmitted += ring->sqPending;
+    ring->sqPending = 0;
+
+    for(;;)
+    {
+        int submitted = uring_enter(ring->fd, ring->sqUnsubmitted, 1, IORING_ENTER_GETEVENTS);
+        if(submitted >= 0)
+        {
+            ring->sqUnsubmitted -= HALC_MIN((u32) submitted, ring->sqUnsubmitted);
+            halc_end;
+        }
+
+        // the kernel is short on memory or completions, what was taken is in flight so try again
+        if(errno == EINTR || errno == EAGAIN || errno == EBUSY)
+        {
+            continue;
+        }
+
+        fprintf(stderr, "\n  io_uring_enter failed: %d\n", errno);
+        halc_raise(ERR_FILE_READ_ERROR);
+    }
+}
+
+static u64 batch_user_data(u32 index, enum file_batch_op op)
+{
+    return ((u64) index << 8) | (u64) op;
+}
+
+static void batch_submit_open(struct file_batch* batch, u32 index)
+{
+    struct batch_file* file = &batch->files[index];
+    const char* path = batch->paths[index].buffer;
+
+    struct io_uring_sqe* sqe = uring_next_sqe(&batch->ring);
+    sqe->opcode = IORING_OP_OPENAT;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (u64) (uintptr_t) path;
+    sqe->open_flags = O_RDONLY | O_CLOEXEC;
+    sqe->user_data = batch_user_data(index, FILE_BATCH_OPEN);
+
+    // by path, so it doesn't have to wait for the open
+    sqe = uring_next_sqe(&batch->ring);
+    sqe->opcode = IORING_OP_STATX;
+    sqe->fd = AT_FDCWD;
+    sqe->addr = (u64) (uintptr_t) path;
+    sqe->len = STATX_TYPE | STATX_SIZE;
+    sqe->off = (u64) (uintptr_t) &file->stat;
+    sqe->user_data = batch_user_data(index, FILE_BATCH_STATX);
+
+    file->fd = -1;
+    file->pending = 2;
+    batch->inFlight += 2;
+}
+
+static void batch_submit_read(struct file_batch* batch, u32 index)
+{
+    struct batch_file* file = &batch->files[index];
+
+    struct io_uring_sqe* sqe = uring_next_sqe(&batch->ring);
+    sqe->opcode = IORING_OP_READ;
+    sqe->fd = file->fd;
+    sqe->addr = (u64) (uintptr_t) (file->contents.buffer + file->contents.len);
+    sqe->len = file->size - file->contents.len;
+    sqe->off = file->contents.len;
+    sqe->user_data = batch_user_data(index, FILE_BATCH_READ);
+    batch->inFlight += 1;
+}
+
+static void batch_submit_close(struct file_batch* batch, u32 index)
+{
+    struct batch_file* file = &batch->files[index];
+
+    struct io_uring_sqe* sqe = uring_next_sqe(&batch->ring);
+    sqe->opcode = IORING_OP_CLOSE;
+    sqe->fd = file->fd;
+    sqe->user_data = batch_user_data(index, FILE_BATCH_CLOSE);
+    batch->inFlight += 1;
+    file->fd = -1;
+}
+
+// the file is done with the ring, validate it or load it the slow way and pass it on
+static void batch_finish(struct file_batch* batch, u32 index)
+{
+    struct batch_file* file = &batch->files[index];
+    const hstr* path = &batch->paths[index];
+    errc result;
+
+    if(file->failed)
+    {
+        hstr_free(&file->contents);
+        result = load_file(&file->contents, path);
+    }
+    else
+    {
+        result = validate_file_contents(&file->contents, path);
+        if(result != ERR_OK)
+        {
+            hstr_free(&file->contents);
+        }
+    }
+    halc_end_ok;
+
+    file->done = TRUE;
+    batch->onLoaded(batch->ctx, index, result, &file->contents);
+    hstr_init(&file->contents);
+}
+
+// the ring broke with operations still in flight, and they can still write into the
+// files' buffers and stat. The ring, the files and those buffers are leaked rather 
+// than freed under the kernel, and every file that isn't done is loaded with load_file.
+static void batch_abandon(struct file_batch* batch)
+{
+    for(u32 i = 0; i < batch->count; i += 1)
+    {
+        struct batch_file* file = &batch->files[i];
+        if(file->done)
+        {
+            continue;
+        }
+
+        hstr_init(&file->contents);
+        file->failed = TRUE;
+        batch_finish(batch, i);
+    }
+}
+
+// open and statx both landed, size the buffer and start reading
+static void batch_start_read(struct file_batch* batch, u32 index)
+{
+    struct batch_file* file = &batch->files[index];
+
+    // special files and anything too big for an hstr take the slow path
+    if(!file->failed && (!S_ISREG(file->stat.stx_mode) || file->stat.stx_size > 0x7fffffff))
+    {
+        file->failed = TRUE;
+    }
+
+    if(!file->failed && file->stat.stx_size > 0)
+    {
+        file->size = (u32) file->stat.stx_size;
+        if(halloc_string_advanced((void**) &file->contents.buffer, file->size, __FILE__, __LINE__, __func__) == ERR_OK)
+        {
+            file->contents.len = 0;
+            file->contents.cap = file->size;
+            batch_submit_read(batch, index);
+            return;
+        }
+        halc_end_ok;
+        file->failed = TRUE;
+    }
+
+    if(file->fd >= 0)
+    {
+        batch_submit_close(batch, index);
+    }
+    batch_finish(batch, index);
+}
+
+static void batch_complete(struct file_batch* batch, u64 userData, i32 res)
+{
+    u32 index = (u32) (userData >> 8);
+    enum file_batch_op op = (enum file_batch_op) (userData & 0xff);
+    struct batch_file* file = &batch->files[index];
+
+    batch->inFlight -= 1;
+
+    switch(op)
+    {
+        case FILE_BATCH_OPEN:
+        case FILE_BATCH_STATX:
+            if(res < 0)
+            {
+                file->failed = TRUE;
+            }
+            else if(op == FILE_BATCH_OPEN)
+            {
+                file->fd = res;
+            }
+
+            file->pending -= 1;
+            if(file->pending == 0)
+            {
+                batch_start_read(batch, index);
+            }
+            break;
+
+        case FILE_BATCH_READ:
+            if(res < 0)
+            {
+                file->failed = TRUE;
+            }
+            else
+            {
+                file->contents.len += (u32) res;
+
+                // short read, keep going unless the file shrank under us
+                if(res > 0 && file->contents.len < file->size)
+                {
+                    batch_submit_read(batch, index);
+                    break;
+                }
+            }
+
+            batch_submit_close(batch, index);
+            batch_finish(batch, index);
+            break;
+
+        case FILE_BATCH_CLOSE:
+            break;
+    }
+}
+
+// FALSE when there's no ring to be had, nothing has been delivered in that case
+static b8 load_file_batch_uring(struct file_batch* batch)
+{
+    if(!uring_init(&batch->ring, FILE_BATCH_RING_ENTRIES))
+    {
+        return FALSE;
+    }
+
+    if(halloc_advanced((void**) &batch->files, batch->count * sizeof(struct batch_file), __FILE__, __LINE__, __func__) != ERR_OK)
+    {
+        halc_end_ok;
+        uring_free(&batch->ring);
+        return FALSE;
+    }
+    memset(batch->files, 0, batch->count * sizeof(struct batch_file));
+
+    while(batch->started < batch->count || batch->inFlight)
+    {
+        // completions only ever replace themselves, so new files go in while there's room for their pair
+        while(batch->started < batch->count && batch->inFlight + 2 <= batch->ring.entries)
+        {
+            batch_submit_open(batch, batch->started);
+            batch->started += 1;
+        }
+
+        if(uring_submit_and_wait(&batch->ring) != ERR_OK)
+        {
+            halc_end_ok;
+            batch_abandon(batch);
+            return TRUE;
+        }
+
+        u32 head = *batch->ring.cqHead;
+        u32 tail = __atomic_load_n(batch->ring.cqTail, __ATOMIC_ACQUIRE);
+        while(head != tail)
+        {
+            struct io_uring_cqe* cqe = &batch->ring.cqes[head & batch->ring.cqMask];
+            u64 userData = cqe->user_data;
+            i32 res = cqe->res;
+
+            head += 1;
+            __atomic_store_n(batch->ring.cqHead, head, __ATOMIC_RELEASE);
+
+            batch_complete(batch, userData, res);
+        }
+    }
+
+    hfree(batch->files, batch->count * sizeof(struct batch_file));
+    uring_free(&batch->ring);
+    return TRUE;
+}
+
+#endif
+
+b8 file_batch_has_io_uring()
+{
+#if defined(HALC_HAS_IO_URING)
+    static volatile i64 available = -1;
+
+    i64 cached = halc_atomic_load_i64(&available);
+    if(cached < 0)
+    {
+        struct uring ring;
+        cached = uring_init(&ring, 2);
+        if(cached)
+        {
+            uring_free(&ring);
+        }
+        halc_atomic_store_i64(&available, cached);
+    }
+    return cached != 0;
+#else
+    return FALSE;
+#endif
+}
+
+errc load_file_batch(const hstr* filePaths, u32 count, file_batch_callback onLoaded, void* ctx)
+{
+#if defined(HALC_HAS_IO_URING)
+    // a single file isn't worth setting up a ring for
+    if(count > 1)
+    {
+        struct file_batch batch;
+        memset(&batch, 0, sizeof(batch));
+        batch.paths = filePaths;
+        batch.count = count;
+        batch.onLoaded = onLoaded;
+        batch.ctx = ctx;
+
+        if(load_file_batch_uring(&batch))
+        {
+            halc_end_ok;
+            halc_end;
+        }
+    }
+#endif
+
+    for(u32 i = 0; i < count; i += 1)
+    {
+        hstr contents;
+        hstr_init(&contents);
+        errc result = load_file(&contents, &filePaths[i]);
+        halc_end_ok;
+        onLoaded(ctx, i, result, &contents);
+    }
+
+    halc_end_ok;
+    halc_end;
+}
+
+// ======================= directories =================
+
+static b8 is_dot_entry(const char* name)
+{
+    return strcmp(name, ".") == 0 || strcmp(name, "..") == 0;
+}
+
+// path is the directory to walk, it's used as the buffer for every path below it
+// and is back to what it was when this returns.
+static errc walk_directory_recursive(hstr* path, walk_callback onEntry, void* ctx)
+{
+    u32 baseLen = path->len;
+    struct dir_entry_info info;
+
+#if defined(_WIN32)
+    halc_try(hstr_append_cstr(path, "/*"));
+
+    WIN32_FIND_DATAA entry;
+    HANDLE find = FindFirstFileA(path->buffer, &entry);
+    path->len = baseLen;
+    path->buffer[baseLen] = 0;
+
+    if(find == INVALID_HANDLE_VALUE)
+    {
+        fprintf(stderr, "\n  Unable to open directory: %s\n", path->buffer);
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    do
+    {
+        // reparse points are skipped so links can't send the walk in circles
+        if(is_dot_entry(entry.cFileName) || (entry.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+        {
+            continue;
+        }
+
+        path->len = baseLen;
+        halc_tryCleanup(hstr_append_char(path, '/'));
+        halc_tryCleanup(hstr_append_cstr(path, entry.cFileName));
+
+        info.isDirectory = (entry.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+        info.size = ((u64) entry.nFileSizeHigh << 32) | entry.nFileSizeLow;
+        info.modifiedTime = (i64) (((u64) entry.ftLastWriteTime.dwHighDateTime << 32) | entry.ftLastWriteTime.dwLowDateTime);
+
+        halc_tryCleanup(onEntry(ctx, path, &info));
+        if(info.isDirectory)
+        {
+            halc_tryCleanup(walk_directory_recursive(path, onEntry, ctx));
+        }
+    } while(FindNextFileA(find, &entry));
+
+cleanup:
+    FindClose(find);
+#else
+    DIR* dir = opendir(path->buffer);
+    if(!dir)
+    {
+        fprintf(stderr, "\n  Unable to open directory: %s\n", path->buffer);
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    struct dirent* entry;
+    while((entry = readdir(dir)) != NULL)
+    {
+        if(is_dot_entry(entry->d_name))
+        {
+            continue;
+        }
+
+        path->len = baseLen;
+        halc_tryCleanup(hstr_append_char(path, '/'));
+        halc_tryCleanup(hstr_append_cstr(path, entry->d_name));
+
+        // lstat underneath, so symlinks can't send the walk in circles
+        if(!get_path_info(path, &info))
+        {
+            continue;
+        }
+
+        halc_tryCleanup(onEntry(ctx, path, &info));
+        if(info.isDirectory)
+        {
+            halc_tryCleanup(walk_directory_recursive(path, onEntry, ctx));
+        }
+    }
+
+cleanup:
+    closedir(dir);
+#endif
+
+    path->len = baseLen;
+    path->buffer[baseLen] = 0;
+    halc_end;
+}
+
+b8 get_path_info(const hstr* path, struct dir_entry_info* out)
+{
+#if defined(_WIN32)
+    WIN32_FILE_ATTRIBUTE_DATA data;
+    if(!GetFileAttributesExA(path->buffer, GetFileExInfoStandard, &data) || (data.dwFileAttributes & FILE_ATTRIBUTE_REPARSE_POINT))
+    {
+        return FALSE;
+    }
+
+    out->isDirectory = (data.dwFileAttributes & FILE_ATTRIBUTE_DIRECTORY) != 0;
+    out->size = ((u64) data.nFileSizeHigh << 32) | data.nFileSizeLow;
+    out->modifiedTime = (i64) (((u64) data.ftLastWriteTime.dwHighDateTime << 32) | data.ftLastWriteTime.dwLowDateTime);
+#else
+    struct stat pathStat;
+    if(lstat(path->buffer, &pathStat) != 0 || !(S_ISDIR(pathStat.st_mode) || S_ISREG(pathStat.st_mode)))
+    {
+        return FALSE;
+    }
+
+    out->isDirectory = S_ISDIR(pathStat.st_mode);
+    out->size = (u64) pathStat.st_size;
+#if defined(__APPLE__)
+    out->modifiedTime = (i64) pathStat.st_mtimespec.tv_sec * 1000000000 + pathStat.st_mtimespec.tv_nsec;
+#else
+    out->modifiedTime = (i64) pathStat.st_mtim.tv_sec * 1000000000 + pathStat.st_mtim.tv_nsec;
+#endif
+#endif
+
+    return TRUE;
+}
+
+b8 is_halc_path(const hstr* path)
+{
+    return path->len > 5 && memcmp(path->buffer + path->len - 5, ".halc", 5) == 0;
+}
+
+errc copy_root_path(hstr* out, const hstr* rootPath)
+{
+    hstr_init(out);
+    halc_try(hstr_append(out, rootPath));
+    while(out->len > 1 && out->buffer[out->len - 1] == '/')
+    {
+        out->len -= 1;
+        out->buffer[out->len] = 0;
+    }
+
+    halc_end;
+}
+
+errc walk_directory(const hstr* rootPath, walk_callback onEntry, void* ctx)
+{
+    hstr path;
+    halc_try(copy_root_path(&path, rootPath));
+    errc result = walk_directory_recursive(&path, onEntry, ctx);
+    hstr_free(&path);
+
+    halc_try(result);
+    halc_end;
+}
+
+// ======================= file watching =================
+
+#define FILE_WATCH_INITIAL_CAP 16
+
+struct file_watch_dir {
+    i32 wd;
+    hstr path;
+};
+
+struct file_watch_snapshot {
+    hstr path;
+    struct dir_entry_info info;
+};
+
+static void watcher_sleep(u32 ms)
+{
+#if defined(_WIN32)
+    Sleep(ms);
+#else
+    struct timespec duration = {ms / 1000, (long) (ms % 1000) * 1000000};
+    while(nanosleep(&duration, &duration) != 0 && errno == EINTR) {}
+#endif
+}
+
+// grows an array of watcher entries, count is the number in use
+static errc watcher_reserve(void** entries, u32* cap, u32 count, usize entrySize)
+{
+    if(count < *cap)
+    {
+        halc_end;
+    }
+
+    u32 newCap = *cap ? *cap * 2 : FILE_WATCH_INITIAL_CAP;
+    if(*cap)
+    {
+        hrealloc(entries, *cap * entrySize, newCap * entrySize, FALSE);
+    }
+    else
+    {
+        halloc(entries, newCap * entrySize);
+    }
+    *cap = newCap;
+
+    halc_end;
+}
+
+// ---- polling ----
+
+static errc snapshot_push(void* ctx, const hstr* path, const struct dir_entry_info* info)
+{
+    struct file_watcher* watcher = (struct file_watcher*) ctx;
+    halc_try(watcher_reserve((void**) &watcher->snapshot, &watcher->snapshotCap, watcher->snapshotLen, sizeof(struct file_watch_snapshot)));
+
+    struct file_watch_snapshot* entry = &watcher->snapshot[watcher->snapshotLen];
+    halc_try(hstr_dupe(path, &entry->path));
+    entry->info = *info;
+    watcher->snapshotLen += 1;
+
+    halc_end;
+}
+
+static int compare_snapshot_entries(const void* left, const void* right)
+{
+    return strcmp(((const struct file_watch_snapshot*) left)->path.buffer, ((const struct file_watch_snapshot*) right)->path.buffer);
+}
+
+static void snapshot_free(struct file_watch_snapshot* entries, u32 len, u32 cap)
+{
+    for(u32 i = 0; i < len; i += 1)
+    {
+        hstr_free(&entries[i].path);
+    }
+    if(cap)
+    {
+        hfree(entries, cap * sizeof(struct file_watch_snapshot));
+    }
+}
+
+static errc snapshot_take(struct file_watcher* watcher)
+{
+    watcher->snapshot = NULL;
+    watcher->snapshotLen = 0;
+    watcher->snapshotCap = 0;
+
+    halc_try(walk_directory(&watcher->root, snapshot_push, watcher));
+    if(watcher->snapshotLen)
+    {
+        qsort(watcher->snapshot, watcher->snapshotLen, sizeof(struct file_watch_snapshot), compare_snapshot_entries);
+    }
+
+    halc_end;
+}
+
+// takes a new snapshot and reports everything that's different from the last one, 
+// both are sorted so it's a single merge
+static errc snapshot_diff(struct file_watcher* watcher, file_watch_callback onChanged, void* ctx, u32* outChanges)
+{
+    struct file_watch_snapshot* old = watcher->snapshot;
+    u32 oldLen = watcher->snapshotLen;
+    u32 oldCap = watcher->snapshotCap;
+
+    errc result = snapshot_take(watcher);
+    if(result != ERR_OK)
+    {
+        // keep the old snapshot so the next poll compares against it
+        snapshot_free(watcher->snapshot, watcher->snapshotLen, watcher->snapshotCap);
+        watcher->snapshot = old;
+        watcher->snapshotLen = oldLen;
+        watcher->snapshotCap = oldCap;
+        halc_raise(result);
+    }
+
+    u32 i = 0;
+    u32 j = 0;
+    *outChanges = 0;
+    while(i < oldLen || j < watcher->snapshotLen)
+    {
+        int order = i == oldLen ? 1 : j == watcher->snapshotLen ? -1 : 
+            strcmp(old[i].path.buffer, watcher->snapshot[j].path.buffer);
+
+        if(order < 0)
+        {
+            onChanged(ctx, &old[i].path);
+            *outChanges += 1;
+            i += 1;
+        }
+        else if(order > 0)
+        {
+            onChanged(ctx, &watcher->snapshot[j].path);
+            *outChanges += 1;
+            j += 1;
+        }
+        else
+        {
+            // a directory's time changes whenever its entries do, and those get reported themselves
+            const struct dir_entry_info* before = &old[i].info;
+            const struct dir_entry_info* after = &watcher->snapshot[j].info;
+            if(before->isDirectory != after->isDirectory || 
+                (!after->isDirectory && (before->size != after->size || before->modifiedTime != after->modifiedTime)))
+            {
+                onChanged(ctx, &watcher->snapshot[j].path);
+                *outChanges += 1;
+            }
+            i += 1;
+            j += 1;
+        }
+    }
+
+    snapshot_free(old, oldLen, oldCap);
+    halc_end;
+}
+
+// ---- inotify ----
+
+#if defined(HALC_HAS_INOTIFY)
+
+#define FILE_WATCH_DIR_MASK (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_CREATE | IN_DELETE | IN_ONLYDIR | IN_DONT_FOLLOW)
+
+static struct file_watch_dir* watcher_find_dir(struct file_watcher* watcher, i32 wd)
+{
+    for(u32 i = 0; i < watcher->dirCount; i += 1)
+    {
+        if(watcher->dirs[i].wd == wd)
+        {
+            return &watcher->dirs[i];
+        }
+    }
+    return NULL;
+}
+
+static errc watcher_add_dir(struct file_watcher* watcher, const hstr* path)
+{
+    i32 wd = inotify_add_watch(watcher->fd, path->buffer, FILE_WATCH_DIR_MASK);
+    if(wd < 0)
+    {
+        // it may already be gone again, that's reported by its parent
+        if(errno == ENOENT || errno == ENOTDIR)
+        {
+            halc_end;
+        }
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    // watching a directory twice hands back the same descriptor, keep the newest path
+    struct file_watch_dir* existing = watcher_find_dir(watcher, wd);
+    if(existing)
+    {
+        hstr_free(&existing->path);
+        halc_try(hstr_dupe(path, &existing->path));
+        halc_end;
+    }
+
+    halc_try(watcher_reserve((void**) &watcher->dirs, &watcher->dirCap, watcher->dirCount, sizeof(struct file_watch_dir)));
+    watcher->dirs[watcher->dirCount].wd = wd;
+    halc_try(hstr_dupe(path, &watcher->dirs[watcher->dirCount].path));
+    watcher->dirCount += 1;
+
+    halc_end;
+}
+
+static errc watcher_add_entry(void* ctx, const hstr* path, const struct dir_entry_info* info)
+{
+    if(info->isDirectory)
+    {
+        halc_try(watcher_add_dir((struct file_watcher*) ctx, path));
+    }
+    halc_end;
+}
+
+// watches the directory and every directory below it
+static errc watcher_add_tree(struct file_watcher* watcher, const hstr* path)
+{
+    halc_try(watcher_add_dir(watcher, path));
+    halc_try(walk_directory(path, watcher_add_entry, watcher));
+    halc_end;
+}
+
+static void watcher_remove_dir(struct file_watcher* watcher, i32 wd)
+{
+    struct file_watch_dir* dir = watcher_find_dir(watcher, wd);
+    if(dir)
+    {
+        hstr_free(&dir->path);
+        *dir = watcher->dirs[watcher->dirCount - 1];
+        watcher->dirCount -= 1;
+    }
+}
+
+// a directory moved out of the tree keeps its watches, drop them along with every one below it
+static void watcher_remove_tree(struct file_watcher* watcher, const hstr* path)
+{
+    for(u32 i = 0; i < watcher->dirCount;)
+    {
+        struct file_watch_dir* dir = &watcher->dirs[i];
+        if(dir->path.len < path->len || memcmp(dir->path.buffer, path->buffer, path->len) != 0 ||
+            (dir->path.len != path->len && dir->path.buffer[path->len] != '/'))
+        {
+            i += 1;
+            continue;
+        }
+
+        inotify_rm_watch(watcher->fd, dir->wd);
+        hstr_free(&dir->path);
+        *dir = watcher->dirs[watcher->dirCount - 1];
+        watcher->dirCount -= 1;
+    }
+}
+
+static void watcher_free_dirs(struct file_watcher* watcher)
+{
+    for(u32 i = 0; i < watcher->dirCount; i += 1)
+    {
+        hstr_free(&watcher->dirs[i].path);
+    }
+    if(watcher->dirCap)
+    {
+        hfree(watcher->dirs, watcher->dirCap * sizeof(struct file_watch_dir));
+    }
+    watcher->dirs = NULL;
+    watcher->dirCount = 0;
+    watcher->dirCap = 0;
+}
+
+static errc watcher_read_events(struct file_watcher* watcher, file_watch_callback onChanged, void* ctx)
+{
+    // aligned for the event structs, big enough for a burst of saves
+    u64 buffer[4096 / sizeof(u64)];
+    hstr path;
+    hstr_init(&path);
+
+    for(;;)
+    {
+        isize bytes = read(watcher->fd, buffer, sizeof(buffer));
+        if(bytes <= 0)
+        {
+            if(bytes < 0 && errno == EINTR)
+            {
+                continue;
+            }
+            break;
+        }
+
+        for(u8* cursor = (u8*) buffer; cursor < (u8*) buffer + bytes;)
+        {
+            const struct inotify_event* event = (const struct inotify_event*) cursor;
+            cursor += sizeof(struct inotify_event) + event->len;
+
+            if(event->mask & IN_Q_OVERFLOW)
+            {
+                // events were dropped, look at everything again and pick up any directories we missed
+                onChanged(ctx, &watcher->root);
+                halc_tryCleanup(watcher_add_tree(watcher, &watcher->root));
+                continue;
+            }
+
+            if(event->mask & IN_IGNORED)
+            {
+                watcher_remove_dir(watcher, event->wd);
+                continue;
+            }
+
+            struct file_watch_dir* dir = watcher_find_dir(watcher, event->wd);
+            if(!dir || event->len == 0)
+            {
+                continue;
+            }
+
+            path.len = 0;
+            halc_tryCleanup(hstr_append(&path, &dir->path));
+            halc_tryCleanup(hstr_append_char(&path, '/'));
+            halc_tryCleanup(hstr_append_cstr(&path, event->name));
+
+            if(event->mask & IN_ISDIR)
+            {
+                if(event->mask & IN_MOVED_FROM)
+                {
+                    watcher_remove_tree(watcher, &path);
+                }
+                if(event->mask & (IN_CREATE | IN_MOVED_TO))
+                {
+                    halc_tryCleanup(watcher_add_tree(watcher, &path));
+                }
+                if(event->mask & (IN_CREATE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE))
+                {
+                    onChanged(ctx, &path);
+                }
+            }
+            // files are reported once they're closed, not while they're still being written
+            else if(event->mask & (IN_CLOSE_WRITE | IN_MOVED_TO | IN_MOVED_FROM | IN_DELETE))
+            {
+                onChanged(ctx, &path);
+            }
+        }
+    }
+
+cleanup:
+    hstr_free(&path);
+    halc_end;
+}
+
+#endif
+
+errc file_watcher_open(struct file_watcher* watcher, const hstr* rootPath)
+{
+    memset(watcher, 0, sizeof(*watcher));
+    watcher->fd = -1;
+    halc_try(copy_root_path(&watcher->root, rootPath));
+
+#if defined(HALC_HAS_INOTIFY)
+    watcher->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if(watcher->fd >= 0)
+    {
+        errc result = watcher_add_tree(watcher, &watcher->root);
+        halc_end_ok;
+        if(result == ERR_OK)
+        {
+            halc_end;
+        }
+
+        // most likely out of watches, polling works for any size of tree
+        watcher_free_dirs(watcher);
+        close(watcher->fd);
+        watcher->fd = -1;
+    }
+#endif
+
+    watcher->polling = TRUE;
+    halc_tryCleanup(snapshot_take(watcher));
+    halc_end;
+
+cleanup:
+    file_watcher_close(watcher);
+    halc_end;
+}
+
+errc file_watcher_poll(struct file_watcher* watcher, u32 timeoutMs, file_watch_callback onChanged, void* ctx)
+{
+#if defined(HALC_HAS_INOTIFY)
+    if(!watcher->polling)
+    {
+        struct pollfd pfd = {watcher->fd, POLLIN, 0};
+        int ready = poll(&pfd, 1, (int) timeoutMs);
+        if(ready > 0)
+        {
+            halc_try(watcher_read_events(watcher, onChanged, ctx));
+        }
+        halc_end;
+    }
+#endif
+
+    u32 changes = 0;
+    halc_try(snapshot_diff(watcher, onChanged, ctx, &changes));
+    if(changes == 0 && timeoutMs > 0)
+    {
+        watcher_sleep(timeoutMs);
+        halc_try(snapshot_diff(watcher, onChanged, ctx, &changes));
+    }
 
-    hstr_free(&file);
     halc_end;
 }
+
+void file_watcher_close(struct file_watcher* watcher)
+{
+#if defined(HALC_HAS_INOTIFY)
+    watcher_free_dirs(watcher);
+    if(watcher->fd >= 0)
+    {
+        close(watcher->fd);
+    }
+#endif
+    watcher->fd = -1;
+
+    snapshot_free(watcher->snapshot, watcher->snapshotLen, watcher->snapshotCap);
+    watcher->snapshot = NULL;
+    watcher->snapshotLen = 0;
+    watcher->snapshotCap = 0;
+
+    hstr_free(&watcher->root);
+}
@@ -8,10 +8,138 @@
 
 EXTERN_C_BEGIN
 
+// fopen that also works with msvc's secure crt
+FILE* h_fopen(const char* filePath, const char* opts);
+
 // load file into an hstr struct
 errc load_file(hstr* out, const hstr* filePath);
 errc load_and_decode_from_file(hstr* out, const hstr* filePath);
 
+// a file mapped straight from the page cache. contents is a read only view 
+// (cap == -1) that stays valid until unmap_file.
+//
+// where mmap isn't available (windows, or HALC_NO_MMAP) the file is read into 
+// a heap buffer instead, the view works the same either way.
+//
+// eg.
+//
+//  struct mapped_file file;
+//  halc_try(map_file(&file, &filePath));
+//  halc_tryCleanup(tokenize_raw(&ts, &file.contents, &filePath, NULL));
+//  ...
+//  unmap_file(&file);
+//
+struct mapped_file {
+    hstr contents;
+    void* mapping;     // start of the mapping, NULL when the file was read instead
+    usize mappingSize;
+    hstr readBuffer;   // owns the contents when the file was read
+};
+
+errc map_file(struct mapped_file* out, const hstr* filePath);
+
+// same as map_file, but the contents aren't checked for utf8, for files with a binary format
+errc map_file_binary(struct mapped_file* out, const hstr* filePath);
+void unmap_file(struct mapped_file* file);
+
+// loads a batch of files and hands each one to onLoaded as soon as it's in memory, 
+// files finish in whatever order the disk gets to them. On ERR_OK onLoaded owns 
+// contents and has to hstr_free it, otherwise result is what load_file would have 
+// returned for that file and contents is empty. onLoaded runs on the calling thread.
+//
+// on linux the opens, stats and reads for the whole batch go through one io_uring
+// so they cost a handful of syscalls instead of several per file. Everywhere else, 
+// or when io_uring is unavailable (HALC_NO_IO_URING, old kernels, disabled by the
+// sysctl), files are loaded one after the other with load_file. A file that fails 
+// on the ring is retried with load_file so errors are reported the same either way.
+//
+// eg.
+//
+//  static void on_loaded(void* ctx, u32 index, errc result, hstr* contents) { ... }
+//  halc_try(load_file_batch(paths, pathCount, on_loaded, &myState));
+//
+typedef void (*file_batch_callback)(void* ctx, u32 index, errc result, hstr* contents);
+
+errc load_file_batch(const hstr* filePaths, u32 count, file_batch_callback onLoaded, void* ctx);
+
+// TRUE when load_file_batch can use io_uring on this machine
+b8 file_batch_has_io_uring();
+
+// ==================== Directories ======================
+
+struct dir_entry_info {
+    b8 isDirectory;
+    u64 size;
+    i64 modifiedTime; // platform units, only good for telling whether a file changed
+};
+
+// returning an error from the callback stops the walk and walk_directory returns it
+typedef errc (*walk_callback)(void* ctx, const hstr* path, const struct dir_entry_info* info);
+
+// calls onEntry for every directory and regular file below root, each directory before
+// the entries in it. paths are the root joined with the path below it. Symlinks are 
+// skipped so links can't send the walk in circles.
+errc walk_directory(const hstr* rootPath, walk_callback onEntry, void* ctx);
+
+// FALSE if there's nothing at path, or it's a link or something other than a file or directory
+b8 get_path_info(const hstr* path, struct dir_entry_info* out);
+
+// TRUE if the path ends in .halc
+b8 is_halc_path(const hstr* path);
+
+// initializes out to rootPath without its trailing slashes, the form every path 
+// walk_directory reports starts with
+errc copy_root_path(hstr* out, const hstr* rootPath);
+
+// ==================== File watching ======================
+//
+// reports paths below a directory that changed since the last poll. On linux it's 
+// inotify with a watch on every directory in the tree, new directories are picked up
+// as they're created. Elsewhere, or when inotify is unavailable (HALC_NO_INOTIFY or 
+// out of watches), every poll walks the tree and compares sizes and modified times.
+//
+// a reported path is a file that was written, created, moved or deleted, or a 
+// directory that appeared or went away, which means everything under it changed. 
+// The root itself is reported when events were lost and everything has to be 
+// looked at again. The same path can come up more than once in a poll.
+//
+// eg.
+//
+//  struct file_watcher watcher;
+//  halc_try(file_watcher_open(&watcher, &rootPath));
+//  while(running)
+//      halc_try(file_watcher_poll(&watcher, 250, on_changed, &state));
+//  file_watcher_close(&watcher);
+//
+struct file_watch_dir;
+struct file_watch_snapshot;
+
+struct file_watcher {
+    hstr root;
+    b8 polling;     // TRUE when falling back to walking the tree
+
+    // inotify
+    i32 fd;
+    struct file_watch_dir* dirs;
+    u32 dirCount;
+    u32 dirCap;
+
+    // polling, what the tree looked like at the last poll
+    struct file_watch_snapshot* snapshot;
+    u32 snapshotLen;
+    u32 snapshotCap;
+};
+
+typedef void (*file_watch_callback)(void* ctx, const hstr* path);
+
+errc file_watcher_open(struct file_watcher* watcher, const hstr* rootPath);
+
+// waits up to timeoutMs for changes and reports them, returns without calling 
+// onChanged if nothing changed in that time
+errc file_watcher_poll(struct file_watcher* watcher, u32 timeoutMs, file_watch_callback onChanged, void* ctx);
+
+void file_watcher_close(struct file_watcher* watcher);
+
 EXTERN_C_END
 
 #endif
@@ -0,0 +1,139 @@
+#include "halc_hash.h"
+
+#include <string.h>
+
+#if defined(_MSC_VER) && defined(_M_X64)
+#include <intrin.h>
+#endif
+
+static const u64 gHashSecret[4] = {
+    0x2d358dccaa6c78a5ull, 0x8bb84b93962eacc9ull, 0x4b33a62ed433d4a3ull, 0x4d5a2da51de1aa47ull
+};
+
+// full 64x64 -> 128 bit multiply, low half into a and high half into b
+static inline void hash_mum(u64* a, u64* b)
+{
+#if defined(__SIZEOF_INT128__)
+    __uint128_t r = (__uint128_t) *a * *b;
+    *a = (u64) r;
+    *b = (u64)(r >> 64);
+#elif defined(_MSC_VER) && defined(_M_X64)
+    *a = _umul128(*a, *b, b);
+#else
+    u64 ha = *a >> 32, hb = *b >> 32, la = (u32) *a, lb = (u32) *b;
+    u64 rh = ha * hb, rm0 = ha * lb, rm1 = hb * la, rl = la * lb;
+    u64 t = rl + (rm0 << 32);
+    u64 c = t < rl;
+    u64 lo = t + (rm1 << 32);
+    c += lo < t;
+    u64 hi = rh + (rm0 >> 32) + (rm1 >> 32) + c;
+    *a = lo;
+    *b = hi;
+#endif
+}
+
+static inline u64 hash_mix(u64 a, u64 b)
+{
+    hash_mum(&a, &b);
+    return a ^ b;
+}
+
+// unaligned little endian reads
+static inline u64 hash_read8(const u8* p)
+{
+    u64 v;
+    memcpy(&v, p, 8);
+    return v;
+}
+
+static inline u64 hash_read4(const u8* p)
+{
+    u32 v;
+    memcpy(&v, p, 4);
+    return v;
+}
+
+// 1 to 3 bytes, first, middle and last
+static inline u64 hash_read3(const u8* p, usize k)
+{
+    return (((u64) p[0]) << 16) | (((u64) p[k >> 1]) << 8) | p[k - 1];
+}
+
+u64 halc_hash64(const void* data, usize len, u64 seed)
+{
+    const u8* p = (const u8*) data;
+    seed ^= hash_mix(seed ^ gHashSecret[0], gHashSecret[1]);
+
+    u64 a;
+    u64 b;
+    if(len <= 16)
+    {
+        if(len >= 4)
+        {
+            // two overlapping pairs of 4 byte reads cover 4 to 16 bytes without a loop
+            usize mid = (len >> 3) << 2;
+            a = (hash_read4(p) << 32) | hash_read4(p + mid);
+            b = (hash_read4(p + len - 4) << 32) | hash_read4(p + len - 4 - mid);
+        }
+        else if(len > 0)
+        {
+            a = hash_read3(p, len);
+            b = 0;
+        }
+        else
+        {
+            a = 0;
+            b = 0;
+        }
+    }
+    else
+    {
+        usize i = len;
+        if(i > 48)
+        {
+            u64 seed1 = seed;
+            u64 seed2 = seed;
+            do
+            {
+                seed = hash_mix(hash_read8(p) ^ gHashSecret[1], hash_read8(p + 8) ^ seed);
+                seed1 = hash_mix(hash_read8(p + 16) ^ gHashSecret[2], hash_read8(p + 24) ^ seed1);
+                seed2 = hash_mix(hash_read8(p + 32) ^ gHashSecret[3], hash_read8(p + 40) ^ seed2);
+                p += 48;
+                i -= 48;
+            } while(i > 48);
+            seed ^= seed1 ^ seed2;
+        }
+
+        while(i > 16)
+        {
+            seed = hash_mix(hash_read8(p) ^ gHashSecret[1], hash_read8(p + 8) ^ seed);
+            i -= 16;
+            p += 16;
+        }
+
+        // the last 16 bytes, overlapping what was already consumed
+        a = hash_read8(p + i - 16);
+        b = hash_read8(p + i - 8);
+    }
+
+    a ^= gHashSecret[1];
+    b ^= seed;
+    hash_mum(&a, &b);
+    return hash_mix(a ^ gHashSecret[0] ^ len, b ^ gHashSecret[1]);
+}
+
+u32 halc_hash32(const void* data, usize len, u64 seed)
+{
+    u64 hash = halc_hash64(data, len, seed);
+    return (u32)(hash ^ (hash >> 32));
+}
+
+u64 hstr_hash64(const hstr* string, u64 seed)
+{
+    return halc_hash64(string->buffer, string->len, seed);
+}
+
+u32 hstr_hash32(const hstr* string)
+{
+    return halc_hash32(string->buffer, string->len, HALC_HASH_DEFAULT_SEED);
+}
@@ -0,0 +1,40 @@
+#ifndef _HALC_HASH_H_
+#define _HALC_HASH_H_
+
+#include "halc_types.h"
+#include "halc_strings.h"
+
+EXTERN_C_BEGIN
+
+// ==================== Hashing ======================
+//
+// the one non cryptographic hash used across the library (symbol tables, label 
+// maps, caches keyed on content). It's wyhash (final version 4): keys up to 16 
+// bytes take two multiplies, longer keys are consumed 48 bytes per step through 
+// three independent multiply chains.
+//
+// results are stable across runs and platforms of the same endianness, so they 
+// can be written to disk as long as the seed is too. The seed changes every output 
+// bit, use a random one for tables that take untrusted keys.
+//
+// eg.
+//
+//  u32 slot = hstr_hash32(&label) & (cap - 1);
+//  u64 key = halc_hash64(bytes, len, HALC_HASH_DEFAULT_SEED);
+//
+
+#define HALC_HASH_DEFAULT_SEED 0ull
+
+u64 halc_hash64(const void* data, usize len, u64 seed);
+
+// the 64 bit hash folded down, for tables indexed with u32
+u32 halc_hash32(const void* data, usize len, u64 seed);
+
+u64 hstr_hash64(const hstr* string, u64 seed);
+
+// with the default seed, what symbol tables and label maps use
+u32 hstr_hash32(const hstr* string);
+
+EXTERN_C_END
+
+#endif
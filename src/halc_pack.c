@@ -0,0 +1,379 @@
+#include "halc_pack.h"
+#include "halc_allocators.h"
+#include "halc_hash.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(_WIN32)
+#include <windows.h>
+#endif
+
+#define PACK_MAGIC 0x4b504c48 // "HLPK"
+#define PACK_FORMAT 1
+#define PACK_TEMP_EXTENSION ".tmp"
+
+// the data starts on a page so it maps cleanly, files start on a cache line
+#define PACK_DATA_ALIGNMENT 4096
+#define PACK_FILE_ALIGNMENT 64
+
+#define PACK_ENTRIES_INITIAL_CAP 64
+
+// followed by the entries, then the paths, then the data
+struct pack_header {
+    u32 magic;
+    u32 format;
+    u64 size;       // of the whole archive, a truncated one is caught before anything is read
+    u32 entryCount;
+    u32 pathsSize;
+    u64 pathsOffset;
+    u64 dataOffset;
+    u64 reserved;
+};
+
+static u64 pack_align(u64 offset, u64 alignment)
+{
+    return (offset + alignment - 1) & ~(alignment - 1);
+}
+
+static u64 pack_path_hash(const char* path, u32 len)
+{
+    return halc_hash64(path, len, HALC_HASH_DEFAULT_SEED);
+}
+
+// ======================= writing =================
+
+struct pack_source {
+    hstr path;      // the file on disk
+    u32 rootLen;    // how much of path is the root and its slash
+    u64 hash;
+};
+
+struct pack_source_list {
+    struct pack_source* sources;
+    u32 len;
+    u32 cap;
+    u32 rootLen;
+};
+
+static errc pack_collect(void* ctx, const hstr* path, const struct dir_entry_info* info)
+{
+    struct pack_source_list* list = (struct pack_source_list*) ctx;
+    if(info->isDirectory || !is_halc_path(path))
+    {
+        halc_end;
+    }
+
+    if(list->len == list->cap)
+    {
+        u32 newCap = list->cap ? list->cap * 2 : PACK_ENTRIES_INITIAL_CAP;
+        if(list->cap)
+        {
+            hrealloc(&list->sources, list->cap * sizeof(struct pack_source), newCap * sizeof(struct pack_source), FALSE);
+        }
+        else
+        {
+            halloc(&list->sources, newCap * sizeof(struct pack_source));
+        }
+        list->cap = newCap;
+    }
+
+    struct pack_source* source = &list->sources[list->len];
+    hstr_init(&source->path);
+    halc_try(hstr_dupe(path, &source->path));
+    source->rootLen = list->rootLen;
+    source->hash = pack_path_hash(path->buffer + list->rootLen, path->len - list->rootLen);
+    list->len += 1;
+
+    halc_end;
+}
+
+static int compare_pack_sources(const void* left, const void* right)
+{
+    const struct pack_source* a = (const struct pack_source*) left;
+    const struct pack_source* b = (const struct pack_source*) right;
+    if(a->hash != b->hash)
+    {
+        return a->hash < b->hash ? -1 : 1;
+    }
+    return strcmp(a->path.buffer + a->rootLen, b->path.buffer + b->rootLen);
+}
+
+static b8 write_zeros(FILE* file, u64 count)
+{
+    static const u8 zeros[PACK_FILE_ALIGNMENT] = {0};
+    while(count > 0)
+    {
+        usize chunk = count > sizeof(zeros) ? sizeof(zeros) : (usize) count;
+        if(fwrite(zeros, 1, chunk, file) != chunk)
+        {
+            return FALSE;
+        }
+        count -= chunk;
+    }
+    return TRUE;
+}
+
+errc pack_write(const hstr* rootPath, const hstr* packPath)
+{
+    struct pack_source_list list = {NULL, 0, 0, 0};
+    struct pack_header header;
+    struct pack_entry* entries = NULL;
+    char* paths = NULL;
+    hstr root;
+    hstr tempPath;
+    hstr contents;
+    FILE* file = NULL;
+    b8 ok = TRUE;
+
+    hstr_init(&root);
+    hstr_init(&tempPath);
+    hstr_init(&contents);
+    memset(&header, 0, sizeof(header));
+
+    halc_tryCleanup(copy_root_path(&root, rootPath));
+    list.rootLen = root.len + 1;
+
+    halc_tryCleanup(walk_directory(&root, pack_collect, &list));
+    qsort(list.sources, list.len, sizeof(struct pack_source), compare_pack_sources);
+
+    // the index is laid out up front, the files' sizes are filled in as they're written
+    header.magic = PACK_MAGIC;
+    header.format = PACK_FORMAT;
+    header.entryCount = list.len;
+    header.pathsOffset = sizeof(struct pack_header) + (u64) list.len * sizeof(struct pack_entry);
+    for(u32 i = 0; i < list.len; i += 1)
+    {
+        header.pathsSize += list.sources[i].path.len - list.sources[i].rootLen + 1;
+    }
+    header.dataOffset = pack_align(header.pathsOffset + header.pathsSize, PACK_DATA_ALIGNMENT);
+
+    if(list.len)
+    {
+        halloc_cleanup(&entries, list.len * sizeof(struct pack_entry));
+        halloc_cleanup(&paths, header.pathsSize);
+    }
+
+    {
+        u32 pathOffset = 0;
+        for(u32 i = 0; i < list.len; i += 1)
+        {
+            const struct pack_source* source = &list.sources[i];
+            u32 pathLen = source->path.len - source->rootLen;
+            memset(&entries[i], 0, sizeof(struct pack_entry));
+            entries[i].hash = source->hash;
+            entries[i].pathOffset = pathOffset;
+            entries[i].pathLen = pathLen;
+            memcpy(paths + pathOffset, source->path.buffer + source->rootLen, pathLen + 1);
+            pathOffset += pathLen + 1;
+        }
+    }
+
+    // written beside the target and renamed over it, so a failed pack never replaces a good one
+    halc_tryCleanup(hstr_append(&tempPath, packPath));
+    {
+        const hstr tempExtension = HSTR(PACK_TEMP_EXTENSION);
+        halc_tryCleanup(hstr_append(&tempPath, &tempExtension));
+    }
+
+    file = h_fopen(tempPath.buffer, "wb");
+    if(!file)
+    {
+        fprintf(stderr, "\n  Unable to open file: %s\n", tempPath.buffer);
+        halc_raiseCleanup(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    u64 offset = header.dataOffset;
+    ok = write_zeros(file, header.dataOffset);
+    for(u32 i = 0; i < list.len && ok; i += 1)
+    {
+        halc_tryCleanup(load_file(&contents, &list.sources[i].path));
+
+        u64 start = pack_align(offset, PACK_FILE_ALIGNMENT);
+        ok = write_zeros(file, start - offset) && (contents.len == 0 || fwrite(contents.buffer, 1, contents.len, file) == contents.len);
+        entries[i].offset = start;
+        entries[i].size = contents.len;
+        offset = start + contents.len;
+
+        hstr_free(&contents);
+    }
+    header.size = offset;
+
+    ok = ok && fseek(file, 0, SEEK_SET) == 0 && fwrite(&header, sizeof(header), 1, file) == 1;
+    if(list.len)
+    {
+        ok = ok && fwrite(entries, sizeof(struct pack_entry), list.len, file) == list.len &&
+            fwrite(paths, 1, header.pathsSize, file) == header.pathsSize;
+    }
+
+    if(fclose(file) != 0)
+    {
+        ok = FALSE;
+    }
+    file = NULL;
+
+#if defined(_WIN32)
+    if(!ok || !MoveFileExA(tempPath.buffer, packPath->buffer, MOVEFILE_REPLACE_EXISTING))
+#else
+    if(!ok || rename(tempPath.buffer, packPath->buffer) != 0)
+#endif
+    {
+        fprintf(stderr, "\n  Unable to write pack: %s\n", packPath->buffer);
+        halc_raiseCleanup(ERR_FILE_WRITE_ERROR);
+    }
+
+cleanup:
+    if(file)
+    {
+        fclose(file);
+    }
+    if(gErrorCatch != ERR_OK && tempPath.len)
+    {
+        remove(tempPath.buffer);
+    }
+
+    for(u32 i = 0; i < list.len; i += 1)
+    {
+        hstr_free(&list.sources[i].path);
+    }
+    if(list.cap)
+    {
+        hfree(list.sources, list.cap * sizeof(struct pack_source));
+    }
+    if(entries)
+    {
+        hfree(entries, list.len * sizeof(struct pack_entry));
+    }
+    if(paths)
+    {
+        hfree(paths, header.pathsSize);
+    }
+    hstr_free(&contents);
+    hstr_free(&tempPath);
+    hstr_free(&root);
+    halc_end;
+}
+
+// ======================= reading =================
+
+// everything pack_find and the entry accessors rely on is checked here once
+static b8 pack_validate(struct pack* pack)
+{
+    const u8* base = (const u8*) pack->file.contents.buffer;
+    u64 size = pack->file.contents.len;
+    struct pack_header header;
+
+    if(size < sizeof(header))
+    {
+        return FALSE;
+    }
+    memcpy(&header, base, sizeof(header));
+
+    if(header.magic != PACK_MAGIC || header.format != PACK_FORMAT || header.size != size ||
+        header.pathsOffset != sizeof(header) + (u64) header.entryCount * sizeof(struct pack_entry) ||
+        header.pathsOffset + header.pathsSize > header.dataOffset || header.dataOffset > size)
+    {
+        return FALSE;
+    }
+
+    pack->entries = (const struct pack_entry*) (base + sizeof(header));
+    pack->paths = (const char*) (base + header.pathsOffset);
+    pack->entryCount = header.entryCount;
+
+    for(u32 i = 0; i < header.entryCount; i += 1)
+    {
+        const struct pack_entry* entry = &pack->entries[i];
+        if((u64) entry->pathOffset + entry->pathLen >= header.pathsSize || pack->paths[entry->pathOffset + entry->pathLen] != 0 ||
+            entry->offset < header.dataOffset || entry->offset > size || entry->size > size - entry->offset ||
+            entry->hash != pack_path_hash(pack->paths + entry->pathOffset, entry->pathLen))
+        {
+            return FALSE;
+        }
+
+        // strictly in order of hash then path, so the same path can't be in there twice
+        if(i > 0)
+        {
+            const struct pack_entry* last = &pack->entries[i - 1];
+            if(entry->hash < last->hash || 
+                (entry->hash == last->hash && strcmp(pack->paths + entry->pathOffset, pack->paths + last->pathOffset) <= 0))
+            {
+                return FALSE;
+            }
+        }
+    }
+
+    return TRUE;
+}
+
+errc pack_open(struct pack* pack, const hstr* packPath)
+{
+    memset(pack, 0, sizeof(*pack));
+    halc_try(map_file_binary(&pack->file, packPath));
+
+    if(!pack_validate(pack))
+    {
+        fprintf(stderr, "\n  Not a pack, or a damaged one: %s\n", packPath->buffer);
+        pack_close(pack);
+        halc_raise(ERR_INCONSISTENT_FILE_FORMAT);
+    }
+
+    halc_end;
+}
+
+void pack_close(struct pack* pack)
+{
+    unmap_file(&pack->file);
+    pack->entries = NULL;
+    pack->paths = NULL;
+    pack->entryCount = 0;
+}
+
+b8 pack_find(const struct pack* pack, const hstr* path, hstr* outContents)
+{
+    u64 hash = pack_path_hash(path->buffer, path->len);
+
+    // the first entry with this hash, then every one that shares it
+    u32 low = 0;
+    u32 high = pack->entryCount;
+    while(low < high)
+    {
+        u32 mid = low + (high - low) / 2;
+        if(pack->entries[mid].hash < hash)
+        {
+            low = mid + 1;
+        }
+        else
+        {
+            high = mid;
+        }
+    }
+
+    for(u32 i = low; i < pack->entryCount && pack->entries[i].hash == hash; i += 1)
+    {
+        const struct pack_entry* entry = &pack->entries[i];
+        if(entry->pathLen == path->len && memcmp(pack->paths + entry->pathOffset, path->buffer, path->len) == 0)
+        {
+            pack_entry_contents(pack, i, outContents);
+            return TRUE;
+        }
+    }
+
+    return FALSE;
+}
+
+void pack_entry_path(const struct pack* pack, u32 index, hstr* outPath)
+{
+    const struct pack_entry* entry = &pack->entries[index];
+    outPath->buffer = (hchar*) (pack->paths + entry->pathOffset);
+    outPath->len = entry->pathLen;
+    outPath->cap = -1;
+}
+
+void pack_entry_contents(const struct pack* pack, u32 index, hstr* outContents)
+{
+    const struct pack_entry* entry = &pack->entries[index];
+    outContents->buffer = pack->file.contents.buffer + entry->offset;
+    outContents->len = entry->size;
+    outContents->cap = -1;
+}
@@ -0,0 +1,70 @@
+#ifndef _HALC_PACK_H_
+#define _HALC_PACK_H_
+
+#include "halc_types.h"
+#include "halc_errors.h"
+#include "halc_strings.h"
+#include "halc_files.h"
+
+EXTERN_C_BEGIN
+
+// ==================== Story Packs ======================
+//
+// a pack is every .halc file of a region in one archive, so a shipped game opens a
+// single file at startup instead of thousands. The archive is a header, an index
+// of entries sorted by the hash of their path, the paths, then the contents of
+// every file. The data starts on a page boundary and each file on a 64 byte one.
+//
+// opening a pack maps it and checks the index, nothing else is read. pack_find
+// binary searches the index and hands back a view straight into the mapping, the
+// file's pages only fault in once something reads them.
+//
+// paths in a pack are relative to the root it was built from, with '/' between
+// directories. Views are valid until pack_close and read only (cap == -1).
+//
+// eg.
+//
+//  halc_try(pack_write(&rootPath, &packPath));  // at build time
+//
+//  struct pack pack;
+//  halc_try(pack_open(&pack, &packPath));
+//  if(pack_find(&pack, &path, &contents)) ... // path like "events/intro.halc"
+//  pack_close(&pack);
+//
+
+#define HALC_PACK_EXTENSION ".hpak"
+
+struct pack_entry {
+    u64 hash;       // of the path, what the index is sorted on
+    u64 offset;     // of the contents, from the start of the archive
+    u32 size;
+    u32 pathOffset; // into the paths, which are null terminated
+    u32 pathLen;
+    u32 reserved;
+};
+
+struct pack {
+    struct mapped_file file;
+    const struct pack_entry* entries;
+    const char* paths;
+    u32 entryCount;
+};
+
+// packs every .halc file under rootPath into one archive at packPath, replacing
+// whatever was there. Fails if any of the files can't be loaded.
+errc pack_write(const hstr* rootPath, const hstr* packPath);
+
+// ERR_INCONSISTENT_FILE_FORMAT if it isn't a pack, or it's damaged or from another version
+errc pack_open(struct pack* pack, const hstr* packPath);
+void pack_close(struct pack* pack);
+
+// FALSE if there's no file at that path in the pack
+b8 pack_find(const struct pack* pack, const hstr* path, hstr* outContents);
+
+// for going over every file, entries are in hash order
+void pack_entry_path(const struct pack* pack, u32 index, hstr* outPath);
+void pack_entry_contents(const struct pack* pack, u32 index, hstr* outContents);
+
+EXTERN_C_END
+
+#endif
@@ -13,12 +13,29 @@ struct anode_list_ref {
     i32* listEnd;
 };
 
+// ast nodes live in a pool so their addresses are stable while the parser grows.
+// parser_init sizes the first slab for the whole file, so lookups are nearly 
+// always a flat index into it, the reduce scans are very sensitive to this.
+static struct anode* p_ast_slow(struct s_parser* p, i32 node)
+{
+    return (struct anode*) pool_at(&p->ast, (u32) node);
+}
+
+static struct anode* p_ast(struct s_parser* p, i32 node)
+{
+    if((u32) node < p->astFirstCap)
+    {
+        return p->astFirst + node;
+    }
+    return p_ast_slow(p, node);
+}
+
 void parser_dump_stack(struct s_parser* p)
 {
     printf("stack: ");
     for (i32 i = 0; i < p->stackCount; i += 1)
     {
-        printf(" %s ", node_id_to_string(p->ast[p->stack[i]].typeTag));
+        printf(" %s ", node_id_to_string(p_ast(p, p->stack[i])->typeTag));
     }
     printf("\n");
 }
@@ -45,14 +62,14 @@ void halc_clear_parser_run_verbose()
 
 static i32 p_getTokenFromNode(struct s_parser* p, i32 node)
 {
-    return p->ast[node].nodeData.token;
+    return p_ast(p, node)->nodeData.token;
 }
 
 
 static void print_error_at_node(struct s_parser* p, i32 node, const char* errorText)
 {
     fprintf(stderr, "\n");
-    p_print_node(p, p->ast + node, RED_S);
+    p_print_node(p, p_ast(p, node), RED_S);
 
     fprintf(stderr, RED("Error: %s \n"), errorText);
 }
@@ -76,13 +93,10 @@ static errc aindex_init(struct aindex_list* list, i32 initialCap)
     halc_end;
 }
 
-static errc p_getTokenLabelText(struct s_parser* p, i32 node, hstr *gotoString)
+// interned text of a LABEL node, see halc_symbols.h
+static u32 p_getTokenSymbol(struct s_parser* p, i32 node)
 {
-    // assert(p_getTypeTag(p, node) == LABEL);
-
-    *gotoString = p->ts->tokens[p->ast[node].nodeData.token].tokenView;
-
-    halc_end;
+    return p->ts->tokens[p_ast(p, node)->nodeData.token].symbol;
 }
 
 static errc aindex_push(struct aindex_list* list, i32 newIndex)
@@ -123,7 +137,7 @@ static i32 p_get_index_list_start(struct s_parser* p)
 
 static void p_assign_parent(struct s_parser* p, i32 target, i32 newParent)
 {
-    p->ast[target].parent = newParent;
+    p_ast(p, target)->parent = newParent;
 }
 
 static errc p_create_index_list(struct s_parser* p, i32* stackStart, i32* stackEnd, struct anode_list_alloc* newList)
@@ -182,7 +196,7 @@ errc p_print_node(struct s_parser* p, struct anode* n, const char* pointerColor)
     {
         printf("index: %" PRId32 " (%s) parent: %" PRId32" (%s)\n", 
                 n->index, node_id_to_string(n->typeTag),
-                n->parent, node_id_to_string(p->ast[n->parent].typeTag));
+                n->parent, node_id_to_string(p_ast(p, n->parent)->typeTag));
     }
     else 
     {
@@ -213,15 +227,15 @@ errc p_print_node(struct s_parser* p, struct anode* n, const char* pointerColor)
 
 static errc parser_new_node(struct s_parser* p, struct anode** newNode)
 {
-    if(p->ast_len == p->ast_cap)
+    u32 index;
+    halc_try(pool_alloc_indexed(&p->ast, (void**) newNode, &index));
+    if(index == 0)
     {
-        u32 newSize = HALC_MAX(p->ast_cap * 2, 16);
-        hrealloc(&p->ast, p->ast_cap * sizeof(struct anode), newSize * sizeof(struct anode), FALSE);
-        p->ast_cap = newSize;
+        p->astFirst = *newNode;
+        p->astFirstCap = p->ast.slabCapacity;
     }
 
-    *newNode = p->ast + p->ast_len;
-    (*newNode)->index = p->ast_len;
+    (*newNode)->index = (i32) index;
     (*newNode)->parent = 0;
     (*newNode)->typeTag = ANODE_INVALID;
     p->ast_len += 1;
@@ -236,13 +250,12 @@ static errc parser_push_stack(struct s_parser* p, struct anode* node); // forwar
 
 errc parser_init(struct s_parser* p, const struct tokenStream* ts)
 {
-    p->ast_cap = PARSER_INIT_NODECOUNT;
-    if(p->ast_cap)
-        halloc(&p->ast, p->ast_cap * sizeof(struct anode));
+    // size the slabs so a typical file fits in a single one, every token becomes a node 
+    // plus roughly one reduction per line.
+    halc_try(pool_init(&p->ast, sizeof(struct anode), HALC_MAX(PARSER_INIT_NODECOUNT, ts->len + (ts->len >> 1))));
     p->ast_len = 0;
-
-    p->ast_view_len = 0;
-    p->ast_view = p->ast;
+    p->astFirst = NULL;
+    p->astFirstCap = 0;
 
     p->state = PSTATE_DEFAULT;
 
@@ -277,7 +290,7 @@ errc parser_init(struct s_parser* p, const struct tokenStream* ts)
 void parser_free(struct  s_parser* p)
 {
     hfree(p->stack, sizeof(i32) * p->stackCap);
-    hfree(p->ast, sizeof(struct anode) * p->ast_cap);
+    pool_free(&p->ast);
     aindex_free(&p->list);
 }
 
@@ -373,12 +386,12 @@ static b8 isTagTerminal(i32 tag)
 
 static b8 isNodeTerminal(struct s_parser* p, i32 node)
 {
-    return isTagTerminal(p->ast[node].typeTag);
+    return isTagTerminal(p_ast(p, node)->typeTag);
 }
 
 static i32 p_getTypeTag(struct s_parser* p, i32 node)
 {
-    return p->ast[node].typeTag;
+    return p_ast(p, node)->typeTag;
 }
 
 static errc match_forward_newline(struct s_parser* p, i32* stackStart, i32* stackEnd, b8* didReduce) 
@@ -399,7 +412,7 @@ static errc match_forward_newline(struct s_parser* p, i32* stackStart, i32* stac
 static errc match_reduce_space(struct s_parser* p, i32* stackStart, i32* stackEnd, b8* didReduce)
 {
     *didReduce = FALSE;
-    if(p->ast[stackEnd[-1]].typeTag == SPACE)
+    if(p_ast(p, stackEnd[-1])->typeTag == SPACE)
     {
         pop_stack_discard(p);
         *didReduce = TRUE;
@@ -555,11 +568,7 @@ static errc match_forward_end(struct s_parser* p, i32* stackStart, i32* stackEnd
         halc_end;
     }
 
-    hstr directiveString;
-    const hstr compare = HSTR("end");
-    halc_try(p_getTokenLabelText(p, stackStart[1], &directiveString));
-
-    if (!hstr_match(&directiveString, &compare))
+    if (p_getTokenSymbol(p, stackStart[1]) != HALC_SYM_END)
     {
         halc_end;
     }
@@ -602,11 +611,7 @@ static errc match_forward_goto(struct s_parser* p, i32* stackStart, i32* stackEn
         halc_end;
     }
 
-    hstr directiveString;
-    const hstr compare = HSTR("goto");
-    halc_try(p_getTokenLabelText(p, stackStart[1], &directiveString));
-
-    if (!hstr_match(&directiveString, &compare))
+    if (p_getTokenSymbol(p, stackStart[1]) != HALC_SYM_GOTO)
     {
         halc_end;
     }
@@ -766,7 +771,7 @@ static errc match_forward_directive(struct s_parser* p, i32* stackStart, i32* st
 static errc match_reduce_tab(struct s_parser* p, i32* stackStart, i32* stackEnd, b8* didReduce)
 {
     *didReduce = FALSE;
-    if(p->ast[stackEnd[-1]].typeTag == TAB)
+    if(p_ast(p, stackEnd[-1])->typeTag == TAB)
     {
         pop_stack_discard(p);
         *didReduce = TRUE;
@@ -783,7 +788,7 @@ static errc match_reduce_errors(struct s_parser* p, i32* stackStart, i32* stackE
     i32 len = (i32)(stackEnd - stackStart);
     b8 shouldEvict = FALSE;
 
-    if(p->ast[stackStart[0]].typeTag == ANODE_GRAPH)
+    if(p_ast(p, stackStart[0])->typeTag == ANODE_GRAPH)
     {
         // check if there are errors.
         //
@@ -793,11 +798,11 @@ static errc match_reduce_errors(struct s_parser* p, i32* stackStart, i32* stackE
         {
             // find start of terminal list.
             i32* terminalStart = stackStart;
-            if(p->ast[stackStart[0]].typeTag == L_SQBRACK && p->ast[stackStart[1]].typeTag != LABEL)
+            if(p_ast(p, stackStart[0])->typeTag == L_SQBRACK && p_ast(p, stackStart[1])->typeTag != LABEL)
             {
                 if(!gParserRunNoPrint)
-                    fprintf(stderr, RED("Unexpected token %s after "), node_id_to_string(p->ast[stackStart[1]].typeTag));
-                ts_print_token(p->ts, p->ast[stackStart[1]].nodeData.token, FALSE, RED_S);
+                    fprintf(stderr, RED("Unexpected token %s after "), node_id_to_string(p_ast(p, stackStart[1])->typeTag));
+                ts_print_token(p->ts, p_ast(p, stackStart[1])->nodeData.token, FALSE, RED_S);
                 shouldEvict = TRUE;
             }
         }
@@ -808,7 +813,7 @@ static errc match_reduce_errors(struct s_parser* p, i32* stackStart, i32* stackE
             i32 newLineCount = 0;
             for(int i = 0; i < len; i+=1)
             {
-                if(p->ast[stackStart[i]].typeTag == NEWLINE)
+                if(p_ast(p, stackStart[i])->typeTag == NEWLINE)
                 {
                     newLineCount += 1;
                 }
@@ -816,7 +821,7 @@ static errc match_reduce_errors(struct s_parser* p, i32* stackStart, i32* stackE
                 {
                     if(!gParserRunNoPrint)
                     {
-                        p_print_node(p, &p->ast[stackStart[i - 1]], GREEN_S);
+                        p_print_node(p, p_ast(p, stackStart[i - 1]), GREEN_S);
                         fprintf(stderr, RED("Unable to parse line after reaching end of line\n")); // another stray thought. logging should really be something that we give hooks for the end user code to call into.
                     }
                     shouldEvict = TRUE;
@@ -835,12 +840,12 @@ static errc match_reduce_errors(struct s_parser* p, i32* stackStart, i32* stackE
             // its better to not use halc_raise() here.
             
             i32 currentStackEnd = stackEnd[-1];
-            while(p->ast[p->stack[p->stackCount-1]].typeTag <= COMMENT)
+            while(p_ast(p, p->stack[p->stackCount-1])->typeTag <= COMMENT)
             {
                 pop_stack_discard(p);
             }
 
-            halc_try(parser_push_stack(p, &p->ast[currentStackEnd]));
+            halc_try(parser_push_stack(p, p_ast(p, currentStackEnd)));
 
             *didReduce = TRUE;
         }
@@ -894,36 +899,36 @@ static errc match_reduce_segment_label(struct s_parser* p, i32* stackStart, i32*
     //
     // @if([my_butt])\n
     //
-    if(p->ast[stackStart[len - 1]].typeTag == NEWLINE &&
-       p->ast[stackStart[0]].typeTag == L_SQBRACK && 
-       p->ast[stackStart[1]].typeTag == LABEL && 
-       p->ast[stackStart[2]].typeTag == R_SQBRACK
+    if(p_ast(p, stackStart[len - 1])->typeTag == NEWLINE &&
+       p_ast(p, stackStart[0])->typeTag == L_SQBRACK && 
+       p_ast(p, stackStart[1])->typeTag == LABEL && 
+       p_ast(p, stackStart[2])->typeTag == R_SQBRACK
     )
     {
         struct anode* label;
         halc_try(parser_new_node(p, &label));
 
-        p->ast[stackStart[0]].parent = label->index;
-        p->ast[stackStart[1]].parent = label->index;
-        p->ast[stackStart[2]].parent = label->index;
+        p_ast(p, stackStart[0])->parent = label->index;
+        p_ast(p, stackStart[1])->parent = label->index;
+        p_ast(p, stackStart[2])->parent = label->index;
 
         label->typeTag = ANODE_SEGMENT_LABEL;
-        label->nodeData.label.label = p->ast[stackStart[1]].nodeData.token;
+        label->nodeData.label.label = p_ast(p, stackStart[1])->nodeData.token;
         label->nodeData.label.tabCount =  p->tabCount;
 
         if(len > 4)
         {
-            if(p->ast[stackStart[3]].typeTag != COMMENT)
+            if(p_ast(p, stackStart[3])->typeTag != COMMENT)
             {
                 fprintf(stderr, RED("Unexpected token when matching a segment, expected a comment or a newline\nIssue with token:\n"));
-                if(p->ast[stackStart[3]].typeTag <= COMMENT)
+                if(p_ast(p, stackStart[3])->typeTag <= COMMENT)
                 {
-                    ts_print_token(p->ts, p->ast[stackStart[3]].nodeData.token, FALSE, RED_S);
+                    ts_print_token(p->ts, p_ast(p, stackStart[3])->nodeData.token, FALSE, RED_S);
                 }
                 
                 halc_raise(ERR_UNEXPECTED_TOKEN);
             }
-            label->nodeData.label.comment = p->ast[stackStart[3]].nodeData.token;
+            label->nodeData.label.comment = p_ast(p, stackStart[3])->nodeData.token;
         }
         else {
             label->nodeData.label.comment = -1;
@@ -1007,15 +1012,19 @@ static errc parser_reduce(struct s_parser* p)
         continueReducing = FALSE;
         stackEnd =  p->stack + p->stackCount;
         stackStart = stackEnd - 1;
+
+        // space and tab reductions only ever look at the top of the stack, 
+        // so there is no need to retry them at every position of the scan below.
+        PARSER_MATCH_REDUCE(match_reduce_space(p, stackStart, stackEnd, &didReduce))
+        PARSER_MATCH_REDUCE(match_reduce_tab(p, stackStart, stackEnd, &didReduce))
+
         while(stackStart >= p->stack)
         {
             // printf("stackCount %ld \n", stackEnd - stackStart);
             // if anything gets popped from the stack, restart reduction
 
             PARSER_MATCH_REDUCE(match_reduce_segment_label(p, stackStart, stackEnd, &didReduce))
-            PARSER_MATCH_REDUCE(match_reduce_space(p, stackStart, stackEnd, &didReduce))
             PARSER_MATCH_REDUCE(match_reduce_errors(p, stackStart, stackEnd, &didReduce))
-            PARSER_MATCH_REDUCE(match_reduce_tab(p, stackStart, stackEnd, &didReduce))
 
             stackStart -= 1;
         }
@@ -1081,9 +1090,7 @@ errc graph_init(struct s_graph* graph)
     graph->stringsLen = 0;
     graph->stringsCap = defaultSize;
 
-    halloc(&graph->nodes, sizeof(struct s_node) * defaultSize);
-    graph->nodesLen = 0;
-    graph->nodesCap = defaultSize;
+    halc_try(pool_init(&graph->nodes, sizeof(struct s_node), 0));
 
     halc_end;
 }
@@ -1096,7 +1103,7 @@ void graph_free(struct s_graph* graph)
     }
 
     hfree(graph->strings, graph->stringsCap * sizeof(hstr));
-    hfree(graph->nodes, graph->nodesCap * sizeof(struct s_node));
+    pool_free(&graph->nodes);
 }
 
 errc parse_tokens(struct s_graph* graph, const struct tokenStream* ts)
@@ -1139,15 +1146,9 @@ errc label_map_insert(struct s_label_map* map, s_link link)
 
 errc graph_append(struct s_graph* graph, struct s_node newNode)
 {
-    if (graph->nodesLen == graph->nodesCap)
-    {
-        u32 newCap = graph->nodesCap * 2;
-        hrealloc(&graph->nodes, graph->nodesCap, newCap, FALSE);
-        graph->nodesCap = newCap;
-    }
-
-    graph->nodes[graph->nodesLen] = newNode;
-    graph->nodesLen += 1;
+    struct s_node* node;
+    halc_try(pool_alloc_indexed(&graph->nodes, (void**) &node, NULL));
+    *node = newNode;
 
     halc_end;
 }
@@ -1157,7 +1158,7 @@ errc graph_clone_string(struct s_graph* graph, const hstr* string, hstr** out)
     if (graph->stringsLen == graph->stringsCap)
     {
         u32 newCap = graph->stringsCap * 2;
-        hrealloc(&graph->strings, graph->stringsCap, newCap, FALSE);
+        hrealloc(&graph->strings, graph->stringsCap * sizeof(hstr), newCap * sizeof(hstr), FALSE);
         graph->stringsCap = newCap;
     }
     
@@ -1173,10 +1174,10 @@ errc graph_clone_string(struct s_graph* graph, const hstr* string, hstr** out)
 
 struct s_node* find_node_from_link(struct s_graph* graph, u32 link)
 {
-    if (link > graph->nodesLen)
+    if (link >= graph->nodes.len)
     {
         return NULL;
     }
 
-    return graph->nodes + link;
+    return (struct s_node*) pool_at(&graph->nodes, link);
 }
@@ -41,10 +41,8 @@ struct s_graph
     u32 stringsLen;
     u32 stringsCap;
 
-    // fully linked story nodes
-    struct s_node* nodes;
-    u32 nodesLen;
-    u32 nodesCap;
+    // fully linked story nodes, pool slots are indexed by s_link
+    struct pool nodes;
 
     // oh god... I have to make a hashmap
     struct s_label_map labels;
@@ -217,15 +215,14 @@ struct anode
 
 struct s_parser
 {
-    struct anode* ast; // container for all ast nodes;
-    u32 ast_cap;
+    struct pool ast; // container for all ast nodes, indexed by anode.index
     u32 ast_len;
 
-    struct aindex_list list; // container for all indexes
+    // first slab of the ast pool, cached for the fast path in node lookups
+    struct anode* astFirst;
+    u32 astFirstCap;
 
-    // ast view
-    struct anode* ast_view;
-    u32 ast_view_len;
+    struct aindex_list list; // container for all indexes
 
     i32 state;
 
@@ -0,0 +1,446 @@
+#include "halc_region.h"
+#include "halc_allocators.h"
+#include "halc_files.h"
+#include "halc_threads.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <inttypes.h>
+
+#define REGION_PATHS_INITIAL_CAP 64
+
+struct region_path_list {
+    hstr* paths;
+    u32 len;
+    u32 cap;
+};
+
+static errc path_list_push(struct region_path_list* list, const hstr* path)
+{
+    if(list->len == list->cap)
+    {
+        u32 newCap = list->cap ? list->cap * 2 : REGION_PATHS_INITIAL_CAP;
+        if(list->cap)
+        {
+            hrealloc(&list->paths, list->cap * sizeof(hstr), newCap * sizeof(hstr), FALSE);
+        }
+        else
+        {
+            halloc(&list->paths, newCap * sizeof(hstr));
+        }
+        list->cap = newCap;
+    }
+
+    halc_try(hstr_dupe(path, &list->paths[list->len]));
+    list->len += 1;
+
+    halc_end;
+}
+
+static void path_list_free(struct region_path_list* list)
+{
+    for(u32 i = 0; i < list->len; i += 1)
+    {
+        hstr_free(&list->paths[i]);
+    }
+
+    if(list->cap)
+    {
+        hfree(list->paths, list->cap * sizeof(hstr));
+    }
+    list->paths = NULL;
+    list->len = 0;
+    list->cap = 0;
+}
+
+static errc region_walk_entry(void* ctx, const hstr* path, const struct dir_entry_info* info)
+{
+    if(!info->isDirectory && is_halc_path(path))
+    {
+        halc_try(path_list_push((struct region_path_list*) ctx, path));
+    }
+    halc_end;
+}
+
+static int compare_paths(const void* left, const void* right)
+{
+    return strcmp(((const hstr*) left)->buffer, ((const hstr*) right)->buffer);
+}
+
+static int compare_region_files(const void* left, const void* right)
+{
+    return strcmp(((const struct region_file*) left)->path.buffer, ((const struct region_file*) right)->path.buffer);
+}
+
+// files are handed to the workers in batches so their io can go out together
+#define REGION_BATCH_MAX_FILES 128
+
+struct region_batch {
+    struct region* region;
+    struct compile_cache* cache;
+    u32 first;
+};
+
+// compiles a file that's in memory, everything it touches belongs to this one file
+static void region_file_compile_source(struct region_file* file, errc loadResult, hstr* contents, struct compile_cache* cache, struct symbol_table* symbols)
+{
+    file->result = loadResult;
+    file->cached = FALSE;
+    if(loadResult == ERR_OK)
+    {
+        file->source = *contents;
+        if(cache)
+        {
+            file->result = compile_cached(cache, &file->ts, &file->source, &file->path, symbols, &file->cached);
+        }
+        else
+        {
+            file->result = tokenize_raw(&file->ts, &file->source, &file->path, symbols);
+        }
+
+        if(file->result != ERR_OK)
+        {
+            hstr_free(&file->source);
+        }
+    }
+
+    halc_end_ok;
+}
+
+// runs on the workers as each file lands
+static void region_file_loaded(void* ctx, u32 index, errc result, hstr* contents)
+{
+    struct region_batch* batch = (struct region_batch*) ctx;
+    region_file_compile_source(&batch->region->files[batch->first + index], result, contents, batch->cache, NULL);
+}
+
+errc region_file_compile(struct region_file* file, struct compile_cache* cache, struct symbol_table* symbols)
+{
+    hstr contents;
+    hstr_init(&contents);
+    errc result = load_file(&contents, &file->path);
+    halc_end_ok;
+
+    region_file_compile_source(file, result, &contents, cache, symbols);
+    return file->result;
+}
+
+void region_file_free(struct region_file* file)
+{
+    if(file->result == ERR_OK)
+    {
+        ts_free(&file->ts);
+        hstr_free(&file->source);
+    }
+    hstr_free(&file->path);
+}
+
+struct region_symbols_job {
+    struct region* region;
+    u32* remap;     // each file's ids to the shared ones, back to back
+    u32* offsets;   // where each file's ids start in remap
+};
+
+static void region_remap_file(void* ctx, u32 index)
+{
+    struct region_symbols_job* job = (struct region_symbols_job*) ctx;
+    struct region_file* file = &job->region->files[index];
+    if(file->result != ERR_OK || !file->ts.ownsSymbols)
+    {
+        return;
+    }
+
+    const u32* remap = job->remap + job->offsets[index];
+    for(i32 i = 0; i < file->ts.len; i += 1)
+    {
+        file->ts.tokens[i].symbol = remap[file->ts.tokens[i].symbol];
+    }
+
+    symbol_table_free(file->ts.symbols);
+    hfree(file->ts.symbols, sizeof(struct symbol_table));
+    file->ts.symbols = job->region->symbols;
+    file->ts.ownsSymbols = FALSE;
+}
+
+// merges every file's table into the region's. Only the distinct labels are interned,
+// one file at a time in path order, then the workers renumber the tokens.
+static errc region_share_symbols(struct region* region, u32 workerCount)
+{
+    struct region_symbols_job job = {region, NULL, NULL};
+    u32 remapLen = 0;
+
+    halloc(&region->symbols, sizeof(struct symbol_table));
+    halc_tryCleanup(symbol_table_init(region->symbols));
+
+    if(region->fileCount)
+    {
+        halloc_cleanup(&job.offsets, region->fileCount * sizeof(u32));
+    }
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        const struct region_file* file = &region->files[i];
+        job.offsets[i] = remapLen;
+        if(file->result == ERR_OK && file->ts.ownsSymbols)
+        {
+            remapLen += file->ts.symbols->len;
+        }
+    }
+
+    if(remapLen)
+    {
+        halloc_cleanup(&job.remap, remapLen * sizeof(u32));
+    }
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        const struct region_file* file = &region->files[i];
+        if(file->result != ERR_OK || !file->ts.ownsSymbols)
+        {
+            continue;
+        }
+
+        u32* remap = job.remap + job.offsets[i];
+        remap[HALC_SYM_NONE] = HALC_SYM_NONE;
+        for(u32 symbol = HALC_SYM_NONE + 1; symbol < file->ts.symbols->len; symbol += 1)
+        {
+            hstr name;
+            symbol_get_string(file->ts.symbols, symbol, &name);
+            halc_tryCleanup(symbol_intern(region->symbols, &name, &remap[symbol]));
+        }
+    }
+
+    halc_tryCleanup(halc_parallel_for(region->fileCount, workerCount, region_remap_file, &job));
+
+    // the table itself is left to region_free either way
+cleanup:
+    if(job.offsets)
+    {
+        hfree(job.offsets, region->fileCount * sizeof(u32));
+    }
+    if(job.remap)
+    {
+        hfree(job.remap, remapLen * sizeof(u32));
+    }
+    halc_end;
+}
+
+static u32 region_batch_size(const struct region* region, u32 workerCount)
+{
+    // small enough that every worker gets a few batches to balance with
+    u32 size = region->fileCount / (workerCount * 4);
+    if(size > REGION_BATCH_MAX_FILES)
+    {
+        size = REGION_BATCH_MAX_FILES;
+    }
+    return size ? size : 1;
+}
+
+// aggregates over every file once they've all been compiled
+static void region_total(struct region* region)
+{
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        struct region_file* file = &region->files[i];
+        if(file->result != ERR_OK)
+        {
+            region->failedCount += 1;
+            continue;
+        }
+        region->cachedCount += file->cached ? 1 : 0;
+        region->byteCount += file->source.len;
+        region->tokenCount += (u64) file->ts.len;
+    }
+}
+
+struct region_load_job {
+    struct region* region;
+    struct compile_cache* cache;
+    u32 batchSize;
+};
+
+static void region_load_batch(void* ctx, u32 index)
+{
+    struct region_load_job* job = (struct region_load_job*) ctx;
+    struct region_batch batch = {job->region, job->cache, index * job->batchSize};
+
+    u32 count = job->region->fileCount - batch.first;
+    if(count > job->batchSize)
+    {
+        count = job->batchSize;
+    }
+
+    // paths are contiguous in the file array, gather them for the batch
+    hstr paths[REGION_BATCH_MAX_FILES];
+    for(u32 i = 0; i < count; i += 1)
+    {
+        paths[i] = job->region->files[batch.first + i].path;
+    }
+
+    // every file gets its own result, there's nothing left to report for the batch
+    load_file_batch(paths, count, region_file_loaded, &batch);
+    halc_end_ok;
+}
+
+errc region_load(struct region* region, const hstr* rootPath, u32 workerCount)
+{
+    return region_load_cached(region, rootPath, workerCount, NULL);
+}
+
+errc region_load_cached(struct region* region, const hstr* rootPath, u32 workerCount, struct compile_cache* cache)
+{
+    struct region_path_list list = {NULL, 0, 0};
+    memset(region, 0, sizeof(*region));
+
+    halc_tryCleanup(copy_root_path(&region->root, rootPath));
+
+    halc_tryCleanup(walk_directory(&region->root, region_walk_entry, &list));
+
+    qsort(list.paths, list.len, sizeof(hstr), compare_paths);
+
+    if(list.len)
+    {
+        halloc_cleanup(&region->files, list.len * sizeof(struct region_file));
+        memset(region->files, 0, list.len * sizeof(struct region_file));
+        for(u32 i = 0; i < list.len; i += 1)
+        {
+            region->files[i].path = list.paths[i];
+        }
+
+        // the paths belong to the files now
+        region->fileCount = list.len;
+        list.len = 0;
+    }
+
+    if(workerCount == 0)
+    {
+        workerCount = halc_cpu_count();
+    }
+
+    {
+        struct region_load_job job = {region, cache, region_batch_size(region, workerCount)};
+        u32 batchCount = (region->fileCount + job.batchSize - 1) / job.batchSize;
+        halc_tryCleanup(halc_parallel_for(batchCount, workerCount, region_load_batch, &job));
+    }
+
+    halc_tryCleanup(region_share_symbols(region, workerCount));
+    region_total(region);
+    path_list_free(&list);
+    halc_end;
+
+cleanup:
+    path_list_free(&list);
+    region_free(region);
+    halc_end;
+}
+
+struct region_pack_job {
+    struct region* region;
+    const struct pack* pack;
+    struct compile_cache* cache;
+};
+
+// the file's contents are a view into the pack, nothing is loaded or copied
+static void region_pack_compile(void* ctx, u32 index)
+{
+    struct region_pack_job* job = (struct region_pack_job*) ctx;
+    struct region_file* file = &job->region->files[index];
+    u32 rootLen = job->region->root.len + 1;
+    hstr relative = {file->path.buffer + rootLen, file->path.len - rootLen, -1};
+    hstr contents;
+    struct utf8_error utf8Error;
+
+    // the paths came from the pack, they're always found. A pack isn't checked 
+    // for utf8 when it's opened, so it's checked here the way load_file would
+    pack_find(job->pack, &relative, &contents);
+    errc result = hstr_validate_utf8(&contents, &utf8Error);
+    region_file_compile_source(file, result, &contents, job->cache, NULL);
+}
+
+errc region_load_pack(struct region* region, const struct pack* pack, const hstr* packPath, u32 workerCount, struct compile_cache* cache)
+{
+    const hstr separator = HSTR("/");
+    memset(region, 0, sizeof(*region));
+
+    halc_tryCleanup(hstr_append(&region->root, packPath));
+
+    if(pack->entryCount)
+    {
+        halloc_cleanup(&region->files, pack->entryCount * sizeof(struct region_file));
+        memset(region->files, 0, pack->entryCount * sizeof(struct region_file));
+        region->fileCount = pack->entryCount;
+    }
+
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        hstr path;
+        pack_entry_path(pack, i, &path);
+        halc_tryCleanup(hstr_append(&region->files[i].path, &region->root));
+        halc_tryCleanup(hstr_append(&region->files[i].path, &separator));
+        halc_tryCleanup(hstr_append(&region->files[i].path, &path));
+    }
+
+    // the pack is in hash order, a region is in path order
+    if(region->fileCount > 1)
+    {
+        qsort(region->files, region->fileCount, sizeof(struct region_file), compare_region_files);
+    }
+
+    if(workerCount == 0)
+    {
+        workerCount = halc_cpu_count();
+    }
+
+    {
+        struct region_pack_job job = {region, pack, cache};
+        halc_tryCleanup(halc_parallel_for(region->fileCount, workerCount, region_pack_compile, &job));
+    }
+
+    halc_tryCleanup(region_share_symbols(region, workerCount));
+    region_total(region);
+    halc_end;
+
+cleanup:
+    region_free(region);
+    halc_end;
+}
+
+void region_print_diagnostics(const struct region* region)
+{
+    fprintf(stderr, "region %s: %u files, %u failed, %u cached, %" PRIu64 " bytes, %" PRIu64 " tokens\n", 
+        region->root.buffer, region->fileCount, region->failedCount, region->cachedCount, 
+        (u64) region->byteCount, (u64) region->tokenCount);
+
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        const struct region_file* file = &region->files[i];
+        if(file->result != ERR_OK)
+        {
+            fprintf(stderr, "  " RED("%s") ": %s (%d)\n", file->path.buffer, errc_to_string(file->result), file->result);
+        }
+    }
+}
+
+void region_free(struct region* region)
+{
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        region_file_free(&region->files[i]);
+    }
+
+    if(region->files)
+    {
+        hfree(region->files, region->fileCount * sizeof(struct region_file));
+        region->files = NULL;
+    }
+    region->fileCount = 0;
+
+    // after the files, their streams point into it
+    if(region->symbols)
+    {
+        symbol_table_free(region->symbols);
+        hfree(region->symbols, sizeof(struct symbol_table));
+        region->symbols = NULL;
+    }
+
+    hstr_free(&region->root);
+}
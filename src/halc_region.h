@@ -0,0 +1,86 @@
+#ifndef _HALC_REGION_H_
+#define _HALC_REGION_H_
+
+#include "halc_types.h"
+#include "halc_errors.h"
+#include "halc_strings.h"
+#include "halc_tokenizer.h"
+#include "halc_cache.h"
+#include "halc_pack.h"
+
+EXTERN_C_BEGIN
+
+// ==================== Region Loader ======================
+//
+// a region is a directory tree of .halc files (characters, events, quests and a 
+// region.halc). region_load finds every .halc file under the root, then loads and 
+// tokenizes them across a pool of worker threads. Each worker loads its files in
+// batches with load_file_batch and tokenizes every file the moment it lands.
+//
+// files are tokenized with tokenize_raw so normalizing happens inline. The workers
+// can't share a symbol table, so each stream interns into one of its own. Once every
+// file is in, their labels are merged into region.symbols and the tokens renumbered,
+// so a label has the same id in every file of the region. Files are sorted by path,
+// so neither the order nor the ids depend on the file system or the threads.
+//
+// a file failing doesn't stop the others, its result says what went wrong and 
+// region_print_diagnostics lists every failure at once.
+//
+// eg.
+//
+//  struct region region;
+//  halc_try(region_load(&region, &rootPath, 0));
+//  if(region.failedCount) region_print_diagnostics(&region);
+//  for(u32 i = 0; i < region.fileCount; i += 1) ... region.files[i].ts ...
+//  region_free(&region);
+//
+
+struct region_file {
+    hstr path;              // root joined with the path below it, null terminated
+    hstr source;            // the file as loaded, token views point into it
+    struct tokenStream ts;  // only valid when result is ERR_OK
+    errc result;
+    b8 cached;              // the tokens came from the compile cache
+};
+
+struct region {
+    hstr root;
+    struct region_file* files;
+    u32 fileCount;
+    struct symbol_table* symbols; // shared by every file that loaded
+
+    // aggregated over every file
+    u32 failedCount;
+    u32 cachedCount;
+    u64 byteCount;
+    u64 tokenCount;
+};
+
+// workerCount 0 means one per cpu. Only fails if the directory tree can't be walked,
+// region_free has to be called whenever it succeeds.
+errc region_load(struct region* region, const hstr* rootPath, u32 workerCount);
+
+// same as region_load, but files compile through the cache (see compile_cached), so 
+// only the ones that changed since the last load get tokenized and parsed. A file 
+// that doesn't parse fails here even though region_load would have tokenized it.
+errc region_load_cached(struct region* region, const hstr* rootPath, u32 workerCount, struct compile_cache* cache);
+
+// loads a region out of a pack (see pack_write), the root is packPath and each file's
+// path is the one it has in the pack joined to it. Sources are views into the pack,
+// so the pack has to stay open until region_free. cache can be NULL.
+errc region_load_pack(struct region* region, const struct pack* pack, const hstr* packPath, u32 workerCount, struct compile_cache* cache);
+
+// loads and compiles a single file the way region_load does, file->path has to be set.
+// For recompiling one file that changed, the result is also left in file->result.
+// symbols can be NULL to give the stream a table of its own, cache can be NULL.
+errc region_file_compile(struct region_file* file, struct compile_cache* cache, struct symbol_table* symbols);
+void region_file_free(struct region_file* file);
+
+// a summary line and every failed file with its error
+void region_print_diagnostics(const struct region* region);
+
+void region_free(struct region* region);
+
+EXTERN_C_END
+
+#endif
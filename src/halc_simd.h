@@ -0,0 +1,172 @@
+#ifndef _HALC_SIMD_H_
+#define _HALC_SIMD_H_
+
+#include "halc_types.h"
+
+// ==================== SIMD helpers ======================
+//
+// byte compare primitives for the string and tokenizer hot loops. The instruction set
+// is picked at compile time:
+//
+// - AVX2 when the compiler targets it (eg. -mavx2 or HALC_NATIVE in cmake), 32 bytes per step
+// - SSE2 on every other x86_64 build, 16 bytes per step
+// - NEON on arm64, 16 bytes per step
+// - a scalar fallback everywhere else, or when HALC_NO_SIMD is defined
+//
+// every helper looks at exactly HALC_SIMD_WIDTH bytes and returns a bitmask with 
+// bit i set for byte i, so callers can walk the hits with halc_ctz32. Loads are 
+// unaligned, callers make sure HALC_SIMD_WIDTH bytes are readable.
+
+#if !defined(HALC_NO_SIMD) && defined(__AVX2__)
+#define HALC_SIMD_AVX2 1
+#include <immintrin.h>
+#elif !defined(HALC_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define HALC_SIMD_SSE2 1
+#include <emmintrin.h>
+#elif !defined(HALC_NO_SIMD) && (defined(__ARM_NEON) || defined(_M_ARM64))
+#define HALC_SIMD_NEON 1
+#include <arm_neon.h>
+#else
+#define HALC_SIMD_SCALAR 1
+#endif
+
+#if defined(HALC_SIMD_AVX2)
+#define HALC_SIMD_WIDTH 32
+#else
+#define HALC_SIMD_WIDTH 16
+#endif
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+// index of the lowest set bit, value must not be 0
+static inline u32 halc_ctz32(u32 value)
+{
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, value);
+    return (u32) index;
+#else
+    return (u32) __builtin_ctz(value);
+#endif
+}
+
+#if defined(HALC_SIMD_NEON)
+// neon has no movemask, weigh each lane with its bit and add the halves up
+static inline u32 halc_simd_neon_movemask(uint8x16_t lanes)
+{
+    static const u8 weights[16] = {1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t bits = vandq_u8(lanes, vld1q_u8(weights));
+    u32 low = vaddv_u8(vget_low_u8(bits));
+    u32 high = vaddv_u8(vget_high_u8(bits));
+    return low | (high << 8);
+}
+#endif
+
+// bit i is set when p[i] == c
+static inline u32 halc_simd_eq_mask(const char* p, char c)
+{
+#if defined(HALC_SIMD_AVX2)
+    __m256i bytes = _mm256_loadu_si256((const __m256i*) p);
+    return (u32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(bytes, _mm256_set1_epi8(c)));
+#elif defined(HALC_SIMD_SSE2)
+    __m128i bytes = _mm_loadu_si128((const __m128i*) p);
+    return (u32) _mm_movemask_epi8(_mm_cmpeq_epi8(bytes, _mm_set1_epi8(c)));
+#elif defined(HALC_SIMD_NEON)
+    uint8x16_t bytes = vld1q_u8((const u8*) p);
+    return halc_simd_neon_movemask(vceqq_u8(bytes, vdupq_n_u8((u8) c)));
+#else
+    u32 mask = 0;
+    for(u32 i = 0; i < HALC_SIMD_WIDTH; i += 1)
+    {
+        mask |= (u32)(p[i] == c) << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i is set when a[i] != b[i]
+static inline u32 halc_simd_neq_mask(const char* a, const char* b)
+{
+#if defined(HALC_SIMD_AVX2)
+    __m256i left = _mm256_loadu_si256((const __m256i*) a);
+    __m256i right = _mm256_loadu_si256((const __m256i*) b);
+    return ~(u32) _mm256_movemask_epi8(_mm256_cmpeq_epi8(left, right));
+#elif defined(HALC_SIMD_SSE2)
+    __m128i left = _mm_loadu_si128((const __m128i*) a);
+    __m128i right = _mm_loadu_si128((const __m128i*) b);
+    return ~(u32) _mm_movemask_epi8(_mm_cmpeq_epi8(left, right)) & 0xffff;
+#elif defined(HALC_SIMD_NEON)
+    uint8x16_t left = vld1q_u8((const u8*) a);
+    uint8x16_t right = vld1q_u8((const u8*) b);
+    return ~halc_simd_neon_movemask(vceqq_u8(left, right)) & 0xffff;
+#else
+    u32 mask = 0;
+    for(u32 i = 0; i < HALC_SIMD_WIDTH; i += 1)
+    {
+        mask |= (u32)(a[i] != b[i]) << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i is set when p[i] has its high bit set, ie. it's not ascii
+static inline u32 halc_simd_high_mask(const char* p)
+{
+#if defined(HALC_SIMD_AVX2)
+    return (u32) _mm256_movemask_epi8(_mm256_loadu_si256((const __m256i*) p));
+#elif defined(HALC_SIMD_SSE2)
+    return (u32) _mm_movemask_epi8(_mm_loadu_si128((const __m128i*) p));
+#elif defined(HALC_SIMD_NEON)
+    uint8x16_t bytes = vld1q_u8((const u8*) p);
+    return halc_simd_neon_movemask(vtstq_u8(bytes, vdupq_n_u8(0x80)));
+#else
+    u32 mask = 0;
+    for(u32 i = 0; i < HALC_SIMD_WIDTH; i += 1)
+    {
+        mask |= (u32)(((u8) p[i]) >> 7) << i;
+    }
+    return mask;
+#endif
+}
+
+// bit i is set when p[i] can be part of a label, ie. a-z, A-Z, 0-9 or _
+static inline u32 halc_simd_label_mask(const char* p)
+{
+#if defined(HALC_SIMD_AVX2)
+    __m256i bytes = _mm256_loadu_si256((const __m256i*) p);
+    // setting 0x20 folds upper case onto lower case. Bytes past ascii are negative 
+    // as signed, so they never land in a range
+    __m256i lower = _mm256_or_si256(bytes, _mm256_set1_epi8(0x20));
+    __m256i alpha = _mm256_and_si256(_mm256_cmpgt_epi8(lower, _mm256_set1_epi8('a' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('z' + 1), lower));
+    __m256i digit = _mm256_and_si256(_mm256_cmpgt_epi8(bytes, _mm256_set1_epi8('0' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('9' + 1), bytes));
+    __m256i under = _mm256_cmpeq_epi8(bytes, _mm256_set1_epi8('_'));
+    return (u32) _mm256_movemask_epi8(_mm256_or_si256(_mm256_or_si256(alpha, digit), under));
+#elif defined(HALC_SIMD_SSE2)
+    __m128i bytes = _mm_loadu_si128((const __m128i*) p);
+    __m128i lower = _mm_or_si128(bytes, _mm_set1_epi8(0x20));
+    __m128i alpha = _mm_and_si128(_mm_cmpgt_epi8(lower, _mm_set1_epi8('a' - 1)), _mm_cmplt_epi8(lower, _mm_set1_epi8('z' + 1)));
+    __m128i digit = _mm_and_si128(_mm_cmpgt_epi8(bytes, _mm_set1_epi8('0' - 1)), _mm_cmplt_epi8(bytes, _mm_set1_epi8('9' + 1)));
+    __m128i under = _mm_cmpeq_epi8(bytes, _mm_set1_epi8('_'));
+    return (u32) _mm_movemask_epi8(_mm_or_si128(_mm_or_si128(alpha, digit), under));
+#elif defined(HALC_SIMD_NEON)
+    uint8x16_t bytes = vld1q_u8((const u8*) p);
+    uint8x16_t lower = vorrq_u8(bytes, vdupq_n_u8(0x20));
+    uint8x16_t alpha = vandq_u8(vcgeq_u8(lower, vdupq_n_u8('a')), vcleq_u8(lower, vdupq_n_u8('z')));
+    uint8x16_t digit = vandq_u8(vcgeq_u8(bytes, vdupq_n_u8('0')), vcleq_u8(bytes, vdupq_n_u8('9')));
+    uint8x16_t under = vceqq_u8(bytes, vdupq_n_u8('_'));
+    return halc_simd_neon_movemask(vorrq_u8(vorrq_u8(alpha, digit), under));
+#else
+    u32 mask = 0;
+    for(u32 i = 0; i < HALC_SIMD_WIDTH; i += 1)
+    {
+        char c = p[i];
+        b8 isLabel = (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '_';
+        mask |= (u32) isLabel << i;
+    }
+    return mask;
+#endif
+}
+
+#endif
@@ -0,0 +1,497 @@
+#include "halc_story.h"
+#include "halc_allocators.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define STORY_INITIAL_CAP 16
+
+static int compare_story_files(const void* left, const void* right)
+{
+    const struct story_file* a = *(const struct story_file* const*) left;
+    const struct story_file* b = *(const struct story_file* const*) right;
+    return strcmp(a->file.path.buffer, b->file.path.buffer);
+}
+
+// TRUE if path is the changed path itself or somewhere below it
+static b8 path_is_under(const hstr* path, const hstr* changed)
+{
+    if(path->len < changed->len || memcmp(path->buffer, changed->buffer, changed->len) != 0)
+    {
+        return FALSE;
+    }
+    return path->len == changed->len || path->buffer[changed->len] == '/';
+}
+
+static errc story_version_new(struct story_version** out, u32 fileCap)
+{
+    struct story_version* version;
+    halloc(&version, sizeof(struct story_version));
+    memset(version, 0, sizeof(*version));
+
+    if(fileCap)
+    {
+        if(halloc_advanced((void**) &version->files, fileCap * sizeof(struct story_file*), __FILE__, __LINE__, __func__))
+        {
+            hfree(version, sizeof(struct story_version));
+            halc_raise(ERR_OUT_OF_MEMORY);
+        }
+        version->fileCap = fileCap;
+    }
+
+    *out = version;
+    halc_end;
+}
+
+static errc story_version_push(struct story_version* version, struct story_file* file)
+{
+    if(version->fileCount == version->fileCap)
+    {
+        u32 newCap = version->fileCap ? version->fileCap * 2 : STORY_INITIAL_CAP;
+        if(version->fileCap)
+        {
+            hrealloc(&version->files, version->fileCap * sizeof(struct story_file*), newCap * sizeof(struct story_file*), FALSE);
+        }
+        else
+        {
+            halloc(&version->files, newCap * sizeof(struct story_file*));
+        }
+        version->fileCap = newCap;
+    }
+
+    version->files[version->fileCount] = file;
+    version->fileCount += 1;
+    halc_end;
+}
+
+// a copy of table under a single reference, for the version being built
+static errc story_symbols_copy(struct story_symbols** out, const struct symbol_table* table)
+{
+    struct story_symbols* symbols;
+    halloc(&symbols, sizeof(struct story_symbols));
+    symbols->refs = 1;
+    symbols->table = NULL;
+
+    halloc_cleanup(&symbols->table, sizeof(struct symbol_table));
+    halc_tryCleanup(symbol_table_copy(symbols->table, table));
+
+    *out = symbols;
+    halc_end;
+
+cleanup:
+    if(symbols->table)
+    {
+        symbol_table_free(symbols->table);
+        hfree(symbols->table, sizeof(struct symbol_table));
+    }
+    hfree(symbols, sizeof(struct story_symbols));
+    halc_end;
+}
+
+static void story_symbols_release_locked(struct story_symbols* symbols)
+{
+    symbols->refs -= 1;
+    if(symbols->refs == 0)
+    {
+        symbol_table_free(symbols->table);
+        hfree(symbols->table, sizeof(struct symbol_table));
+        hfree(symbols, sizeof(struct story_symbols));
+    }
+}
+
+// drops the version's reference on each of its files, call with the story's lock held
+static void story_version_free(struct story_version* version)
+{
+    for(u32 i = 0; i < version->fileCount; i += 1)
+    {
+        struct story_file* file = version->files[i];
+        file->refs -= 1;
+        if(file->refs == 0)
+        {
+            region_file_free(&file->file);
+            if(file->symbols)
+            {
+                story_symbols_release_locked(file->symbols);
+            }
+            hfree(file, sizeof(struct story_file));
+        }
+    }
+
+    if(version->symbols)
+    {
+        story_symbols_release_locked(version->symbols);
+    }
+
+    if(version->fileCap)
+    {
+        hfree(version->files, version->fileCap * sizeof(struct story_file*));
+    }
+    hfree(version, sizeof(struct story_version));
+}
+
+static void story_version_release_locked(struct story_version* version)
+{
+    version->refs -= 1;
+    if(version->refs == 0)
+    {
+        story_version_free(version);
+    }
+}
+
+// the version replaces the current one, readers holding the old one keep it until they release it
+static void story_publish(struct story* story, struct story_version* version)
+{
+    version->failedCount = 0;
+    for(u32 i = 0; i < version->fileCount; i += 1)
+    {
+        version->failedCount += version->files[i]->file.result != ERR_OK ? 1 : 0;
+    }
+    version->refs = 1;
+
+    halc_mutex_lock(&story->lock);
+    struct story_version* old = story->current;
+    story->versionCount += 1;
+    version->version = story->versionCount;
+    story->current = version;
+    if(old)
+    {
+        story_version_release_locked(old);
+    }
+    halc_mutex_unlock(&story->lock);
+}
+
+errc story_init(struct story* story, struct region* region, struct compile_cache* cache)
+{
+    struct story_version* version = NULL;
+    struct story_symbols* symbols = NULL;
+    u32 fileCount = region->fileCount;
+
+    memset(story, 0, sizeof(*story));
+    story->cache = cache;
+    halc_try(halc_mutex_init(&story->lock));
+    halc_tryCleanup(hstr_dupe(&region->root, &story->root));
+    halc_tryCleanup(story_version_new(&version, fileCount));
+    halloc_cleanup(&symbols, sizeof(struct story_symbols));
+
+    // a region that was never loaded doesn't have a table yet, it stays the region's until the move
+    if(!region->symbols)
+    {
+        halloc_cleanup(&region->symbols, sizeof(struct symbol_table));
+        halc_tryCleanup(symbol_table_init(region->symbols));
+    }
+
+    // allocate everything first, the files only move once nothing else can fail
+    for(u32 i = 0; i < fileCount; i += 1)
+    {
+        halloc_cleanup(&version->files[i], sizeof(struct story_file));
+        version->fileCount += 1;
+    }
+
+    symbols->refs = 1 + fileCount;
+    symbols->table = region->symbols;
+    version->symbols = symbols;
+    for(u32 i = 0; i < fileCount; i += 1)
+    {
+        version->files[i]->refs = 1;
+        version->files[i]->symbols = symbols;
+        version->files[i]->file = region->files[i];
+    }
+
+    if(region->files)
+    {
+        hfree(region->files, fileCount * sizeof(struct region_file));
+        region->files = NULL;
+    }
+    region->fileCount = 0;
+    region->symbols = NULL;
+    region->failedCount = 0;
+    region->cachedCount = 0;
+    region->byteCount = 0;
+    region->tokenCount = 0;
+
+    story_publish(story, version);
+    halc_end;
+
+cleanup:
+    if(version)
+    {
+        for(u32 i = 0; i < version->fileCount; i += 1)
+        {
+            hfree(version->files[i], sizeof(struct story_file));
+        }
+        version->fileCount = 0;
+        story_version_free(version);
+    }
+    if(symbols)
+    {
+        hfree(symbols, sizeof(struct story_symbols));
+    }
+    hstr_free(&story->root);
+    halc_mutex_free(&story->lock);
+    halc_end;
+}
+
+void story_free(struct story* story)
+{
+    if(story->current)
+    {
+        story_version_release_locked(story->current);
+        story->current = NULL;
+    }
+    hstr_free(&story->root);
+    halc_mutex_free(&story->lock);
+}
+
+struct story_version* story_acquire(struct story* story)
+{
+    halc_mutex_lock(&story->lock);
+    struct story_version* version = story->current;
+    version->refs += 1;
+    halc_mutex_unlock(&story->lock);
+    return version;
+}
+
+void story_release(struct story* story, struct story_version* version)
+{
+    halc_mutex_lock(&story->lock);
+    story_version_release_locked(version);
+    halc_mutex_unlock(&story->lock);
+}
+
+// ======================= reloading =================
+
+struct story_reload {
+    struct story* story;
+    struct story_version* next;
+    u32 sharedCount; // files carried over from the current version come first
+};
+
+// compiles a file that's new or changed into the next version
+static errc reload_compile(void* ctx, const hstr* path, const struct dir_entry_info* info)
+{
+    struct story_reload* reload = (struct story_reload*) ctx;
+    struct story_version* next = reload->next;
+    struct story_file* file;
+
+    if(info->isDirectory || !is_halc_path(path))
+    {
+        halc_end;
+    }
+
+    // a file can be reported along with the directory it's in
+    for(u32 i = reload->sharedCount; i < next->fileCount; i += 1)
+    {
+        if(hstr_match(&next->files[i]->file.path, path))
+        {
+            halc_end;
+        }
+    }
+
+    halloc(&file, sizeof(struct story_file));
+    memset(file, 0, sizeof(*file));
+    file->refs = 1;
+    hstr_init(&file->file.path);
+    halc_tryCleanup(hstr_dupe(path, &file->file.path));
+    halc_tryCleanup(story_version_push(next, file));
+    file->symbols = next->symbols;
+    next->symbols->refs += 1;
+
+    // a file that doesn't compile still goes in the version, carrying its error
+    region_file_compile(&file->file, reload->story->cache, next->symbols->table);
+    halc_end_ok;
+
+    next->recompiledCount += 1;
+    halc_end;
+
+cleanup:
+    hstr_free(&file->file.path);
+    hfree(file, sizeof(struct story_file));
+    halc_end;
+}
+
+errc story_reload(struct story* story, const hstr* changedPaths, u32 count, b8* outPublished)
+{
+    struct story_version* current = story->current;
+    struct story_reload reload = {story, NULL, 0};
+    b8 touched = FALSE;
+
+    if(outPublished)
+    {
+        *outPublished = FALSE;
+    }
+
+    halc_try(story_version_new(&reload.next, current->fileCount));
+
+    // the next version's labels go in a copy, readers of the current one never see it change
+    halc_tryCleanup(story_symbols_copy(&reload.next->symbols, current->symbols->table));
+
+    // files outside the changed paths carry over as they are
+    for(u32 i = 0; i < current->fileCount; i += 1)
+    {
+        b8 changed = FALSE;
+        for(u32 c = 0; c < count && !changed; c += 1)
+        {
+            changed = path_is_under(&current->files[i]->file.path, &changedPaths[c]);
+        }
+
+        if(changed)
+        {
+            touched = TRUE;
+            continue;
+        }
+        reload.next->files[reload.next->fileCount] = current->files[i];
+        reload.next->fileCount += 1;
+    }
+    reload.sharedCount = reload.next->fileCount;
+
+    // then whatever is at the changed paths now
+    for(u32 c = 0; c < count; c += 1)
+    {
+        struct dir_entry_info info;
+        if(!get_path_info(&changedPaths[c], &info))
+        {
+            continue;
+        }
+
+        if(info.isDirectory)
+        {
+            halc_tryCleanup(walk_directory(&changedPaths[c], reload_compile, &reload));
+        }
+        else
+        {
+            halc_tryCleanup(reload_compile(&reload, &changedPaths[c], &info));
+        }
+    }
+
+    if(!touched && reload.next->recompiledCount == 0)
+    {
+        halc_end_ok;
+        goto cleanup;
+    }
+
+    halc_mutex_lock(&story->lock);
+    for(u32 i = 0; i < reload.sharedCount; i += 1)
+    {
+        reload.next->files[i]->refs += 1;
+    }
+    halc_mutex_unlock(&story->lock);
+
+    qsort(reload.next->files, reload.next->fileCount, sizeof(struct story_file*), compare_story_files);
+    story_publish(story, reload.next);
+
+    if(outPublished)
+    {
+        *outPublished = TRUE;
+    }
+    halc_end;
+
+cleanup:
+    // the shared files were never referenced by the new version, only free what it compiled
+    memmove(reload.next->files, reload.next->files + reload.sharedCount,
+        (reload.next->fileCount - reload.sharedCount) * sizeof(struct story_file*));
+    reload.next->fileCount -= reload.sharedCount;
+    story_version_free(reload.next);
+    halc_end;
+}
+
+// ======================= hot reload =================
+
+static void story_watch_changed(void* ctx, const hstr* path)
+{
+    struct story_watch* watch = (struct story_watch*) ctx;
+
+    for(u32 i = 0; i < watch->changedLen; i += 1)
+    {
+        if(hstr_match(&watch->changed[i], path))
+        {
+            return;
+        }
+    }
+
+    if(watch->changedLen == watch->changedCap)
+    {
+        u32 newCap = watch->changedCap ? watch->changedCap * 2 : STORY_INITIAL_CAP;
+        errc result = watch->changedCap ?
+            hrealloc_advanced((void**) &watch->changed, watch->changedCap * sizeof(hstr), newCap * sizeof(hstr), FALSE, __FILE__, __LINE__, __func__) :
+            halloc_advanced((void**) &watch->changed, newCap * sizeof(hstr), __FILE__, __LINE__, __func__);
+
+        if(result)
+        {
+            // the path would be lost, reloading from the root catches it with everything else
+            halc_end_ok;
+            watch->overflowed = TRUE;
+            return;
+        }
+        watch->changedCap = newCap;
+    }
+
+    hstr_init(&watch->changed[watch->changedLen]);
+    if(hstr_dupe(path, &watch->changed[watch->changedLen]))
+    {
+        halc_end_ok;
+        watch->overflowed = TRUE;
+        return;
+    }
+    watch->changedLen += 1;
+}
+
+static void story_watch_clear(struct story_watch* watch)
+{
+    for(u32 i = 0; i < watch->changedLen; i += 1)
+    {
+        hstr_free(&watch->changed[i]);
+    }
+    watch->changedLen = 0;
+    watch->overflowed = FALSE;
+}
+
+errc story_watch_open(struct story_watch* watch, struct story* story)
+{
+    memset(watch, 0, sizeof(*watch));
+    watch->story = story;
+    halc_try(file_watcher_open(&watch->watcher, &story->root));
+    halc_end;
+}
+
+errc story_watch_tick(struct story_watch* watch, u32 timeoutMs, b8* outPublished)
+{
+    errc result;
+
+    if(outPublished)
+    {
+        *outPublished = FALSE;
+    }
+
+    halc_try(file_watcher_poll(&watch->watcher, timeoutMs, story_watch_changed, watch));
+
+    if(watch->overflowed)
+    {
+        result = story_reload(watch->story, &watch->story->root, 1, outPublished);
+    }
+    else if(watch->changedLen)
+    {
+        result = story_reload(watch->story, watch->changed, watch->changedLen, outPublished);
+    }
+    else
+    {
+        halc_end;
+    }
+
+    // a reload that failed keeps its paths, the next tick tries them again
+    halc_try(result);
+    story_watch_clear(watch);
+    halc_end;
+}
+
+void story_watch_close(struct story_watch* watch)
+{
+    story_watch_clear(watch);
+    if(watch->changedCap)
+    {
+        hfree(watch->changed, watch->changedCap * sizeof(hstr));
+    }
+    watch->changed = NULL;
+    watch->changedCap = 0;
+
+    file_watcher_close(&watch->watcher);
+}
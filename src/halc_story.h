@@ -1,10 +1,115 @@
-#ifndef __HALC_STORY 
+#ifndef __HALC_STORY
 #define __HALC_STORY
 
 #include "halc_types.h"
+#include "halc_errors.h"
+#include "halc_files.h"
+#include "halc_region.h"
+#include "halc_threads.h"
 
 EXTERN_C_BEGIN
 
+// ==================== Story versions ======================
+//
+// a story is the latest compiled version of a region, published for running worlds
+// to pick up. A version never changes once it's published. A reload builds the next
+// version beside it, recompiling only the files that changed and sharing the rest,
+// then publishing swaps it in under the story's lock.
+//
+// a world acquires the current version at the start of its tick and releases it
+// when it's done, so the version it's reading can't be freed out from under it and
+// a new one shows up at its next tick. Old versions go away with their last reader.
+//
+// every version has a symbol table of its own that all of its files' labels resolve
+// against. A reload starts from a copy of the current table, so files carried over
+// keep their ids, and the recompiled ones intern into the copy before it's published.
+//
+// one thread reloads (story_reload or story_watch_tick), any thread can acquire.
+//
+// eg. (a world's tick)
+//
+//  struct story_version* version = story_acquire(&story);
+//  ... run interactions against version->files ...
+//  story_release(&story, version);
+//
+
+// tables are shared by reference like files. A file keeps the table it was compiled 
+// into alive, so file.ts.symbols stays valid after the version that built it is gone.
+struct story_symbols {
+    i64 refs;       // the version built with it and every file compiled into it, guarded by the story's lock
+    struct symbol_table* table;
+};
+
+struct story_file {
+    i64 refs;       // versions sharing the file, guarded by the story's lock
+    struct story_symbols* symbols; // what file.ts interned into
+    struct region_file file;
+};
+
+struct story_version {
+    i64 refs;       // the story while it's current, plus every reader
+    u64 version;    // counts up from 1 with every publish
+    struct story_file** files; // sorted by path
+    struct story_symbols* symbols; // every label in the version resolves against this
+    u32 fileCount;
+    u32 fileCap;
+    u32 failedCount;
+    u32 recompiledCount; // files compiled for this version, the rest came from the last one
+};
+
+struct story {
+    hstr root;
+    struct compile_cache* cache; // used for recompiling, can be NULL
+    struct halc_mutex lock;
+    struct story_version* current;
+    u64 versionCount;
+};
+
+// the region's files and symbols move into the first version, the region is left empty
+errc story_init(struct story* story, struct region* region, struct compile_cache* cache);
+
+// every acquired version has to be released first
+void story_free(struct story* story);
+
+struct story_version* story_acquire(struct story* story);
+void story_release(struct story* story, struct story_version* version);
+
+// recompiles what's under the changed paths (files or directories, see file_watcher_poll)
+// and publishes the result as a new version. Files that are gone are dropped and new
+// ones are picked up. Doesn't publish if none of the paths touch a .halc file.
+errc story_reload(struct story* story, const hstr* changedPaths, u32 count, b8* outPublished);
+
+// ==================== Hot reload ======================
+//
+// watches the story's root and reloads whatever changes.
+//
+// eg. (on its own thread)
+//
+//  struct story_watch watch;
+//  halc_try(story_watch_open(&watch, &story));
+//  while(running)
+//      halc_try(story_watch_tick(&watch, 250, NULL));
+//  story_watch_close(&watch);
+//
+struct story_watch {
+    struct story* story;
+    struct file_watcher watcher;
+
+    // paths reported by the watcher during a tick
+    hstr* changed;
+    u32 changedLen;
+    u32 changedCap;
+    b8 overflowed;  // a path couldn't be kept, the tick reloads the whole root
+};
+
+errc story_watch_open(struct story_watch* watch, struct story* story);
+
+// waits up to timeoutMs for changes, then reloads and publishes. If the reload fails
+// the changed paths are kept and reloaded along with the next tick's. outPublished can be NULL.
+errc story_watch_tick(struct story_watch* watch, u32 timeoutMs, b8* outPublished);
+
+void story_watch_close(struct story_watch* watch);
+
 EXTERN_C_END
 
 #endif
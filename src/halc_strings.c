@@ -2,10 +2,12 @@
 #include "halc_allocators.h"
 #include "halc_strings.h"
 #include "halc_errors.h"
+#include "halc_simd.h"
 
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdarg.h>
+#include <string.h>
 
 #define HSTR_VALIDATE_NOT_STATIC(X) do{if(X->cap == -1) halc_raise(ERR_STR_OPERATION_ON_STATIC_HSTR);\
     } while(0)
@@ -16,26 +18,52 @@
 // try to convert a given binary buffer into equivalent utf8 code points
 // also converts \r\n into \n
 
+// first/last byte filter: for a block of candidate starts, compare the first byte of
+// search at each start and its last byte at start + len - 1, and only run the full
+// compare where both hit. Scanning story text this rejects almost every position
+// a block at a time.
 b8 hstr_contains(const hstr* string, const hstr* search)
 {
-    hchar* start = string->buffer;
-    while (start - string->buffer < string->len)
+    const u32 n = string->len;
+    const u32 m = search->len;
+
+    if(m == 0)
     {
-        if (string->buffer + string->len - start < search->len)
-            break;
+        return n > 0;
+    }
 
-        hstr view = {
-            start,
-            search->len,
-            0,
-        };
+    if(m > n)
+    {
+        return FALSE;
+    }
+
+    const char* s = string->buffer;
+    const char* needle = search->buffer;
+    const char first = needle[0];
+    const char last = needle[m - 1];
 
-        if (hstr_match(&view, search))
+    // candidate starts are [0, n - m], each block reads up to start + m - 1 + HALC_SIMD_WIDTH
+    u32 i = 0;
+    for(; i + m - 1 + HALC_SIMD_WIDTH <= n; i += HALC_SIMD_WIDTH)
+    {
+        u32 mask = halc_simd_eq_mask(s + i, first) & halc_simd_eq_mask(s + i + m - 1, last);
+        while(mask)
         {
-            return TRUE;
+            u32 start = i + halc_ctz32(mask);
+            if(m <= 2 || memcmp(s + start + 1, needle + 1, m - 2) == 0)
+            {
+                return TRUE;
+            }
+            mask &= mask - 1;
         }
+    }
 
-        start += 1;
+    for(; i + m <= n; i += 1)
+    {
+        if(s[i] == first && s[i + m - 1] == last && memcmp(s + i, needle, m) == 0)
+        {
+            return TRUE;
+        }
     }
 
     return FALSE;
@@ -49,30 +77,40 @@ b8 hstr_match(const hstr* left, const hstr* right)
 
     const char* r = left->buffer;
     const char* r2 = right->buffer;
-    const char* rEnd = left->buffer + left->len;
+    const u32 len = left->len;
 
-    while(r < rEnd)
+    if(len < HALC_SIMD_WIDTH)
     {
-        if(*r != *r2)
-            return FALSE;
+        // terminals and most labels end up here
+        for(u32 i = 0; i < len; i += 1)
+        {
+            if(r[i] != r2[i])
+                return FALSE;
+        }
+        return TRUE;
+    }
 
-        r2++;
-        r++;
+    // the last block is loaded ending at len so there's no scalar tail, 
+    // it overlaps the previous block instead.
+    for(u32 i = 0; i + HALC_SIMD_WIDTH < len; i += HALC_SIMD_WIDTH)
+    {
+        if(halc_simd_neq_mask(r + i, r2 + i))
+            return FALSE;
     }
 
-    return TRUE;
+    return halc_simd_neq_mask(r + len - HALC_SIMD_WIDTH, r2 + len - HALC_SIMD_WIDTH) == 0;
 }
 
 void hstr_free(hstr* str) 
 {
     HSTR_VALIDATE_NOT_STATIC_VOID(str);
 
-    if(str->len <= 0)
+    if(str->cap <= 0)
     {
         return;
     }
 
-    hfree(str->buffer, str->cap);
+    hfree_string(str->buffer, str->cap);
     str->len = 0;
     str->cap = 0;
     str->buffer = NULL;
@@ -96,11 +134,11 @@ errc hstr_reserve(hstr* str, u32 len)
 
     if(str->cap > 0)
     {
-        hrealloc(&str->buffer, str->cap, len, FALSE);
+        hrealloc_string(&str->buffer, str->cap, len);
     }
     else 
     {
-        halloc(&str->buffer, len);
+        halloc_string(&str->buffer, len);
     }
 
     str->cap = len;
@@ -111,12 +149,11 @@ errc hstr_reserve(hstr* str, u32 len)
 errc hstr_normalize(const hstr* istr, hstr* ostr)
 {
     // Allocate working buffer, it's garunteed to be smaller the input buffer.
-    halloc(&ostr->buffer, istr->len + 1); // FIXME_GOOD
+    halloc_string(&ostr->buffer, istr->len + 1); // FIXME_GOOD
     ostr->len = 0;
     ostr->cap = istr->len + 1;
 
     char* w = ostr->buffer;
-    usize wLen = ostr->len;
 
     const char* r = istr->buffer;
     const char* rEnd = istr->buffer + istr->len;
@@ -126,7 +163,35 @@ errc hstr_normalize(const hstr* istr, hstr* ostr)
 
     while(r < rEnd)
     {
+        if(!isNewLine)
+        {
+            // past the indentation everything is copied as is up to the next \n or \r,
+            // move whole blocks at a time. w never gets ahead of r so the block fits.
+            while(r + HALC_SIMD_WIDTH <= rEnd)
+            {
+                u32 mask = halc_simd_eq_mask(r, '\n') | halc_simd_eq_mask(r, '\r');
+                if(!mask)
+                {
+                    memcpy(w, r, HALC_SIMD_WIDTH);
+                    w += HALC_SIMD_WIDTH;
+                    r += HALC_SIMD_WIDTH;
+                    continue;
+                }
+
+                u32 run = halc_ctz32(mask);
+                memcpy(w, r, run);
+                w += run;
+                r += run;
+                break;
+            }
+
+            if(r >= rEnd)
+            {
+                break;
+            }
+        }
 
+        // line starts, line breaks and the last few bytes go one at a time
         if(isNewLine)
         {
             if(*r != '\t' && *r != ' ')
@@ -136,6 +201,7 @@ errc hstr_normalize(const hstr* istr, hstr* ostr)
                 {
                     *w = 0; // write out a null so we can debug print it
                     fprintf(stderr, RED("attempted to normalize file with inconsistent file format, inconsistent spacing count for tabbing, we need a tab value of 4 content normalized so far:") " %s\n", ostr->buffer);
+                    hstr_free(ostr);
                     halc_raise(ERR_INCONSISTENT_FILE_FORMAT);
                 }
 
@@ -187,25 +253,491 @@ errc hstr_normalize(const hstr* istr, hstr* ostr)
     halc_end;
 }
 
+// ==================== utf8 validation ======================
+
+// length of the well formed sequence starting at p, 0 if it's malformed or runs past end
+static u32 utf8_sequence_length(const u8* p, const u8* end)
+{
+    u8 c = p[0];
+    usize avail = end - p;
+
+    if(c < 0x80)
+    {
+        return 1;
+    }
+
+    // C0 and C1 can only start overlong two byte sequences
+    if(c >= 0xC2 && c <= 0xDF)
+    {
+        return (avail >= 2 && (p[1] & 0xC0) == 0x80) ? 2 : 0;
+    }
+
+    if(c >= 0xE0 && c <= 0xEF)
+    {
+        // E0 80..9F is overlong, ED A0..BF are the utf16 surrogates
+        u8 low = c == 0xE0 ? 0xA0 : 0x80;
+        u8 high = c == 0xED ? 0x9F : 0xBF;
+        return (avail >= 3 && p[1] >= low && p[1] <= high && (p[2] & 0xC0) == 0x80) ? 3 : 0;
+    }
+
+    if(c >= 0xF0 && c <= 0xF4)
+    {
+        // F0 80..8F is overlong, F4 90..BF is past U+10FFFF
+        u8 low = c == 0xF0 ? 0x90 : 0x80;
+        u8 high = c == 0xF4 ? 0x8F : 0xBF;
+        return (avail >= 4 && p[1] >= low && p[1] <= high && 
+            (p[2] & 0xC0) == 0x80 && (p[3] & 0xC0) == 0x80) ? 4 : 0;
+    }
+
+    return 0;
+}
+
+// walks one sequence at a time from start, which must be on a sequence boundary.
+// returns the offset of the first malformed sequence or len if there isn't one.
+static usize utf8_scalar_find_error(const u8* buf, usize start, usize len)
+{
+    usize i = start;
+    while(i < len)
+    {
+        u32 n = utf8_sequence_length(buf + i, buf + len);
+        if(!n)
+        {
+            return i;
+        }
+        i += n;
+    }
+    return len;
+}
+
+#if defined(HALC_SIMD_AVX2)
+
+// Keiser and Lemire's lookup validator, the same one simdjson uses. Every error 
+// a two byte window can show is a bit, three nibble lookups on (prev byte high, 
+// prev byte low, this byte high) pick the errors each nibble allows and anding 
+// them leaves only the ones that actually happened. Third and fourth continuation
+// bytes are checked with a saturating subtract on the bytes 2 and 3 back.
+#define UTF8_TOO_SHORT      (1 << 0)
+#define UTF8_TOO_LONG       (1 << 1)
+#define UTF8_OVERLONG_3     (1 << 2)
+#define UTF8_TOO_LARGE      (1 << 3)
+#define UTF8_SURROGATE      (1 << 4)
+#define UTF8_OVERLONG_2     (1 << 5)
+#define UTF8_TOO_LARGE_1000 (1 << 6)
+#define UTF8_OVERLONG_4     (1 << 6)
+#define UTF8_TWO_CONTS      (1 << 7)
+#define UTF8_CARRY          (UTF8_TOO_SHORT | UTF8_TOO_LONG | UTF8_TWO_CONTS)
+
+// pshufb looks up within each 128 bit lane, so the table goes in twice
+#define UTF8_TABLE(...) _mm256_setr_epi8(__VA_ARGS__, __VA_ARGS__)
+
+// the input shifted back by N bytes, with the end of the previous block shifted in
+#define UTF8_PREV(INPUT, PREV, N) \
+    _mm256_alignr_epi8(INPUT, _mm256_permute2x128_si256(PREV, INPUT, 0x21), 16 - N)
+
+static inline __m256i utf8_high_nibbles(__m256i v)
+{
+    return _mm256_and_si256(_mm256_srli_epi16(v, 4), _mm256_set1_epi8(0x0F));
+}
+
+// non zero lanes mark errors in input, prev is the previous block
+static inline __m256i utf8_check_block(__m256i input, __m256i prev)
+{
+    const __m256i byte1HighTable = UTF8_TABLE(
+        // 0_______ ascii
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG, UTF8_TOO_LONG,
+        // 10______ continuation
+        UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS, UTF8_TWO_CONTS,
+        // 1100____ two byte lead
+        UTF8_TOO_SHORT | UTF8_OVERLONG_2,
+        // 1101____ two byte lead
+        UTF8_TOO_SHORT,
+        // 1110____ three byte lead
+        UTF8_TOO_SHORT | UTF8_OVERLONG_3 | UTF8_SURROGATE,
+        // 1111____ four byte lead
+        UTF8_TOO_SHORT | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4);
+
+    const __m256i byte1LowTable = UTF8_TABLE(
+        // ____0000
+        UTF8_CARRY | UTF8_OVERLONG_3 | UTF8_OVERLONG_2 | UTF8_OVERLONG_4,
+        // ____0001
+        UTF8_CARRY | UTF8_OVERLONG_2,
+        // ____001_
+        UTF8_CARRY,
+        UTF8_CARRY,
+        // ____0100
+        UTF8_CARRY | UTF8_TOO_LARGE,
+        // ____0101 and up
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        // ____1101
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000 | UTF8_SURROGATE,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000,
+        UTF8_CARRY | UTF8_TOO_LARGE | UTF8_TOO_LARGE_1000);
+
+    const __m256i byte2HighTable = UTF8_TABLE(
+        // 0_______ ascii
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT,
+        // 1000____
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE_1000 | UTF8_OVERLONG_4,
+        // 1001____
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_OVERLONG_3 | UTF8_TOO_LARGE,
+        // 101_____
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        UTF8_TOO_LONG | UTF8_OVERLONG_2 | UTF8_TWO_CONTS | UTF8_SURROGATE | UTF8_TOO_LARGE,
+        // 11______ lead
+        UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT, UTF8_TOO_SHORT);
+
+    __m256i prev1 = UTF8_PREV(input, prev, 1);
+    __m256i byte1High = _mm256_shuffle_epi8(byte1HighTable, utf8_high_nibbles(prev1));
+    __m256i byte1Low = _mm256_shuffle_epi8(byte1LowTable, _mm256_and_si256(prev1, _mm256_set1_epi8(0x0F)));
+    __m256i byte2High = _mm256_shuffle_epi8(byte2HighTable, utf8_high_nibbles(input));
+    __m256i special = _mm256_and_si256(_mm256_and_si256(byte1High, byte1Low), byte2High);
+
+    // a continuation is required 2 bytes after a 3 or 4 byte lead and 3 bytes after a 4 byte lead,
+    // the lookup above flags those as TWO_CONTS so flip that bit back where it's expected
+    __m256i isThird = _mm256_subs_epu8(UTF8_PREV(input, prev, 2), _mm256_set1_epi8(0xE0 - 0x80));
+    __m256i isFourth = _mm256_subs_epu8(UTF8_PREV(input, prev, 3), _mm256_set1_epi8(0xF0 - 0x80));
+    __m256i must23 = _mm256_and_si256(_mm256_or_si256(isThird, isFourth), _mm256_set1_epi8((char) 0x80));
+    return _mm256_xor_si256(must23, special);
+}
+
+// non zero when the block ends partway into a sequence
+static inline __m256i utf8_is_incomplete(__m256i input)
+{
+    const __m256i maxValue = _mm256_setr_epi8(
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+        (char)(0xF0 - 1), (char)(0xE0 - 1), (char)(0xC0 - 1));
+    return _mm256_subs_epu8(input, maxValue);
+}
+
+// the blocks only say that something went wrong, not where. Every block before 
+// blockStart passed, so the bad sequence starts at most 3 bytes before it.
+static usize utf8_locate_error(const u8* buf, usize blockStart, usize len)
+{
+    usize start = blockStart >= 3 ? blockStart - 3 : 0;
+    while(start > 0 && (buf[start] & 0xC0) == 0x80)
+    {
+        start -= 1;
+    }
+
+    usize offset = utf8_scalar_find_error(buf, start, len);
+    return offset < len ? offset : blockStart;
+}
+
+static usize utf8_find_error(const u8* buf, usize len)
+{
+    __m256i prev = _mm256_setzero_si256();
+    __m256i prevIncomplete = _mm256_setzero_si256();
+
+    usize i = 0;
+    for(; i + 32 <= len; i += 32)
+    {
+        __m256i input = _mm256_loadu_si256((const __m256i*) (buf + i));
+        __m256i error;
+
+        // ascii blocks only have to check that the previous block didn't end mid sequence
+        if(!_mm256_movemask_epi8(input))
+        {
+            error = prevIncomplete;
+        }
+        else
+        {
+            error = utf8_check_block(input, prev);
+            prevIncomplete = utf8_is_incomplete(input);
+        }
+        prev = input;
+
+        if(!_mm256_testz_si256(error, error))
+        {
+            return utf8_locate_error(buf, i, len);
+        }
+    }
+
+    // the tail is padded out with zeros, a sequence cut short by the end of the
+    // string shows up as one followed by ascii
+    u8 tail[32] = {0};
+    memcpy(tail, buf + i, len - i);
+    __m256i error = utf8_check_block(_mm256_loadu_si256((const __m256i*) tail), prev);
+    if(!_mm256_testz_si256(error, error))
+    {
+        return utf8_locate_error(buf, i, len);
+    }
+
+    return len;
+}
+
+#else
+
+// without a byte shuffle this steps over ascii a block at a time and walks 
+// anything else one sequence at a time.
+static usize utf8_find_error(const u8* buf, usize len)
+{
+    usize i = 0;
+    while(i + HALC_SIMD_WIDTH <= len)
+    {
+        u32 mask = halc_simd_high_mask((const char*) buf + i);
+        if(!mask)
+        {
+            i += HALC_SIMD_WIDTH;
+            continue;
+        }
+
+        usize blockEnd = i + HALC_SIMD_WIDTH;
+        i += halc_ctz32(mask);
+        while(i < blockEnd)
+        {
+            u32 n = utf8_sequence_length(buf + i, buf + len);
+            if(!n)
+            {
+                return i;
+            }
+            i += n;
+        }
+    }
+
+    return utf8_scalar_find_error(buf, i, len);
+}
+
+#endif
+
+errc hstr_validate_utf8(const hstr* str, struct utf8_error* outError)
+{
+    const u8* buf = (const u8*) str->buffer;
+    usize offset = utf8_find_error(buf, str->len);
+
+    if(offset < str->len)
+    {
+        if(outError)
+        {
+            outError->offset = (u32) offset;
+            outError->lineNumber = 1;
+            for(usize i = 0; i < offset; i += 1)
+            {
+                outError->lineNumber += buf[i] == '\n';
+            }
+        }
+        halc_raise(ERR_STR_INVALID_UTF8);
+    }
+
+    halc_end;
+}
+
+// ==================== string building ======================
+
+// the appenders grow the buffer to at least double its capacity, so a string 
+// assembled from many small pieces only reallocates a handful of times.
+#define HSTR_MIN_GROWTH 32
+
+// makes room for extra more bytes plus the null terminator
+static errc hstr_grow(hstr* str, u32 extra)
+{
+    HSTR_VALIDATE_NOT_STATIC(str);
+
+    u32 needed = str->len + extra + 1;
+    if(str->cap >= (i32) needed)
+    {
+        halc_end;
+    }
+
+    u32 doubled = (u32) str->cap * 2;
+    u32 newCap = HALC_MAX(needed, doubled);
+    if(newCap < HSTR_MIN_GROWTH)
+    {
+        newCap = HSTR_MIN_GROWTH;
+    }
+
+    halc_try(hstr_reserve(str, newCap));
+    halc_end;
+}
+
 errc hstr_printf(hstr* str, const char* fmt, ...)
 {
     HSTR_VALIDATE_NOT_STATIC(str);
     va_list args, copy;
     va_start(args, fmt);
+
+    // format straight into the spare capacity, the format is only walked a second
+    // time when the output didn't fit
+    halc_tryCleanup(hstr_grow(str, HSTR_MIN_GROWTH));
+
     va_copy(copy, args);
-    int charsToWrite = vsnprintf(NULL, 0, fmt, copy);
+    usize spare = str->cap - str->len;
+    int charsToWrite = vsnprintf(str->buffer + str->len, spare, fmt, copy);
     va_end(copy);
 
-    if(str->cap < (i32)(str->len + charsToWrite + 1))
+    if((usize) charsToWrite >= spare)
     {
-        hstr_reserve(str, str->len + charsToWrite + 1);
+        halc_tryCleanup(hstr_grow(str, charsToWrite));
+        vsnprintf(str->buffer + str->len, charsToWrite + 1, fmt, args);
     }
-
-    char* start = str->buffer + str->len;
-    vsnprintf(start, charsToWrite + 1, fmt, args);
     str->len += charsToWrite;
-    va_end (args);
 
+cleanup:
+    va_end(args);
+    halc_end;
+}
+
+errc hstr_append_chars(hstr* str, const hchar* chars, u32 len)
+{
+    halc_try(hstr_grow(str, len));
+
+    memcpy(str->buffer + str->len, chars, len);
+    str->len += len;
+    str->buffer[str->len] = 0;
+
+    halc_end;
+}
+
+errc hstr_append(hstr* str, const hstr* view)
+{
+    halc_try(hstr_append_chars(str, view->buffer, view->len));
+    halc_end;
+}
+
+errc hstr_append_cstr(hstr* str, const hchar* cstr)
+{
+    halc_try(hstr_append_chars(str, cstr, (u32) strlen(cstr)));
+    halc_end;
+}
+
+errc hstr_append_char(hstr* str, hchar c)
+{
+    halc_try(hstr_grow(str, 1));
+
+    str->buffer[str->len] = c;
+    str->len += 1;
+    str->buffer[str->len] = 0;
+
+    halc_end;
+}
+
+static const char gDigitPairs[201] = 
+    "00010203040506070809"
+    "10111213141516171819"
+    "20212223242526272829"
+    "30313233343536373839"
+    "40414243444546474849"
+    "50515253545556575859"
+    "60616263646566676869"
+    "70717273747576777879"
+    "80818283848586878889"
+    "90919293949596979899";
+
+// writes the digits of value ending just before end, two at a time. returns the first digit
+static char* write_u64_backwards(char* end, u64 value)
+{
+    char* w = end;
+    while(value >= 100)
+    {
+        u32 pair = (u32)(value % 100) * 2;
+        value /= 100;
+        w -= 2;
+        w[0] = gDigitPairs[pair];
+        w[1] = gDigitPairs[pair + 1];
+    }
+
+    if(value >= 10)
+    {
+        w -= 2;
+        w[0] = gDigitPairs[value * 2];
+        w[1] = gDigitPairs[value * 2 + 1];
+    }
+    else
+    {
+        w -= 1;
+        w[0] = (char)('0' + value);
+    }
+    return w;
+}
+
+errc hstr_append_u64(hstr* str, u64 value)
+{
+    char digits[20];
+    char* end = digits + sizeof(digits);
+    char* start = write_u64_backwards(end, value);
+
+    halc_try(hstr_append_chars(str, start, (u32)(end - start)));
+    halc_end;
+}
+
+errc hstr_append_i64(hstr* str, i64 value)
+{
+    char digits[21];
+    char* end = digits + sizeof(digits);
+
+    // negate as unsigned so the smallest i64 doesn't overflow
+    u64 magnitude = value < 0 ? 0 - (u64) value : (u64) value;
+    char* start = write_u64_backwards(end, magnitude);
+    if(value < 0)
+    {
+        *--start = '-';
+    }
+
+    halc_try(hstr_append_chars(str, start, (u32)(end - start)));
+    halc_end;
+}
+
+// past this the scaled value doesn't fit the integer path, hand it to printf
+#define HSTR_F64_FAST_LIMIT 1e15
+#define HSTR_F64_MAX_DECIMALS 9
+
+errc hstr_append_f64(hstr* str, f64 value, u32 decimals)
+{
+    static const f64 scales[HSTR_F64_MAX_DECIMALS + 1] = {
+        1e0, 1e1, 1e2, 1e3, 1e4, 1e5, 1e6, 1e7, 1e8, 1e9
+    };
+
+    if(decimals > HSTR_F64_MAX_DECIMALS)
+    {
+        decimals = HSTR_F64_MAX_DECIMALS;
+    }
+
+    f64 magnitude = value < 0 ? -value : value;
+    f64 scaled = magnitude * scales[decimals] + 0.5;
+
+    // also catches nan and inf, which fail every comparison but the last
+    if(!(scaled < HSTR_F64_FAST_LIMIT))
+    {
+        halc_try(hstr_printf(str, "%.*f", (int) decimals, value));
+        halc_end;
+    }
+
+    // fixed point, rounded half away from zero
+    u64 fixed = (u64) scaled;
+    u64 scale = (u64) scales[decimals];
+    u64 whole = fixed / scale;
+    u64 fraction = fixed % scale;
+
+    char digits[40];
+    char* end = digits + sizeof(digits);
+    char* start = end;
+    if(decimals)
+    {
+        // the fraction keeps its leading zeros
+        char* fractionStart = write_u64_backwards(end, fraction);
+        while(fractionStart > end - decimals)
+        {
+            *--fractionStart = '0';
+        }
+        start = fractionStart;
+        *--start = '.';
+    }
+    start = write_u64_backwards(start, whole);
+    if(value < 0 && fixed != 0)
+    {
+        *--start = '-';
+    }
+
+    halc_try(hstr_append_chars(str, start, (u32)(end - start)));
     halc_end;
 }
 
@@ -231,9 +763,13 @@ errc test_hstr_printf()
 
 errc hstr_dupe(const hstr* left, hstr* out) {
 
+    // static strings have no capacity, size the copy from the length
     out->len = left->len;
-    out->cap = left->cap;
-    halloc(out->buffer, left->cap * sizeof(hchar));
+    out->cap = left->len + 1;
+    halloc_string(&out->buffer, out->cap * sizeof(hchar));
+
+    memcpy(out->buffer, left->buffer, left->len * sizeof(hchar));
+    out->buffer[out->len] = 0;
 
     halc_end;
 }
@@ -26,9 +26,23 @@ b8 hstr_match(const hstr* left, const hstr* right);
 // destroys an str
 void hstr_free(hstr* str);
 
-// prints INTO an existing hstr
+// prints INTO an existing hstr, appending to what's already there
 errc hstr_printf(hstr* str, const hchar* fmt, ...);
 
+// appenders for building strings up piece by piece without going through a format
+// string. The buffer grows geometrically and is kept null terminated.
+errc hstr_append(hstr* str, const hstr* view);
+errc hstr_append_chars(hstr* str, const hchar* chars, u32 len);
+errc hstr_append_cstr(hstr* str, const hchar* cstr);
+errc hstr_append_char(hstr* str, hchar c);
+errc hstr_append_i64(hstr* str, i64 value);
+errc hstr_append_u64(hstr* str, u64 value);
+
+// fixed point with the given number of decimals (at most 9), rounded half away 
+// from zero. Can differ from printf in the last digit when the value sits right on
+// a tie, very large values, nan and inf go through printf.
+errc hstr_append_f64(hstr* str, f64 value, u32 decimals);
+
 // empties the string, retaining the current capacity
 void hstr_empty(hstr* str);
 
@@ -47,6 +61,17 @@ errc hstr_normalize(const hstr* istr, hstr* ostr);
 
 void hstr_init(hstr* str);
 
+// where hstr_validate_utf8 found the first malformed sequence
+struct utf8_error {
+    u32 offset;     // byte offset of the first byte of the bad sequence
+    i32 lineNumber; // 1 based
+};
+
+// checks that a string is well formed utf8, rejects overlong encodings, surrogates,
+// code points past U+10FFFF and sequences cut short. Raises ERR_STR_INVALID_UTF8 and 
+// fills in outError (when not NULL) with the location of the first bad sequence.
+errc hstr_validate_utf8(const hstr* str, struct utf8_error* outError);
+
 errc hstr_dupe(const hstr* left, hstr* out);
 
 // Do not count the null terminator as part of the length
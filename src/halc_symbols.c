@@ -0,0 +1,211 @@
+#include "halc_symbols.h"
+#include "halc_allocators.h"
+#include "halc_hash.h"
+
+#include <string.h>
+
+#define SYMBOL_TABLE_INITIAL_CAP 64
+#define SYMBOL_CHARS_INITIAL_CAP 1024
+
+static const hstr gBuiltinSymbols[] = {
+    HSTR(""), // HALC_SYM_NONE, never looked up
+    HSTR("end"), // HALC_SYM_END
+    HSTR("goto"), // HALC_SYM_GOTO
+};
+
+static b8 symbol_entry_matches(const struct symbol_table* table, u32 symbol, u32 hash, const hstr* string)
+{
+    const struct symbol_entry* entry = &table->entries[symbol];
+    return entry->hash == hash && 
+        entry->len == string->len && 
+        memcmp(table->chars + entry->offset, string->buffer, string->len) == 0;
+}
+
+// returns the slot holding the string, or the empty slot it would go into
+static u32 symbol_probe(const struct symbol_table* table, u32 hash, const hstr* string)
+{
+    u32 mask = table->slotsCap - 1;
+    u32 slot = hash & mask;
+    while(table->slots[slot] && !symbol_entry_matches(table, table->slots[slot], hash, string))
+    {
+        slot = (slot + 1) & mask;
+    }
+    return slot;
+}
+
+static errc symbol_grow_slots(struct symbol_table* table)
+{
+    u32 oldCap = table->slotsCap;
+    u32* oldSlots = table->slots;
+
+    u32* newSlots;
+    halloc(&newSlots, oldCap * 2 * sizeof(u32));
+    memset(newSlots, 0, oldCap * 2 * sizeof(u32));
+
+    table->slots = newSlots;
+    table->slotsCap = oldCap * 2;
+
+    u32 mask = table->slotsCap - 1;
+    for(u32 i = 0; i < oldCap; i += 1)
+    {
+        u32 symbol = oldSlots[i];
+        if(symbol)
+        {
+            u32 slot = table->entries[symbol].hash & mask;
+            while(table->slots[slot])
+            {
+                slot = (slot + 1) & mask;
+            }
+            table->slots[slot] = symbol;
+        }
+    }
+
+    hfree(oldSlots, oldCap * sizeof(u32));
+    halc_end;
+}
+
+static errc symbol_insert(struct symbol_table* table, u32 slot, u32 hash, const hstr* string, u32* outSymbol)
+{
+    if(table->len == table->cap)
+    {
+        u32 newCap = table->cap * 2;
+        hrealloc(&table->entries, table->cap * sizeof(struct symbol_entry), newCap * sizeof(struct symbol_entry), FALSE);
+        table->cap = newCap;
+    }
+
+    if(table->charsLen + string->len + 1 > table->charsCap)
+    {
+        u32 newCap = table->charsCap * 2;
+        while(table->charsLen + string->len + 1 > newCap)
+        {
+            newCap *= 2;
+        }
+        hrealloc(&table->chars, table->charsCap, newCap, FALSE);
+        table->charsCap = newCap;
+    }
+
+    u32 symbol = table->len;
+    struct symbol_entry* entry = &table->entries[symbol];
+    entry->hash = hash;
+    entry->offset = table->charsLen;
+    entry->len = string->len;
+
+    memcpy(table->chars + table->charsLen, string->buffer, string->len);
+    table->chars[table->charsLen + string->len] = 0;
+    table->charsLen += string->len + 1;
+
+    table->slots[slot] = symbol;
+    table->len += 1;
+
+    // keep the load factor under 3/4, id 0 doesn't take a slot
+    if((table->len - 1) * 4 >= table->slotsCap * 3)
+    {
+        halc_try(symbol_grow_slots(table));
+    }
+
+    *outSymbol = symbol;
+    halc_end;
+}
+
+errc symbol_table_init(struct symbol_table* table)
+{
+    // zeroed first so a table that failed part way through can still be freed
+    memset(table, 0, sizeof(*table));
+
+    table->len = 1; // HALC_SYM_NONE
+    table->cap = SYMBOL_TABLE_INITIAL_CAP;
+    table->slotsCap = SYMBOL_TABLE_INITIAL_CAP * 2;
+    table->charsLen = 1;
+    table->charsCap = SYMBOL_CHARS_INITIAL_CAP;
+
+    halloc(&table->entries, table->cap * sizeof(struct symbol_entry));
+    halloc(&table->slots, table->slotsCap * sizeof(u32));
+    halloc(&table->chars, table->charsCap);
+
+    memset(table->slots, 0, table->slotsCap * sizeof(u32));
+    table->entries[HALC_SYM_NONE].hash = 0;
+    table->entries[HALC_SYM_NONE].offset = 0;
+    table->entries[HALC_SYM_NONE].len = 0;
+    table->chars[0] = 0;
+
+    for(u32 i = HALC_SYM_NONE + 1; i < HALC_SYM_BUILTIN_COUNT; i += 1)
+    {
+        u32 symbol;
+        halc_try(symbol_intern(table, &gBuiltinSymbols[i], &symbol));
+    }
+
+    halc_end;
+}
+
+void symbol_table_free(struct symbol_table* table)
+{
+    if(table->entries)
+        hfree(table->entries, table->cap * sizeof(struct symbol_entry));
+    if(table->slots)
+        hfree(table->slots, table->slotsCap * sizeof(u32));
+    if(table->chars)
+        hfree(table->chars, table->charsCap);
+
+    table->entries = NULL;
+    table->slots = NULL;
+    table->chars = NULL;
+    table->len = 0;
+    table->cap = 0;
+    table->slotsCap = 0;
+    table->charsLen = 0;
+    table->charsCap = 0;
+}
+
+errc symbol_table_copy(struct symbol_table* out, const struct symbol_table* table)
+{
+    // the capacities go in first so a copy that failed part way through can still be freed
+    memset(out, 0, sizeof(*out));
+    out->len = table->len;
+    out->cap = table->cap;
+    out->slotsCap = table->slotsCap;
+    out->charsLen = table->charsLen;
+    out->charsCap = table->charsCap;
+
+    halloc(&out->entries, out->cap * sizeof(struct symbol_entry));
+    halloc(&out->slots, out->slotsCap * sizeof(u32));
+    halloc(&out->chars, out->charsCap);
+
+    memcpy(out->entries, table->entries, table->len * sizeof(struct symbol_entry));
+    memcpy(out->slots, table->slots, table->slotsCap * sizeof(u32));
+    memcpy(out->chars, table->chars, table->charsLen);
+
+    halc_end;
+}
+
+errc symbol_intern(struct symbol_table* table, const hstr* string, u32* outSymbol)
+{
+    u32 hash = hstr_hash32(string);
+    u32 slot = symbol_probe(table, hash, string);
+
+    if(table->slots[slot])
+    {
+        *outSymbol = table->slots[slot];
+        return ERR_OK;
+    }
+
+    halc_try(symbol_insert(table, slot, hash, string, outSymbol));
+    halc_end;
+}
+
+u32 symbol_find(const struct symbol_table* table, const hstr* string)
+{
+    return table->slots[symbol_probe(table, hstr_hash32(string), string)];
+}
+
+void symbol_get_string(const struct symbol_table* table, u32 symbol, hstr* out)
+{
+    const struct symbol_entry* entry = &table->entries[symbol];
+    out->buffer = table->chars + entry->offset;
+    out->len = entry->len;
+    out->cap = -1;
+}
+
+u32 symbol_get_hash(const struct symbol_table* table, u32 symbol)
+{
+    return table->entries[symbol].hash;
+}
@@ -0,0 +1,80 @@
+#ifndef _HALC_SYMBOLS_H_
+#define _HALC_SYMBOLS_H_
+
+#include "halc_types.h"
+#include "halc_errors.h"
+#include "halc_strings.h"
+
+EXTERN_C_BEGIN
+
+// ==================== Symbol Table ======================
+//
+// interns strings (labels, speaker names, directive names) to stable u32 symbol ids.
+// each distinct string is stored once and hashed once, after that two symbols from
+// the same table are equal exactly when their ids are.
+//
+// the tokenizer interns every LABEL token, so the parser can dispatch on directive 
+// names and compare labels with an integer compare. Several token streams can share 
+// a table, eg. every file of a region, so a label has the same id in all of them.
+//
+// ids are handed out in insertion order starting after the builtins, 0 is never a symbol.
+// a table is not thread safe.
+//
+// eg.
+//
+//  struct symbol_table symbols;
+//  halc_try(symbol_table_init(&symbols));
+//  halc_try(tokenize_with_symbols(&ts, &source, &filename, &symbols));
+//  ...
+//  if(ts.tokens[i].symbol == HALC_SYM_GOTO) ...
+//
+enum builtin_symbol {
+    HALC_SYM_NONE = 0,
+    HALC_SYM_END,
+    HALC_SYM_GOTO,
+    HALC_SYM_BUILTIN_COUNT
+};
+
+struct symbol_entry {
+    u32 hash;
+    u32 offset; // into the character storage
+    u32 len;
+};
+
+struct symbol_table {
+    struct symbol_entry* entries; // indexed by symbol id
+    u32 len;
+    u32 cap;
+
+    // open addressed, linear probing. holds symbol ids, 0 is an empty slot
+    u32* slots;
+    u32 slotsCap; // always a power of two
+
+    // every interned string back to back, each one null terminated
+    char* chars;
+    u32 charsLen;
+    u32 charsCap;
+};
+
+// the builtin symbols are interned up front
+errc symbol_table_init(struct symbol_table* table);
+void symbol_table_free(struct symbol_table* table);
+
+// out gets every symbol of table under the same id, and grows on its own from there
+errc symbol_table_copy(struct symbol_table* out, const struct symbol_table* table);
+
+// returns the id of string, adding it to the table if it's not there yet
+errc symbol_intern(struct symbol_table* table, const hstr* string, u32* outSymbol);
+
+// looks a string up without adding it, returns HALC_SYM_NONE if it was never interned
+u32 symbol_find(const struct symbol_table* table, const hstr* string);
+
+// static view of the interned string, valid until the next symbol_intern on this table
+void symbol_get_string(const struct symbol_table* table, u32 symbol, hstr* out);
+
+// hash computed when the string was interned, hstr_hash32 of it
+u32 symbol_get_hash(const struct symbol_table* table, u32 symbol);
+
+EXTERN_C_END
+
+#endif
@@ -0,0 +1,195 @@
+#include "halc_threads.h"
+#include "halc_allocators.h"
+
+#if !defined(_WIN32)
+#include <unistd.h>
+#endif
+
+// ======================= mutex =================
+
+#if defined(_WIN32)
+
+errc halc_mutex_init(struct halc_mutex* mutex)
+{
+    InitializeSRWLock(&mutex->lock);
+    return ERR_OK;
+}
+
+void halc_mutex_lock(struct halc_mutex* mutex)
+{
+    AcquireSRWLockExclusive(&mutex->lock);
+}
+
+void halc_mutex_unlock(struct halc_mutex* mutex)
+{
+    ReleaseSRWLockExclusive(&mutex->lock);
+}
+
+void halc_mutex_free(struct halc_mutex* mutex)
+{
+}
+
+#else
+
+errc halc_mutex_init(struct halc_mutex* mutex)
+{
+    if(pthread_mutex_init(&mutex->lock, NULL) != 0)
+    {
+        halc_raise(ERR_THREAD_FAILURE);
+    }
+    return ERR_OK;
+}
+
+void halc_mutex_lock(struct halc_mutex* mutex)
+{
+    pthread_mutex_lock(&mutex->lock);
+}
+
+void halc_mutex_unlock(struct halc_mutex* mutex)
+{
+    pthread_mutex_unlock(&mutex->lock);
+}
+
+void halc_mutex_free(struct halc_mutex* mutex)
+{
+    pthread_mutex_destroy(&mutex->lock);
+}
+
+#endif
+
+// ======================= threads =================
+
+#if defined(_WIN32)
+
+static DWORD WINAPI thread_trampoline(LPVOID param)
+{
+    struct halc_thread* thread = (struct halc_thread*) param;
+    thread->entry(thread->arg);
+    return 0;
+}
+
+errc halc_thread_start(struct halc_thread* thread, void (*entry)(void* arg), void* arg)
+{
+    thread->entry = entry;
+    thread->arg = arg;
+    thread->handle = CreateThread(NULL, 0, thread_trampoline, thread, 0, NULL);
+    if(!thread->handle)
+    {
+        halc_raise(ERR_THREAD_FAILURE);
+    }
+    return ERR_OK;
+}
+
+void halc_thread_join(struct halc_thread* thread)
+{
+    WaitForSingleObject(thread->handle, INFINITE);
+    CloseHandle(thread->handle);
+}
+
+#else
+
+static void* thread_trampoline(void* param)
+{
+    struct halc_thread* thread = (struct halc_thread*) param;
+    thread->entry(thread->arg);
+    return NULL;
+}
+
+errc halc_thread_start(struct halc_thread* thread, void (*entry)(void* arg), void* arg)
+{
+    thread->entry = entry;
+    thread->arg = arg;
+    if(pthread_create(&thread->handle, NULL, thread_trampoline, thread) != 0)
+    {
+        halc_raise(ERR_THREAD_FAILURE);
+    }
+    return ERR_OK;
+}
+
+void halc_thread_join(struct halc_thread* thread)
+{
+    pthread_join(thread->handle, NULL);
+}
+
+#endif
+
+u32 halc_cpu_count()
+{
+#if defined(_WIN32)
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwNumberOfProcessors > 0 ? (u32) info.dwNumberOfProcessors : 1;
+#else
+    long count = sysconf(_SC_NPROCESSORS_ONLN);
+    return count > 0 ? (u32) count : 1;
+#endif
+}
+
+// ======================= parallel for =================
+
+struct parallel_for_job {
+    volatile i64 next;
+    i64 count;
+    void (*fn)(void* ctx, u32 index);
+    void* ctx;
+};
+
+static void parallel_for_worker(void* arg)
+{
+    struct parallel_for_job* job = (struct parallel_for_job*) arg;
+
+    i64 index;
+    while((index = halc_atomic_add_i64(&job->next, 1)) < job->count)
+    {
+        job->fn(job->ctx, (u32) index);
+    }
+}
+
+errc halc_parallel_for(u32 count, u32 workerCount, void (*fn)(void* ctx, u32 index), void* ctx)
+{
+    struct parallel_for_job job = {0, count, fn, ctx};
+
+    if(workerCount == 0)
+    {
+        workerCount = halc_cpu_count();
+    }
+
+    // no point in more threads than there is work
+    if(workerCount > count)
+    {
+        workerCount = count;
+    }
+
+    struct halc_thread* threads = NULL;
+    u32 threadCount = workerCount > 1 ? workerCount - 1 : 0;
+    u32 started = 0;
+
+    if(threadCount)
+    {
+        halloc(&threads, threadCount * sizeof(struct halc_thread));
+        for(; started < threadCount; started += 1)
+        {
+            if(halc_thread_start(&threads[started], parallel_for_worker, &job) != ERR_OK)
+            {
+                break;
+            }
+        }
+        halc_end_ok;
+    }
+
+    parallel_for_worker(&job);
+
+    for(u32 i = 0; i < started; i += 1)
+    {
+        halc_thread_join(&threads[i]);
+    }
+
+    if(threadCount)
+    {
+        hfree(threads, threadCount * sizeof(struct halc_thread));
+    }
+
+    // fn's errors are its own business, don't pass on whatever it left behind
+    halc_end_ok;
+    halc_end;
+}
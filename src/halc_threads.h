@@ -0,0 +1,134 @@
+#ifndef _HALC_THREADS_H_
+#define _HALC_THREADS_H_
+
+#include "halc_types.h"
+#include "halc_errors.h"
+
+#if defined(_WIN32)
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
+EXTERN_C_BEGIN
+
+// ==================== Atomics ======================
+//
+// relaxed atomics, these are for counters and statistics only.
+// they don't order any other memory, use a mutex for anything that needs to be published.
+
+#if defined(_MSC_VER)
+
+static inline i64 halc_atomic_add_i64(volatile i64* value, i64 amount)
+{
+    return _InterlockedExchangeAdd64((volatile long long*) value, amount);
+}
+
+static inline i64 halc_atomic_load_i64(const volatile i64* value)
+{
+    return *value;
+}
+
+static inline void halc_atomic_store_i64(volatile i64* value, i64 newValue)
+{
+    _InterlockedExchange64((volatile long long*) value, newValue);
+}
+
+static inline b8 halc_atomic_cas_i64(volatile i64* value, i64 expected, i64 desired)
+{
+    return _InterlockedCompareExchange64((volatile long long*) value, desired, expected) == expected;
+}
+
+#else
+
+// returns the value from before the add
+static inline i64 halc_atomic_add_i64(volatile i64* value, i64 amount)
+{
+    return __atomic_fetch_add(value, amount, __ATOMIC_RELAXED);
+}
+
+static inline i64 halc_atomic_load_i64(const volatile i64* value)
+{
+    return __atomic_load_n(value, __ATOMIC_RELAXED);
+}
+
+static inline void halc_atomic_store_i64(volatile i64* value, i64 newValue)
+{
+    __atomic_store_n(value, newValue, __ATOMIC_RELAXED);
+}
+
+static inline b8 halc_atomic_cas_i64(volatile i64* value, i64 expected, i64 desired)
+{
+    return __atomic_compare_exchange_n(value, &expected, desired, FALSE, __ATOMIC_RELAXED, __ATOMIC_RELAXED);
+}
+
+#endif
+
+// raises value to candidate if candidate is larger, used for peak tracking
+static inline void halc_atomic_max_i64(volatile i64* value, i64 candidate)
+{
+    i64 current = halc_atomic_load_i64(value);
+    while(candidate > current)
+    {
+        if(halc_atomic_cas_i64(value, current, candidate))
+        {
+            return;
+        }
+        current = halc_atomic_load_i64(value);
+    }
+}
+
+// ==================== Mutex ======================
+//
+// statically initialize with HALC_MUTEX_INITIALIZER, or call halc_mutex_init.
+struct halc_mutex {
+#if defined(_WIN32)
+    SRWLOCK lock;
+#else
+    pthread_mutex_t lock;
+#endif
+};
+
+#if defined(_WIN32)
+#define HALC_MUTEX_INITIALIZER {SRWLOCK_INIT}
+#else
+#define HALC_MUTEX_INITIALIZER {PTHREAD_MUTEX_INITIALIZER}
+#endif
+
+errc halc_mutex_init(struct halc_mutex* mutex);
+void halc_mutex_lock(struct halc_mutex* mutex);
+void halc_mutex_unlock(struct halc_mutex* mutex);
+void halc_mutex_free(struct halc_mutex* mutex);
+
+// ==================== Threads ======================
+struct halc_thread {
+#if defined(_WIN32)
+    HANDLE handle;
+#else
+    pthread_t handle;
+#endif
+    void (*entry)(void* arg);
+    void* arg;
+};
+
+// the thread struct must stay alive until halc_thread_join returns
+errc halc_thread_start(struct halc_thread* thread, void (*entry)(void* arg), void* arg);
+void halc_thread_join(struct halc_thread* thread);
+
+// number of cpus available to the process, at least 1
+u32 halc_cpu_count();
+
+// ==================== Parallel for ======================
+//
+// runs fn(ctx, i) for every i in [0, count) on a pool of workerCount threads, the
+// calling thread is one of them. Indices are handed out one at a time from a shared
+// counter so uneven work balances itself out. Returns once every index has run, 
+// everything written by fn is visible to the caller by then.
+//
+// workerCount 0 means one per cpu. If threads can't be started the remaining 
+// workers (at least the caller) pick up the slack.
+errc halc_parallel_for(u32 count, u32 workerCount, void (*fn)(void* ctx, u32 index), void* ctx);
+
+EXTERN_C_END
+
+#endif
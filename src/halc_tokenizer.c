@@ -5,6 +5,8 @@
 
 #include "halc_tokenizer.h"
 #include "halc_allocators.h"
+#include "halc_files.h"
+#include "halc_simd.h"
 
 
 errc ts_initialize(struct tokenStream* ts, i32 source_length_hint)
@@ -123,17 +125,37 @@ const hstr Terminals[] = {
     HSTR("'"), // DOUBLE_QUOTE,
 };
 
+// what a byte starts, one load per character instead of trying every terminal.
+// Entries are the token type plus one so a zero (every byte past ascii too) starts
+// nothing. !=, ==, <= and >= start as their first character, see tokenizer_advance.
+#define CC(type) ((type) + 1)
+#define CC_LABEL CC(LABEL)
+
+static const u8 gCharClass[256] = {
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, CC(TAB), CC(NEWLINE), 0, 0, CC(CARRIAGE_RETURN), 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    0, 0, 0, 0, 0, 0, 0, 0,
+    CC(SPACE), CC(EXCLAMATION), CC(DOUBLE_QUOTE), CC(HASHTAG), CC(SPEAKERSIGN), 0, CC(AMPERSAND), CC(QUOTE),
+    CC(L_PAREN), CC(R_PAREN), 0, CC(PLUS), CC(COMMA), CC(MINUS), CC(DOT), 0,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC(COLON), CC(SEMICOLON), CC(L_ANGLE), CC(EQUALS), CC(R_ANGLE), 0,
+    CC(AT), CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC(L_SQBRACK), 0, CC(R_SQBRACK), 0, CC_LABEL,
+    0, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL, CC_LABEL,
+    CC_LABEL, CC_LABEL, CC_LABEL, CC(L_BRACE), 0, CC(R_BRACE), 0, 0,
+};
+
+#undef CC
+#undef CC_LABEL
+
 b8 isAlphaNumeric(char ch)
 {
-    if ((ch >= 'a' && ch <= 'z') || 
-        (ch >= 'A' && ch <= 'Z') ||
-        (ch >= '0' && ch <= '9') ||
-        (ch == '_')
-        )
-    {
-        return TRUE;
-    }
-    return FALSE;
+    return gCharClass[(u8) ch] == LABEL + 1;
 }
 
 // temporary struct created during tokenize()
@@ -151,8 +173,151 @@ struct tokenizer {
     b8 directiveParenCount; // nested directives parentheses count 
     i32 lineNumber; // current line number in source
     i32 state;
+
+    // raw source mode, the normalization hstr_normalize would do happens inline
+    b8 raw;
+    b8 atLineStart;
+    i32 spaceCount; // leading spaces seen so far on this line
+
+    struct symbol_table* symbols; // where LABEL tokens are interned
+    struct token_ring* ring; // stream_tokenizer only, tokens go here instead of ts
 };
 
+// a stream_tokenizer makes sure the ring has room for this many tokens before each 
+// tokenizer_advance, so a full ring never has to be dealt with mid token.
+#define TOKENIZER_MAX_TOKENS_PER_ADVANCE 2
+
+static errc tokenizer_emit(struct tokenizer* t, struct token* tok)
+{
+    if(t->ring)
+    {
+        struct token_ring* ring = t->ring;
+        halc_assert(ring->len < ring->capacity);
+        ring->tokens[(ring->head + ring->len) % ring->capacity] = *tok;
+        ring->len += 1;
+        halc_end;
+    }
+
+    halc_try(ts_push(t->ts, tok));
+    halc_end;
+}
+
+errc ts_print_token_inner(const struct tokenStream* ts, struct token tok, b8 dryRun, const char* color);
+
+static void tokenizer_print_last_token(struct tokenizer* t, const char* message)
+{
+    if(t->ring)
+    {
+        if(t->ring->len > 0)
+        {
+            // stand in stream so the token is shown against the window it came from
+            struct tokenStream window;
+            window.source = *t->source;
+            window.filename = *t->filename;
+
+            fprintf(stderr, "%s", message);
+            ts_print_token_inner(&window, t->ring->tokens[(t->ring->head + t->ring->len - 1) % t->ring->capacity], FALSE, RED_S);
+        }
+        return;
+    }
+
+    if(t->ts->len > 0)
+    {
+        fprintf(stderr, "%s", message);
+        ts_print_token(t->ts, t->ts->len - 1, FALSE, RED_S);
+    }
+}
+
+// raw source mode only, runs before a character is tokenized.
+// \r is dropped, every 4th leading space gives a TAB token spanning the last 4, and
+// indentation that isn't a multiple of 4 raises once it ends. sets consumed if the 
+// character was used up.
+static errc tokenizer_raw_prelude(struct tokenizer* t, b8* consumed)
+{
+    *consumed = FALSE;
+
+    if(t->atLineStart)
+    {
+        if(*t->r == ' ')
+        {
+            t->spaceCount += 1;
+            if(t->spaceCount % 4 == 0)
+            {
+                struct token tab = { TAB, {(char*) t->r - 3, 4}, t->lineNumber };
+                halc_try(tokenizer_emit(t, &tab));
+            }
+            *consumed = TRUE;
+            halc_end;
+        }
+
+        if(*t->r != '\t')
+        {
+            t->atLineStart = FALSE;
+            if(t->spaceCount % 4 != 0)
+            {
+                if(!is_supressed_errors())
+                {
+                    fprintf(stderr, RED("inconsistent spacing count for tabbing, we need a tab value of 4") " %.*s:%d\n",
+                            t->filename->len, t->filename->buffer, t->lineNumber);
+                }
+                halc_raise(ERR_INCONSISTENT_FILE_FORMAT);
+            }
+            t->spaceCount = 0;
+        }
+    }
+
+    if(*t->r == '\r')
+    {
+        *consumed = TRUE;
+    }
+
+    halc_end;
+}
+
+// story text and comments are most of a file and run to the end of their line, 
+// so they're scanned a block at a time. Both return end when nothing stops them.
+
+// the next \n or \r, or # as well when stopAtHash is set
+static const char* tokenizer_scan_line(const char* p, const char* end, b8 stopAtHash)
+{
+    while(p + HALC_SIMD_WIDTH <= end)
+    {
+        u32 mask = halc_simd_eq_mask(p, '\n') | halc_simd_eq_mask(p, '\r');
+        if(stopAtHash)
+        {
+            mask |= halc_simd_eq_mask(p, '#');
+        }
+
+        if(mask)
+        {
+            return p + halc_ctz32(mask);
+        }
+        p += HALC_SIMD_WIDTH;
+    }
+
+    while(p < end && *p != '\n' && *p != '\r' && !(stopAtHash && *p == '#')) p++;
+    return p;
+}
+
+// the first byte that can't be part of a label
+static const char* tokenizer_scan_label(const char* p, const char* end)
+{
+    const u32 all = (u32) (((u64) 1 << HALC_SIMD_WIDTH) - 1);
+
+    while(p + HALC_SIMD_WIDTH <= end)
+    {
+        u32 mask = halc_simd_label_mask(p);
+        if(mask != all)
+        {
+            return p + halc_ctz32(~mask);
+        }
+        p += HALC_SIMD_WIDTH;
+    }
+
+    while (p < end && gCharClass[(u8) *p] == LABEL + 1) p++;
+    return p;
+}
+
 errc tokenizer_advance(struct tokenizer* t)
 {
     b8 shouldBreak = FALSE;
@@ -160,16 +325,25 @@ errc tokenizer_advance(struct tokenizer* t)
     const hstr* filename = t->filename;
     const hstr* source = t->source;
 
+    if(t->raw)
+    {
+        halc_try(tokenizer_raw_prelude(t, &shouldBreak));
+        if(shouldBreak)
+        {
+            t->r += 1;
+            halc_end;
+        }
+    }
+
     // comment clause
     if(*t->r == '#' && !shouldBreak)
     {
-        t->c = t->r;
-        while(*t->c != '\n' && t->c < t->rEnd) t->c++;
+        t->c = tokenizer_scan_line(t->r, t->rEnd, FALSE);
 
         hstr view = {(char*) t->r, (u32)(t->c - t->r)};
 
         struct token newToken = {COMMENT, view, t->lineNumber};
-        halc_try(ts_push(t->ts, &newToken));
+        halc_try(tokenizer_emit(t, &newToken));
         t->r += view.len - 1;
         shouldBreak = TRUE;
     }
@@ -179,80 +353,97 @@ errc tokenizer_advance(struct tokenizer* t)
         if (*t->r == ':')
         {
             struct token nt = { COLON, {(char*)t->r, 1}, t->lineNumber };
-            halc_try(ts_push(t->ts, &nt));
+            halc_try(tokenizer_emit(t, &nt));
         }
         if (*t->r == '>')
         {
             struct token nt = { R_ANGLE, {(char*)t->r, 1}, t->lineNumber };
-            halc_try(ts_push(t->ts, &nt));
+            halc_try(tokenizer_emit(t, &nt));
         }
         t->r += 1;
 
-        while (*t->r == ' ') t->r++;
+        while (t->r < t->rEnd && *t->r == ' ') t->r++;
 
-        t->c = t->r;
-        while (*t->c != '\n' && *t->c != '#' && t->c < t->rEnd) t->c++;
+        // up to the line break or a comment, less the spaces in front of it. Never 
+        // reads outside the source, mapped and packed files have no terminator
+        t->c = tokenizer_scan_line(t->r, t->rEnd, TRUE);
 
-        t->c--;
-
-        while (*t->c == ' ') t->c--;
-
-        t->c++;
+        while (t->c > t->r && t->c[-1] == ' ') t->c--;
 
         hstr view = { (char*) t->r, (u32)(t->c - t->r)};
         struct token newToken = { STORY_TEXT, view, t->lineNumber };
-        halc_try(ts_push(t->ts, &newToken));
+        halc_try(tokenizer_emit(t, &newToken));
         t->r += view.len;
         if (t->r > t->rEnd)
         {
             if(!is_supressed_errors())
             {
                 fprintf(stderr, RED("Tokenizer pointer overflow: \n"));
-                if(t->ts->len > 0)
-                {
-                    fprintf(stderr, "Last token parsed: ");
-                    ts_print_token(t->ts, t->ts->len - 1, FALSE, RED_S);
-                }
+                tokenizer_print_last_token(t, "Last token parsed: ");
             }
             halc_raise(ERR_TOKENIZER_POINTER_OVERFLOW);
         }
-        while (*t->r == ' ') t->r++;
+        while (t->r < t->rEnd && *t->r == ' ') t->r++;
         t->r--;
         shouldBreak = TRUE;
     }
 
-    // terminals clause
+    // terminals and labels
     if (!shouldBreak) {
-        for (i32 i = 0; i < arrayCount(Terminals); i += 1)
+        i32 type = (i32) gCharClass[(u8) *t->r] - 1;
+        u32 len = 1;
+
+        switch(type)
         {
-            // build a view based on the current character and look ahead.
-            hstr view = { (char*) t->r, Terminals[i].len };
+            case -1:
+                break;
 
-            // clamp it so we don't look at the null terminator or look past the end.
-            if(view.buffer + view.len >= t->rEnd) 
+            case LABEL:
             {
-                view.len = (u32) (t->rEnd - view.buffer);
+                t->c = tokenizer_scan_label(t->r + 1, t->rEnd);
+
+                hstr view = { (char*) t->r, (u32)(t->c - t->r)};
+                struct token newToken = { LABEL, view, t->lineNumber };
+                halc_try(symbol_intern(t->symbols, &view, &newToken.symbol));
+
+                halc_try(tokenizer_emit(t, &newToken));
+                t->r += view.len - 1;
+                shouldBreak = TRUE;
+                break;
             }
 
-            if(hstr_match(&view, &Terminals[i]))
+            case EXCLAMATION:
+            case EQUALS:
+            case L_ANGLE:
+            case R_ANGLE:
+                // the two character terminals
+                if(t->r + 1 < t->rEnd && t->r[1] == '=')
+                {
+                    type = type == EXCLAMATION ? NOT_EQUIV : 
+                        type == EQUALS ? EQUIV : 
+                        type == L_ANGLE ? LESS_EQ : GREATER_EQ;
+                    len = 2;
+                }
+                // fallthrough
+
+            default:
             {
-                struct token newToken = {i, view, t->lineNumber};
-                t->r += Terminals[i].len - 1;
+                struct token newToken = {(enum tokenType) type, {(char*) t->r, len}, t->lineNumber};
+                t->r += len - 1;
 
-                halc_try(ts_push(t->ts, &newToken));
+                halc_try(tokenizer_emit(t, &newToken));
 
-                if(i == NEWLINE)
+                if(type == NEWLINE)
                 {
                     t->directiveParenCount = 0;
                     t->lineNumber += 1;
+                    t->atLineStart = t->raw;
                 }
-
-                if (i == L_PAREN)
+                else if (type == L_PAREN)
                 {
                     t->directiveParenCount += 1;
                 }
-
-                if (i == R_PAREN)
+                else if (type == R_PAREN)
                 {
                     t->directiveParenCount -= 1;
                 }
@@ -262,30 +453,12 @@ errc tokenizer_advance(struct tokenizer* t)
         }
     }
 
-    // try to build a label instead
-    if (!shouldBreak && isAlphaNumeric(*t->r))
-    {
-        t->c = t->r;
-        while (t->c < t->rEnd && isAlphaNumeric(*t->c)) t->c++;
-
-        hstr view = { (char*) t->r, (u32)(t->c - t->r)};
-        struct token newToken = { LABEL, view, t->lineNumber };
-
-        halc_try(ts_push(t->ts, &newToken));
-        t->r += view.len - 1;
-        shouldBreak = TRUE;
-    }
-
     if (!shouldBreak)
     {
         if(!is_supressed_errors())
         {
             fprintf(stderr, RED("Unrecognized token: \n"));
-            if(t->ts->len > 0)
-            {
-                fprintf(stderr, "Last token parsed\n");
-                ts_print_token(t->ts, t->ts->len - 1, FALSE, RED_S);
-            }
+            tokenizer_print_last_token(t, "Last token parsed\n");
         }
         halc_raise(ERR_UNRECOGNIZED_TOKEN);
     }
@@ -297,12 +470,41 @@ errc tokenizer_advance(struct tokenizer* t)
 }
 
 errc tokenize(struct tokenStream* ts, const hstr* source, const hstr* filename)
+{
+    halc_try(tokenize_with_symbols(ts, source, filename, NULL));
+    halc_end;
+}
+
+static errc tokenize_source(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols, b8 raw);
+
+errc tokenize_with_symbols(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols)
+{
+    halc_try(tokenize_source(ts, source, filename, symbols, FALSE));
+    halc_end;
+}
+
+errc tokenize_raw(struct tokenStream* ts, const hstr* rawSource, const hstr* filename, struct symbol_table* symbols)
+{
+    halc_try(tokenize_source(ts, rawSource, filename, symbols, TRUE));
+    halc_end;
+}
+
+static errc tokenize_source(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols, b8 raw)
 {
     track_allocs("ts_initialize");
     halc_try(ts_initialize(ts, source->len));
     ts->source = *source;
     ts->filename = *filename;
 
+    ts->symbols = symbols;
+    ts->ownsSymbols = FALSE;
+    if(!symbols)
+    {
+        halloc_cleanup(&ts->symbols, sizeof(struct symbol_table));
+        ts->ownsSymbols = TRUE;
+        halc_tryCleanup(symbol_table_init(ts->symbols));
+    }
+
     struct tokenizer t;
 
     t.ts = ts;
@@ -318,6 +520,13 @@ errc tokenize(struct tokenStream* ts, const hstr* source, const hstr* filename)
     t.lineNumber = 1;
     t.directiveParenCount = 0;
 
+    t.raw = raw;
+    t.atLineStart = raw;
+    t.spaceCount = 0;
+
+    t.symbols = ts->symbols;
+    t.ring = NULL;
+
     while(t.r < t.rEnd)
     {
         halc_tryCleanup(tokenizer_advance(&t));
@@ -334,6 +543,231 @@ void ts_free(struct tokenStream* ts)
 {
     if(ts->capacity > 0)
         hfree(ts->tokens, sizeof(struct token) * ts->capacity);
+    ts->capacity = 0;
+    ts->len = 0;
+
+    if(ts->ownsSymbols)
+    {
+        symbol_table_free(ts->symbols);
+        hfree(ts->symbols, sizeof(struct symbol_table));
+        ts->ownsSymbols = FALSE;
+    }
+}
+
+// ==================== Streaming tokenizer ======================
+
+#define STREAM_TOKENIZER_MIN_RING_CAPACITY 16
+
+// the partial line left over from the last chunk moves to the front of the window
+// and the next chunk is read in after it. Only called with the ring empty, moving 
+// the window invalidates every view into it.
+static errc stream_tokenizer_refill(struct stream_tokenizer* st)
+{
+    struct tokenizer* t = st->tokenizer;
+
+    u32 carry = (u32)(st->window + st->windowView.len - t->r);
+    memmove(st->window, t->r, carry);
+
+    // a line longer than the window grows it, +1 keeps room for the terminator
+    if(carry + st->chunkSize > st->windowCap)
+    {
+        u32 newCap = carry + st->chunkSize;
+        hrealloc(&st->window, st->windowCap + 1, newCap + 1, FALSE);
+        st->windowCap = newCap;
+    }
+
+    usize bytesRead = fread(st->window + carry, 1, st->chunkSize, st->file);
+    if(bytesRead < st->chunkSize)
+    {
+        if(ferror(st->file))
+        {
+            if(!is_supressed_errors())
+            {
+                fprintf(stderr, "\n  Error reading file: %.*s\n", st->filename.len, st->filename.buffer);
+            }
+            halc_raise(ERR_FILE_READ_ERROR);
+        }
+        st->eof = TRUE;
+    }
+
+    u32 windowLen = carry + (u32) bytesRead;
+    st->window[windowLen] = 0;
+    st->windowView.buffer = st->window;
+    st->windowView.len = windowLen;
+
+    // only whole lines get tokenized until the end of the file
+    u32 end = windowLen;
+    if(!st->eof)
+    {
+        while(end > 0 && st->window[end - 1] != '\n') end -= 1;
+    }
+
+    // none of the bytes up to end have been checked yet, the carried ones were past 
+    // the last end
+    hstr lines = {st->window, end, -1};
+    struct utf8_error utf8Error;
+    if(hstr_validate_utf8(&lines, &utf8Error) != ERR_OK)
+    {
+        if(!is_supressed_errors())
+        {
+            fprintf(stderr, "\n  %.*s:%d: invalid utf8\n", st->filename.len, st->filename.buffer, 
+                t->lineNumber + utf8Error.lineNumber - 1);
+        }
+        halc_raise(ERR_STR_INVALID_UTF8);
+    }
+
+    t->r = st->window;
+    t->rEnd = st->window + end;
+
+    halc_end;
+}
+
+errc stream_tokenizer_open_file(struct stream_tokenizer* st, FILE* file, const hstr* filename, u32 chunkSize, u32 ringCapacity, struct symbol_table* symbols)
+{
+    if(!chunkSize)
+    {
+        chunkSize = STREAM_TOKENIZER_DEFAULT_CHUNK_SIZE;
+    }
+
+    if(!ringCapacity)
+    {
+        ringCapacity = STREAM_TOKENIZER_DEFAULT_RING_CAPACITY;
+    }
+
+    if(ringCapacity < STREAM_TOKENIZER_MIN_RING_CAPACITY)
+    {
+        ringCapacity = STREAM_TOKENIZER_MIN_RING_CAPACITY;
+    }
+
+    memset(st, 0, sizeof(*st));
+    st->file = file;
+    st->filename = *filename;
+    st->chunkSize = chunkSize;
+    st->windowCap = chunkSize;
+
+    halloc_cleanup(&st->window, st->windowCap + 1);
+    st->window[0] = 0;
+    st->windowView.buffer = st->window;
+    st->windowView.cap = -1;
+
+    halloc_cleanup(&st->ring.tokens, ringCapacity * sizeof(struct token));
+    st->ring.capacity = ringCapacity;
+
+    st->symbols = symbols;
+    if(!symbols)
+    {
+        halloc_cleanup(&st->symbols, sizeof(struct symbol_table));
+        st->ownsSymbols = TRUE;
+        halc_tryCleanup(symbol_table_init(st->symbols));
+    }
+
+    halloc_cleanup(&st->tokenizer, sizeof(struct tokenizer));
+    struct tokenizer* t = st->tokenizer;
+    memset(t, 0, sizeof(*t));
+    t->source = &st->windowView;
+    t->filename = &st->filename;
+    t->r = st->window;
+    t->rEnd = st->window;
+    t->state = TOK_MODE_DEFAULT;
+    t->lineNumber = 1;
+    t->raw = TRUE;
+    t->atLineStart = TRUE;
+    t->symbols = st->symbols;
+    t->ring = &st->ring;
+
+    halc_end;
+
+cleanup:
+    stream_tokenizer_close(st);
+    halc_end;
+}
+
+errc stream_tokenizer_open(struct stream_tokenizer* st, const hstr* filePath, u32 chunkSize, u32 ringCapacity, struct symbol_table* symbols)
+{
+    FILE* file = h_fopen(filePath->buffer, "rb");
+    if(!file)
+    {
+        fprintf(stderr, "\n  Unable to open file: %s\n", filePath->buffer);
+        halc_raise(ERR_UNABLE_TO_OPEN_FILE);
+    }
+
+    if(stream_tokenizer_open_file(st, file, filePath, chunkSize, ringCapacity, symbols) != ERR_OK)
+    {
+        fclose(file);
+        halc_end;
+    }
+    st->ownsFile = TRUE;
+
+    halc_end;
+}
+
+errc stream_tokenizer_next(struct stream_tokenizer* st, struct token* outToken, b8* outDone)
+{
+    struct tokenizer* t = st->tokenizer;
+    struct token_ring* ring = &st->ring;
+    *outDone = FALSE;
+
+    while(ring->len == 0)
+    {
+        if(t->r < t->rEnd)
+        {
+            // tokenize as much as fits, views into the window stay valid until the ring drains
+            while(t->r < t->rEnd && ring->capacity - ring->len >= TOKENIZER_MAX_TOKENS_PER_ADVANCE)
+            {
+                halc_try(tokenizer_advance(t));
+            }
+            continue;
+        }
+
+        if(st->eof)
+        {
+            *outDone = TRUE;
+            halc_end;
+        }
+
+        halc_try(stream_tokenizer_refill(st));
+    }
+
+    *outToken = ring->tokens[ring->head];
+    ring->head = (ring->head + 1) % ring->capacity;
+    ring->len -= 1;
+
+    halc_end;
+}
+
+void stream_tokenizer_close(struct stream_tokenizer* st)
+{
+    if(st->window)
+    {
+        hfree(st->window, st->windowCap + 1);
+        st->window = NULL;
+    }
+
+    if(st->ring.tokens)
+    {
+        hfree(st->ring.tokens, st->ring.capacity * sizeof(struct token));
+        st->ring.tokens = NULL;
+    }
+
+    if(st->tokenizer)
+    {
+        hfree(st->tokenizer, sizeof(struct tokenizer));
+        st->tokenizer = NULL;
+    }
+
+    if(st->ownsSymbols)
+    {
+        symbol_table_free(st->symbols);
+        hfree(st->symbols, sizeof(struct symbol_table));
+        st->ownsSymbols = FALSE;
+    }
+
+    if(st->ownsFile)
+    {
+        fclose(st->file);
+        st->ownsFile = FALSE;
+    }
+    st->file = NULL;
 }
 
 errc tok_get_sourceline(const struct token* tok, const hstr* source, hstr* out, struct tok_view* offsets)
@@ -400,43 +834,66 @@ errc ts_print_token_inner(const struct tokenStream* ts, struct token tok, b8 dry
 
     printf("token at: %.*s \n", ts->filename.len, ts->filename.buffer);
 
-    printf("line %6d: ", tok.lineNumber);
+    // the source line and the marker line under it are assembled on the scratch 
+    // stack and written out together. tabs expand to at most 4 characters.
+    struct arena_mark mark;
+    scratch_begin(&mark);
+
+    usize colorLen = strlen(color);
+    usize markerLen = (usize)(offsets.tok_end - offsets.tok_start + 1) * 4;
+    usize lineCap = (usize) sl.len * 4 + (usize) offsets.tok_start * 4 + markerLen + colorLen + sizeof(RESET_S) + 64;
+
+    char* line;
+    halc_tryCleanup(scratch_alloc((void**) &line, lineCap));
+
+    char* w = line + snprintf(line, lineCap, "line %6d: ", tok.lineNumber);
 
     for(u32 j = 0; j < sl.len; j += 1)
     {
         if(sl.buffer[j] == '\t')
         {
-            printf("-->|");
+            memcpy(w, "-->|", 4);
+            w += 4;
         }
         else
         {
-            putchar(sl.buffer[j]);
+            *w++ = sl.buffer[j];
         }
     }
 
-    printf("\n             ");
+    memcpy(w, "\n             ", 14);
+    w += 14;
 
     for (i32 i = 0; i < offsets.tok_start; i++)
     {
         if(sl.buffer[i] == '\t')
         {
-            printf("   ");
+            memcpy(w, "   ", 3);
+            w += 3;
         }
-        printf(" ");
+        *w++ = ' ';
     }
 
-    printf("%s", color);
+    memcpy(w, color, colorLen);
+    w += colorLen;
     for (i32 i = offsets.tok_start; i <= offsets.tok_end; i++)
     {
         if(sl.buffer[i] == '\t')
         {
-            printf("^^^");
+            memcpy(w, "^^^", 3);
+            w += 3;
         }
-        printf("^");
+        *w++ = '^';
     }
-    printf(RESET_S);
+    memcpy(w, RESET_S, sizeof(RESET_S) - 1);
+    w += sizeof(RESET_S) - 1;
+
+    fwrite(line, 1, (usize)(w - line), stdout);
 
     printf("%s(%d)\n",tokenTypeStrings[tok.tokenType], tok.tokenType);
+
+cleanup:
+    scratch_end(&mark);
     halc_end;
 }
 
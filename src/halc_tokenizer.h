@@ -1,8 +1,11 @@
 #ifndef _HALC_TOKENIZER_H_
 #define _HALC_TOKENIZER_H_
 
+#include <stdio.h>
+
 #include "halc_types.h"
 #include "halc_strings.h"
+#include "halc_symbols.h"
 
 EXTERN_C_BEGIN
 
@@ -48,6 +51,7 @@ struct token {
     enum tokenType tokenType;
     hstr tokenView;
     i32 lineNumber;
+    u32 symbol; // interned text of LABEL tokens, HALC_SYM_NONE for everything else
 };
 
 // a list of the entire source as a list of tokens
@@ -60,6 +64,9 @@ struct tokenStream {
     i32 capacity; //4
 
     hstr filename; // 16
+
+    struct symbol_table* symbols; // 8
+    b8 ownsSymbols;
 };
 
 struct iter {
@@ -76,6 +83,17 @@ struct tok_view {
 // creates a tokenstream from a a source file
 errc tokenize(struct tokenStream* ts, const hstr* source, const hstr* filename);
 
+// interns labels into a table shared with other streams, eg. every file in a region.
+// the table must outlive the stream. tokenize() gives each stream a table of its own.
+errc tokenize_with_symbols(struct tokenStream* ts, const hstr* source, const hstr* filename, struct symbol_table* symbols);
+
+// tokenizes the bytes of a file as they were loaded, without hstr_normalize'ing them first.
+// \r is dropped, every 4 leading spaces become a TAB token (whose view is the spaces) and 
+// indentation that isn't a multiple of 4 raises ERR_INCONSISTENT_FILE_FORMAT, same as 
+// hstr_normalize. saves a full pass and a file sized copy per file. 
+// symbols can be NULL to give the stream a table of its own.
+errc tokenize_raw(struct tokenStream* ts, const hstr* rawSource, const hstr* filename, struct symbol_table* symbols);
+
 errc ts_initialize(struct tokenStream* ts, i32 source_length_hint);
 
 errc ts_resize(struct tokenStream* ts);
@@ -104,6 +122,74 @@ const char* ts_get_token_as_buffer(const struct tokenStream* ts, const i32 index
 
 const struct token* ts_get_tok(const struct tokenStream* ts, i32 index);
 
+// ==================== Streaming tokenizer ======================
+//
+// tokenizes a file of any size with memory proportional to the chunk size instead of
+// the file size. The file is read chunkSize bytes at a time, only whole lines are 
+// tokenized and the partial line at the end of a chunk is carried over into the next
+// one. Tokens go into a fixed size ring that stream_tokenizer_next drains. 
+//
+// the input is treated like tokenize_raw treats it: \r is dropped and leading spaces
+// become TABs. Each chunk is checked for valid utf8 as it's read.
+//
+// a token's view points into the chunk window, it's only guaranteed to stay valid until
+// the next call to stream_tokenizer_next, copy it (or keep the LABEL's symbol) to hold 
+// on to it. The window grows to fit the longest line, and the symbol table grows with
+// the number of distinct labels, everything else is fixed when the stream is opened.
+//
+// eg.
+//
+//  struct stream_tokenizer st;
+//  halc_try(stream_tokenizer_open(&st, &filePath, 0, 0, NULL));
+//  struct token tok;
+//  b8 done;
+//  while(stream_tokenizer_next(&st, &tok, &done) == ERR_OK && !done) { ... }
+//  stream_tokenizer_close(&st);
+//
+
+#define STREAM_TOKENIZER_DEFAULT_CHUNK_SIZE (64 * 1024)
+#define STREAM_TOKENIZER_DEFAULT_RING_CAPACITY 1024
+
+struct token_ring {
+    struct token* tokens;
+    u32 capacity;
+    u32 head; // oldest token
+    u32 len;
+};
+
+struct tokenizer; // tokenizer state carried from chunk to chunk
+
+struct stream_tokenizer {
+    FILE* file;
+    b8 ownsFile;
+    hstr filename;
+    b8 eof;
+
+    char* window;      // carried partial line followed by the latest chunk
+    u32 windowCap;
+    u32 chunkSize;
+    hstr windowView;   // the bytes currently in the window
+
+    struct token_ring ring;
+    struct tokenizer* tokenizer;
+
+    struct symbol_table* symbols;
+    b8 ownsSymbols;
+};
+
+// chunkSize and ringCapacity can be 0 for the defaults, symbols can be NULL to give 
+// the stream a table of its own.
+errc stream_tokenizer_open(struct stream_tokenizer* st, const hstr* filePath, u32 chunkSize, u32 ringCapacity, struct symbol_table* symbols);
+
+// streams from a file that's already open, eg. a pipe. The file is read from its current 
+// position and isn't closed by stream_tokenizer_close.
+errc stream_tokenizer_open_file(struct stream_tokenizer* st, FILE* file, const hstr* filename, u32 chunkSize, u32 ringCapacity, struct symbol_table* symbols);
+
+// pops the next token, sets done instead once the whole file has been tokenized
+errc stream_tokenizer_next(struct stream_tokenizer* st, struct token* outToken, b8* outDone);
+
+void stream_tokenizer_close(struct stream_tokenizer* st);
+
 EXTERN_C_END
 
 #endif
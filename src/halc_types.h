@@ -23,6 +23,9 @@ typedef unsigned char u8;
 typedef int i32;
 typedef unsigned int u32;
 
+typedef float f32;
+typedef double f64;
+
 #ifdef __linux__
 
 typedef long i64;
@@ -46,6 +49,15 @@ typedef unsigned long long usize;
 
 #endif
 
+// storage that is private to each thread, eg. allocator tracking contexts
+#if defined(__cplusplus)
+#define HALC_THREAD_LOCAL thread_local
+#elif defined(_MSC_VER)
+#define HALC_THREAD_LOCAL __declspec(thread)
+#else
+#define HALC_THREAD_LOCAL __thread
+#endif
+
 #ifndef __func__
 #define __func__ __FUNCTION__
 #endif
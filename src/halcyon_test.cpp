@@ -2,6 +2,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <inttypes.h>
+#include <math.h>
 
 #include "halc_types.h"
 #include "halc_errors.h"
@@ -10,6 +11,12 @@
 #include "halc_strings.h"
 #include "halc_tokenizer.h"
 #include "halc_parser.h"
+#include "halc_threads.h"
+#include "halc_hash.h"
+#include "halc_region.h"
+#include "halc_cache.h"
+#include "halc_story.h"
+#include "halc_pack.h"
 #include "halcyon.h"
 
 #ifndef NO_TESTS
@@ -319,6 +326,7 @@ static errc test_parser_directives()
     halc_end;
 }
 
+#include <algorithm>
 #include <chrono>
 #include <iostream>
 
@@ -411,21 +419,2348 @@ errc test_parser_story_simple()
     halc_end;
 }
 
+// compiles the same file repeatedly inside one arena, the way a content reload would
+static errc test_arena_compile()
+{
+    halc_set_parser_noprint();
+    const hstr filename = HSTR("testfiles/stress_easy.halc");
+
+    hstr fileContents;
+    halc_try(load_and_decode_from_file(&fileContents, &filename));
+
+    struct arena compileArena;
+    halc_try(arena_init(&compileArena, 0));
+
+    for(i32 i = 0; i < 8; i += 1)
+    {
+        struct tokenStream ts;
+        struct s_graph graph;
+
+        arena_push(&compileArena);
+        errc result = tokenize(&ts, &fileContents, &filename);
+        if(result == ERR_OK)
+            result = parse_tokens(&graph, &ts);
+        if(result == ERR_OK)
+            result = graph_init(&graph);
+        arena_pop();
+
+        halc_tryCleanup(result);
+        halc_assertCleanup(compileArena.used > 0);
+
+        arena_reset(&compileArena);
+        halc_assertCleanup(compileArena.used == 0);
+    }
+
+    // after the first reset, the whole compile should fit in a single block
+    halc_assertCleanup(compileArena.blockCount <= 1);
+    halc_assertCleanup(compileArena.peakUsed > 0);
+
+cleanup:
+    arena_free(&compileArena);
+    hstr_free(&fileContents);
+    halc_end;
+}
+
+// counting allocator used to check that every callback in the allocator vtable is honored
+struct counting_allocator_ctx {
+    i32 mallocs;
+    i32 reallocs;
+    i32 alignedAllocs;
+    i32 frees;
+};
+
+static void* counting_malloc(void* ctx, size_t size)
+{
+    ((counting_allocator_ctx*) ctx)->mallocs += 1;
+    return malloc(size);
+}
+
+static void* counting_realloc(void* ctx, void* ptr, size_t size, size_t newSize)
+{
+    ((counting_allocator_ctx*) ctx)->reallocs += 1;
+    return realloc(ptr, newSize);
+}
+
+#if !defined(_WIN32)
+// _aligned_malloc memory can't go through free(), so windows only tests the fallback
+static void* counting_aligned_alloc(void* ctx, size_t size, size_t alignment)
+{
+    ((counting_allocator_ctx*) ctx)->alignedAllocs += 1;
+    void* ptr = NULL;
+    if(posix_memalign(&ptr, alignment, size) != 0)
+    {
+        return NULL;
+    }
+    return ptr;
+}
+#endif
+
+static void counting_free(void* ctx, void* ptr, size_t size)
+{
+    ((counting_allocator_ctx*) ctx)->frees += 1;
+    free(ptr);
+}
+
+static errc test_custom_allocator()
+{
+    counting_allocator_ctx counts = {};
+    struct allocator custom = {};
+    i32* numbers = NULL;
+    void* aligned = NULL;
+    void* fallbackAligned = NULL;
+    i32 alignedAllocs = 0;
+
+    custom.ctx = &counts;
+    custom.malloc_fn = counting_malloc;
+    custom.realloc_fn = counting_realloc;
+    custom.free_fn = counting_free;
+#if !defined(_WIN32)
+    custom.aligned_alloc_fn = counting_aligned_alloc;
+    alignedAllocs = 1;
+#endif
+
+    halc_try(setup_default_custom_allocator(&custom));
+
+    halloc_cleanup(&numbers, 16 * sizeof(i32));
+    halc_tryCleanup(hrealloc_advanced((void**) &numbers, 16 * sizeof(i32), 64 * sizeof(i32), FALSE, __FILE__, __LINE__, __func__));
+    numbers[63] = 63;
+    hfree(numbers, 64 * sizeof(i32));
+
+    halc_tryCleanup(halloc_aligned_advanced(&aligned, 100, 64, __FILE__, __LINE__, __func__));
+    hfree_aligned(aligned, 100, 64);
+
+    // without aligned_alloc_fn we fall back to carving it out of malloc_fn
+    custom.aligned_alloc_fn = NULL;
+    halc_tryCleanup(setup_default_custom_allocator(&custom));
+    halc_tryCleanup(halloc_aligned_advanced(&fallbackAligned, 100, 256, __FILE__, __LINE__, __func__));
+    hfree_aligned(fallbackAligned, 100, 256);
+
+    halc_assertCleanup(counts.mallocs == 3 - alignedAllocs);
+    halc_assertCleanup(counts.reallocs == 1);
+    halc_assertCleanup(counts.alignedAllocs == alignedAllocs);
+    halc_assertCleanup(counts.frees == 3);
+    halc_assertCleanup(((usize) aligned & 63) == 0);
+    halc_assertCleanup(((usize) fallbackAligned & 255) == 0);
+
+    // the tests after this one run on the default allocator, pass or fail
+cleanup:
+    setup_default_allocator();
+    halc_end;
+}
+
+static errc test_pool_allocator()
+{
+    struct pool pool;
+    halc_try(pool_init(&pool, sizeof(struct anode), 16));
+
+    struct anode* first = NULL;
+    u32 index = 0;
+
+    // indexed allocations across several slabs keep their addresses
+    for(u32 i = 0; i < 100; i += 1)
+    {
+        struct anode* node;
+        halc_tryCleanup(pool_alloc_indexed(&pool, (void**) &node, &index));
+        halc_assertCleanup(index == i);
+        node->index = (i32) i;
+        if(i == 0)
+        {
+            first = node;
+        }
+    }
+
+    halc_assertCleanup(pool.slabsLen == 7);
+    halc_assertCleanup(first == pool_at(&pool, 0));
+    for(u32 i = 0; i < 100; i += 1)
+    {
+        halc_assertCleanup(((struct anode*) pool_at(&pool, i))->index == (i32) i);
+    }
+
+    {
+        // released slots get recycled before the pool grows
+        void* released = pool_at(&pool, 42);
+        pool_release(&pool, released);
+        halc_assertCleanup(pool.liveCount == 99);
+
+        void* recycled;
+        halc_tryCleanup(pool_alloc(&pool, &recycled));
+        halc_assertCleanup(recycled == released);
+        halc_assertCleanup(pool.len == 100);
+    }
+
+cleanup:
+    pool_free(&pool);
+    halc_end;
+}
+
+static errc test_allocation_profiler()
+{
+    b8 wasProfiling = allocation_profiling_enabled();
+    halc_try(enable_allocation_profiling());
+
+    void* blocks[10];
+    for(i32 i = 0; i < 10; i += 1)
+    {
+        halloc(&blocks[i], 32);
+    }
+
+    hrealloc(&blocks[0], 32, 128, FALSE);
+
+    for(i32 i = 0; i < 10; i += 1)
+    {
+        hfree(blocks[i], i == 0 ? 128 : 32);
+    }
+
+    {
+        // this function has exactly two sites, the halloc in the loop and the hrealloc
+        const struct alloc_site_stats* allocSite = NULL;
+        const struct alloc_site_stats* reallocSite = NULL;
+
+        const struct alloc_site_stats* sites;
+        u32 siteCount = allocation_profile_sites(&sites);
+        for(u32 i = 0; i < siteCount; i += 1)
+        {
+            if(strcmp(sites[i].func, __func__))
+            {
+                continue;
+            }
+
+            if(sites[i].reallocCount)
+            {
+                reallocSite = &sites[i];
+            }
+            else
+            {
+                allocSite = &sites[i];
+            }
+        }
+        halc_assertCleanup(allocSite && reallocSite);
+
+        halc_assertCleanup(allocSite->allocCount == 10);
+        halc_assertCleanup(allocSite->freeCount == 9);
+        halc_assertCleanup(allocSite->peakLiveBytes == 320);
+        halc_assertCleanup(allocSite->liveBytes == 0);
+
+        // the realloc'd block belongs to the realloc site from then on
+        halc_assertCleanup(reallocSite->reallocCount == 1);
+        halc_assertCleanup(reallocSite->reallocBytes == 128);
+        halc_assertCleanup(reallocSite->freeCount == 1);
+        halc_assertCleanup(reallocSite->liveBytes == 0);
+
+        FILE* report = tmpfile();
+        halc_assertCleanup(report);
+        errc reportResult = write_allocation_report(report, ALLOC_REPORT_JSON);
+
+        char buffer[64] = {};
+        rewind(report);
+        usize readLen = fread(buffer, 1, sizeof(buffer) - 1, report);
+        fclose(report);
+
+        halc_tryCleanup(reportResult);
+        halc_assertCleanup(readLen > 0 && !strncmp(buffer, "{\"sites\":[", 10));
+
+        if(gPrintouts)
+        {
+            write_allocation_report(stdout, ALLOC_REPORT_TEXT);
+        }
+    }
+
+cleanup:
+    if(!wasProfiling)
+    {
+        disable_allocation_profiling();
+    }
+    halc_end;
+}
+
+static errc test_debug_heap()
+{
+    b8 wasEnabled = debug_heap_enabled();
+    halc_try(enable_debug_heap());
+
+    struct allocatorStats stats;
+    get_allocator_stats(&stats);
+    i64 baseline = stats.allocatedSize;
+    void* block = NULL;
+    void* leaked = NULL;
+    errc freeResult;
+    errc doubleFreeResult;
+    errc reallocResult;
+
+    halloc(&block, 64);
+
+    supress_errors();
+    // wrong size gets reported but the block is still freed with the size it was allocated with
+    freeResult = hfree(block, 32);
+    doubleFreeResult = hfree(block, 64);
+    unsupress_errors();
+    halc_end_ok;
+
+    halc_assertCleanup(freeResult == ERR_BAD_FREE_SIZE);
+    halc_assertCleanup(doubleFreeResult == ERR_DOUBLE_FREE);
+    get_allocator_stats(&stats);
+    halc_assertCleanup(stats.allocatedSize == baseline);
+
+    halloc(&block, 16);
+    supress_errors();
+    reallocResult = hrealloc_advanced(&block, 8, 128, FALSE, __FILE__, __LINE__, __func__);
+    unsupress_errors();
+    halc_end_ok;
+    halc_assertCleanup(reallocResult == ERR_BAD_FREE_SIZE);
+    hfree(block, 16);
+
+    {
+        halloc(&leaked, 24);
+        FILE* report = tmpfile();
+        halc_assertCleanup(report);
+        i64 liveCount = debug_heap_report_leaks(report);
+        fclose(report);
+        hfree(leaked, 24);
+
+        halc_assertCleanup(liveCount == 1);
+        halc_assertCleanup(debug_heap_report_leaks(stderr) == 0);
+    }
+
+cleanup:
+    if(!wasEnabled)
+    {
+        disable_debug_heap();
+    }
+    halc_end;
+}
+
+// each worker holds at most 16 blocks of 32..512 bytes at a time
+#define STATS_WORKER_COUNT 4
+#define STATS_WORKER_ROUNDS 64
+
+struct stats_worker {
+    struct halc_thread thread;
+    errc result;
+    struct allocatorStats threadStats;
+};
+
+static errc stats_worker_run(struct stats_worker* worker)
+{
+    void* blocks[16];
+    for(i32 round = 0; round < STATS_WORKER_ROUNDS; round += 1)
+    {
+        for(i32 i = 0; i < 16; i += 1)
+        {
+            halloc(&blocks[i], 32 * (i + 1));
+        }
+
+        for(i32 i = 0; i < 16; i += 1)
+        {
+            hfree(blocks[i], 32 * (i + 1));
+        }
+    }
+
+    get_thread_allocator_stats(&worker->threadStats);
+    halc_end;
+}
+
+static void stats_worker_entry(void* arg)
+{
+    struct stats_worker* worker = (struct stats_worker*) arg;
+    worker->result = stats_worker_run(worker);
+}
+
+static errc test_threaded_allocator_stats()
+{
+    struct allocatorStats before;
+    struct allocatorStats after;
+    struct stats_worker workers[STATS_WORKER_COUNT] = {};
+
+    get_allocator_stats(&before);
+
+    for(i32 i = 0; i < STATS_WORKER_COUNT; i += 1)
+    {
+        halc_try(halc_thread_start(&workers[i].thread, stats_worker_entry, &workers[i]));
+    }
+
+    for(i32 i = 0; i < STATS_WORKER_COUNT; i += 1)
+    {
+        halc_thread_join(&workers[i].thread);
+    }
+
+    get_allocator_stats(&after);
+
+    const i64 peakPerWorker = 32 * (16 * 17 / 2);
+    for(i32 i = 0; i < STATS_WORKER_COUNT; i += 1)
+    {
+        halc_try(workers[i].result);
+        halc_assert(workers[i].threadStats.allocEventCount == STATS_WORKER_ROUNDS * 16);
+        halc_assert(workers[i].threadStats.allocations == 0);
+        halc_assert(workers[i].threadStats.peakAllocatedSize == peakPerWorker);
+        halc_assert(workers[i].threadStats.peakAllocationsCount == 16);
+    }
+
+    // no increments lost between threads, and the peak covers at least one whole worker
+    halc_assert(after.allocEventCount - before.allocEventCount == STATS_WORKER_COUNT * STATS_WORKER_ROUNDS * 16);
+    halc_assert(after.freeEventCount - before.freeEventCount == STATS_WORKER_COUNT * STATS_WORKER_ROUNDS * 16);
+    halc_assert(after.allocations == before.allocations);
+    halc_assert(after.allocatedSize == before.allocatedSize);
+    halc_assert(after.peakAllocatedSize >= peakPerWorker);
+    halc_assert(after.peakAllocatedSize <= before.peakAllocatedSize + STATS_WORKER_COUNT * peakPerWorker);
+
+    halc_end;
+}
+
+static errc test_scratch_allocator()
+{
+    struct allocatorStats before;
+    struct allocatorStats stats;
+    get_allocator_stats(&before);
+
+    struct arena_mark outer;
+    struct arena_mark inner;
+    scratch_begin(&outer);
+
+    char* a;
+    char* b;
+    char* c;
+    halc_try(scratch_alloc((void**) &a, 100));
+
+    // rewinding an inner mark hands the same memory out again
+    scratch_begin(&inner);
+    halc_try(scratch_alloc((void**) &b, 100));
+    halc_assert(b > a);
+    scratch_end(&inner);
+
+    halc_try(scratch_alloc((void**) &c, 100));
+    halc_assert(c == b);
+
+    get_allocator_stats(&stats);
+    halc_assert(stats.allocations == before.allocations + 1);
+
+    {
+        // anything larger than a block grows the stack and is released on rewind
+        scratch_begin(&inner);
+        char* big;
+        halc_try(scratch_alloc((void**) &big, SCRATCH_BLOCK_SIZE * 2));
+        memset(big, 'x', SCRATCH_BLOCK_SIZE * 2 - 1);
+        big[SCRATCH_BLOCK_SIZE * 2 - 1] = 0;
+
+        get_allocator_stats(&stats);
+        halc_assert(stats.allocations == before.allocations + 2);
+
+        // doesn't fit in what's left of the scratch stack, formats directly into the string
+        hstr str;
+        hstr_init(&str);
+        halc_try(hstr_printf(&str, "%s!", big));
+        halc_assert(str.len == SCRATCH_BLOCK_SIZE * 2);
+        halc_assert(str.buffer[str.len - 1] == '!' && str.buffer[str.len] == 0);
+        hstr_free(&str);
+
+        scratch_end(&inner);
+        get_allocator_stats(&stats);
+        halc_assert(stats.allocations == before.allocations + 1);
+    }
+
+    // the first block stays cached for the next user until it's released
+    scratch_end(&outer);
+    get_allocator_stats(&stats);
+    halc_assert(stats.allocations == before.allocations + 1);
+
+    scratch_release();
+    get_allocator_stats(&stats);
+    halc_assert(stats.allocations == before.allocations);
+
+    halc_end;
+}
+
+static errc test_memory_budgets()
+{
+    halc_set_parser_noprint();
+    const hstr filename = HSTR("testfiles/stress_easy.halc");
+
+    hstr fileContents;
+    halc_try(load_and_decode_from_file(&fileContents, &filename));
+
+    struct memory_budget worldA;
+    struct memory_budget worldB;
+    struct memory_budget_stats stats;
+    memory_budget_init(&worldA, "world a", 0);
+    memory_budget_init(&worldB, "world b", 4096);
+
+    {
+        struct tokenStream ts;
+        struct s_graph graph;
+
+        memory_budget_push(&worldA);
+        errc result = tokenize(&ts, &fileContents, &filename);
+        if(result == ERR_OK)
+            result = parse_tokens(&graph, &ts);
+        if(result == ERR_OK)
+            result = graph_init(&graph);
+
+        get_memory_budget_stats(&worldA, &stats);
+        halc_assertCleanup(stats.current > 0);
+
+        if(result == ERR_OK)
+        {
+            ts_free(&ts);
+            graph_free(&graph);
+        }
+        memory_budget_pop();
+        halc_tryCleanup(result);
+
+        get_memory_budget_stats(&worldA, &stats);
+        halc_assertCleanup(stats.current == 0);
+        halc_assertCleanup(stats.peak > 0);
+        halc_assertCleanup(stats.failedAllocations == 0);
+    }
+
+    {
+        // world b can't hold the token stream, tokenize fails and gives back what it took
+        struct tokenStream ts;
+
+        memory_budget_push(&worldB);
+        supress_errors();
+        errc result = tokenize(&ts, &fileContents, &filename);
+        unsupress_errors();
+        memory_budget_pop();
+        halc_end_ok;
+
+        halc_assertCleanup(result == ERR_OUT_OF_MEMORY);
+        halc_assertCleanup(memory_budget_active() == NULL);
+
+        get_memory_budget_stats(&worldB, &stats);
+        halc_assertCleanup(stats.current == 0);
+        halc_assertCleanup(stats.peak > 0 && stats.peak <= 4096);
+        halc_assertCleanup(stats.failedAllocations == 1);
+    }
+
+    // world a was not charged for anything world b did
+    get_memory_budget_stats(&worldA, &stats);
+    halc_assertCleanup(stats.current == 0);
+
+cleanup:
+    hstr_free(&fileContents);
+    halc_end;
+}
+
+static errc test_string_allocator()
+{
+    struct string_class_stats before[STRING_SIZE_CLASS_COUNT];
+    struct string_class_stats after[STRING_SIZE_CLASS_COUNT];
+    get_string_class_stats(before);
+
+    hstr label;
+    hstr_init(&label);
+    halc_try(hstr_printf(&label, "label_%d", 7));
+    char* original = label.buffer;
+
+    // growing inside the 16 byte class keeps the same slot
+    halc_try(hstr_reserve(&label, 16));
+    halc_assert(label.buffer == original);
+
+    // moving up a class keeps the contents
+    halc_try(hstr_reserve(&label, 100));
+    halc_assert(label.buffer != original);
+    halc_assert(strcmp(label.buffer, "label_7") == 0);
+
+    get_string_class_stats(after);
+    halc_assert(after[0].liveCount == before[0].liveCount);
+    halc_assert(after[3].liveCount == before[3].liveCount + 1);
+
+    // dupes come from the class of their length, freed slots get reused
+    hstr copy;
+    const hstr speaker = HSTR("narrator");
+    halc_try(hstr_dupe(&speaker, &copy));
+    halc_assert(copy.len == speaker.len && strcmp(copy.buffer, "narrator") == 0);
+    char* copySlot = copy.buffer;
+    hstr_free(&copy);
+    halc_try(hstr_dupe(&speaker, &copy));
+    halc_assert(copy.buffer == copySlot);
+
+    // too large for any class
+    hstr line;
+    hstr_init(&line);
+    halc_try(hstr_reserve(&line, 1000));
+    get_string_class_stats(after);
+    for(i32 i = 0; i < STRING_SIZE_CLASS_COUNT; i += 1)
+    {
+        halc_assert(after[i].liveCount == before[i].liveCount + (i == 0 || i == 3));
+    }
+
+    {
+        // while an arena is pushed strings belong to the arena
+        struct arena stringArena;
+        halc_try(arena_init(&stringArena, 0));
+        arena_push(&stringArena);
+
+        hstr arenaString;
+        hstr_init(&arenaString);
+        errc result = hstr_printf(&arenaString, "%s", "in the arena");
+        b8 owned = arena_owns(&stringArena, arenaString.buffer);
+
+        arena_pop();
+        arena_free(&stringArena);
+        halc_try(result);
+        halc_assert(owned);
+    }
+
+    hstr_free(&label);
+    hstr_free(&copy);
+    hstr_free(&line);
+
+    get_string_class_stats(after);
+    for(i32 i = 0; i < STRING_SIZE_CLASS_COUNT; i += 1)
+    {
+        halc_assert(after[i].slotSize == ((usize) 16 << i));
+        halc_assert(after[i].liveCount == before[i].liveCount);
+    }
+
+    halc_end;
+}
+
+static errc test_symbol_table()
+{
+    struct symbol_table symbols;
+    halc_try(symbol_table_init(&symbols));
+
+    struct tokenStream first;
+    struct tokenStream second;
+    hstr firstSource = HSTR("[start]\nnarrator: hello\n@goto finish\n");
+    hstr secondSource = HSTR("[finish]\nnarrator: bye\n@end\n");
+    hstr filename = HSTR("no file");
+
+    halc_try(tokenize_with_symbols(&first, &firstSource, &filename, &symbols));
+    halc_try(tokenize_with_symbols(&second, &secondSource, &filename, &symbols));
+
+    {
+        // both streams share one id per distinct label, directives get the builtin ids
+        const hstr narrator = HSTR("narrator");
+        const hstr finish = HSTR("finish");
+        u32 narratorSymbol = symbol_find(&symbols, &narrator);
+        u32 finishSymbol = symbol_find(&symbols, &finish);
+        halc_assert(narratorSymbol >= HALC_SYM_BUILTIN_COUNT);
+        halc_assert(finishSymbol >= HALC_SYM_BUILTIN_COUNT && finishSymbol != narratorSymbol);
+
+        i32 narrators = 0;
+        i32 finishes = 0;
+        b8 sawGoto = FALSE;
+        b8 sawEnd = FALSE;
+        for(i32 s = 0; s < 2; s += 1)
+        {
+            const struct tokenStream* ts = s == 0 ? &first : &second;
+            for(i32 i = 0; i < ts->len; i += 1)
+            {
+                const struct token* tok = &ts->tokens[i];
+                halc_assert((tok->tokenType == LABEL) == (tok->symbol != HALC_SYM_NONE));
+                narrators += tok->symbol == narratorSymbol;
+                finishes += tok->symbol == finishSymbol;
+                sawGoto |= tok->symbol == HALC_SYM_GOTO;
+                sawEnd |= tok->symbol == HALC_SYM_END;
+            }
+        }
+        halc_assert(narrators == 2 && finishes == 2 && sawGoto && sawEnd);
+
+        hstr text;
+        symbol_get_string(&symbols, finishSymbol, &text);
+        halc_assert(hstr_match(&text, &finish));
+        halc_assert(symbol_get_hash(&symbols, finishSymbol) == hstr_hash32(&finish));
+    }
+
+    {
+        // growing the table keeps every id stable
+        char name[32];
+        for(i32 i = 0; i < 1000; i += 1)
+        {
+            hstr label = {name, (u32) snprintf(name, sizeof(name), "label_%d", i), -1};
+            u32 symbol;
+            halc_try(symbol_intern(&symbols, &label, &symbol));
+        }
+
+        const hstr unknown = HSTR("never_interned");
+        halc_assert(symbol_find(&symbols, &unknown) == HALC_SYM_NONE);
+
+        const hstr goTo = HSTR("goto");
+        halc_assert(symbol_find(&symbols, &goTo) == HALC_SYM_GOTO);
+
+        for(i32 i = 0; i < 1000; i += 1)
+        {
+            hstr label = {name, (u32) snprintf(name, sizeof(name), "label_%d", i), -1};
+            u32 symbol = symbol_find(&symbols, &label);
+            hstr text;
+            symbol_get_string(&symbols, symbol, &text);
+            halc_assert(hstr_match(&text, &label));
+        }
+    }
+
+    {
+        // a copy keeps every id and grows apart from the original
+        struct symbol_table copy;
+        const hstr added = HSTR("only_in_the_copy");
+        const hstr label = HSTR("label_999");
+        u32 symbol;
+        halc_try(symbol_table_copy(&copy, &symbols));
+        halc_assert(copy.len == symbols.len);
+        halc_assert(symbol_find(&copy, &label) == symbol_find(&symbols, &label));
+        halc_try(symbol_intern(&copy, &added, &symbol));
+        halc_assert(symbol == symbols.len);
+        halc_assert(symbol_find(&symbols, &added) == HALC_SYM_NONE);
+        for(u32 i = HALC_SYM_NONE + 1; i < symbols.len; i += 1)
+        {
+            hstr text;
+            symbol_get_string(&symbols, i, &text);
+            halc_assert(symbol_find(&copy, &text) == i);
+        }
+        symbol_table_free(&copy);
+    }
+
+    ts_free(&first);
+    ts_free(&second);
+    symbol_table_free(&symbols);
+    halc_end;
+}
+
+// byte at a time reference for the vectorized string compares
+static b8 naive_contains(const hstr* string, const hstr* search)
+{
+    for(u32 i = 0; i + search->len <= string->len; i += 1)
+    {
+        if(memcmp(string->buffer + i, search->buffer, search->len) == 0)
+            return string->len > 0;
+    }
+    return FALSE;
+}
+
+static errc test_simd_string_compare()
+{
+    // small alphabet so partial matches, and first/last byte hits, are common
+    char text[300];
+    char other[300];
+    srand(1234);
+    for(i32 i = 0; i < (i32) sizeof(text); i += 1)
+    {
+        text[i] = "ab\n"[rand() % 3];
+    }
+
+    for(u32 len = 0; len < 100; len += 1)
+    {
+        // a difference in every position, including the last byte of each block
+        hstr left = {text, len, -1};
+        memcpy(other, text, len);
+        hstr right = {other, len, -1};
+        halc_assert(hstr_match(&left, &right));
+
+        for(u32 diff = 0; diff < len; diff += 1)
+        {
+            other[diff] = 'z';
+            halc_assert(!hstr_match(&left, &right));
+            other[diff] = text[diff];
+        }
+    }
+
+    for(i32 round = 0; round < 2000; round += 1)
+    {
+        u32 len = (u32) (rand() % 200);
+        u32 searchStart = (u32) (rand() % 250);
+        u32 searchLen = (u32) (rand() % 12);
+        hstr string = {text, len, -1};
+        hstr search = {text + searchStart, searchLen, -1};
+        halc_assert(hstr_contains(&string, &search) == naive_contains(&string, &search));
+    }
+
+    const hstr story = HSTR("The narrator walks into the tavern, looking for the innkeeper.");
+    const hstr present = HSTR("innkeeper.");
+    const hstr absent = HSTR("innkeepers");
+    halc_assert(hstr_contains(&story, &present));
+    halc_assert(!hstr_contains(&story, &absent));
+
+    halc_end;
+}
+
+static errc test_normalize_fast_path()
+{
+    // lines of every length around the block size, with space or tab indents and
+    // mixed line endings. the expected output is built alongside the input.
+    hstr input;
+    hstr expected;
+    hstr normalized;
+    hstr_init(&input);
+    hstr_init(&expected);
+    hstr_init(&normalized);
+
+    const char* text = "narrator: the quick brown fox jumps over the lazy dog, then it does it again and again.";
+    for(i32 line = 0; line < 200; line += 1)
+    {
+        i32 indent = line % 3;
+        i32 bodyLen = line % 80;
+        for(i32 i = 0; i < indent; i += 1)
+        {
+            halc_tryCleanup(hstr_printf(&input, "%s", (line & 1) ? "\t" : "    "));
+            halc_tryCleanup(hstr_printf(&expected, "\t"));
+        }
+        halc_tryCleanup(hstr_printf(&input, "%.*s%s", bodyLen, text, (line % 5) ? "\r\n" : "\n"));
+        halc_tryCleanup(hstr_printf(&expected, "%.*s\n", bodyLen, text));
+    }
+    halc_tryCleanup(hstr_printf(&input, "        %s", text));
+    halc_tryCleanup(hstr_printf(&expected, "\t\t%s", text));
+
+    halc_tryCleanup(hstr_normalize(&input, &normalized));
+    halc_assertCleanup(hstr_match(&normalized, &expected));
+    halc_assertCleanup(normalized.buffer[normalized.len] == 0);
+
+cleanup:
+    hstr_free(&input);
+    hstr_free(&expected);
+    hstr_free(&normalized);
+    halc_end;
+}
+
+// tokenizing the raw file has to give the same stream as normalizing it first
+static errc compare_raw_tokenize(const hstr* raw, const hstr* filename)
+{
+    hstr normalized;
+    struct tokenStream expected;
+    struct tokenStream actual;
+
+    supress_errors();
+    errc normalizeResult = hstr_normalize(raw, &normalized);
+    errc expectedResult = normalizeResult;
+    halc_end_ok;
+    if(normalizeResult == ERR_OK)
+        expectedResult = tokenize(&expected, &normalized, filename);
+    halc_end_ok;
+    errc actualResult = tokenize_raw(&actual, raw, filename, NULL);
+    unsupress_errors();
+    halc_end_ok;
+
+    halc_assertCleanup(expectedResult == actualResult);
+
+    if(expectedResult == ERR_OK)
+    {
+        b8 same = expected.len == actual.len;
+        for(i32 i = 0; same && i < expected.len; i += 1)
+        {
+            const struct token* left = &expected.tokens[i];
+            const struct token* right = &actual.tokens[i];
+            same = left->tokenType == right->tokenType &&
+                left->lineNumber == right->lineNumber &&
+                left->symbol == right->symbol &&
+                (left->tokenType == TAB || hstr_match(&left->tokenView, &right->tokenView));
+        }
+
+        ts_free(&expected);
+        ts_free(&actual);
+        halc_assertCleanup(same);
+    }
+
+cleanup:
+    if(normalizeResult == ERR_OK)
+        hstr_free(&normalized);
+    halc_end;
+}
+
+static errc test_tokenize_raw()
+{
+    const char* files[] = {
+        "testfiles/sample.halc",
+        "testfiles/storySimple.halc",
+        "testfiles/stress_easy.halc",
+        "testfiles/random_utf8.halc",
+    };
+
+    for(i32 i = 0; i < (i32)(arrayCount(files)); i += 1)
+    {
+        hstr filename = {(char*) files[i], (u32) strlen(files[i]), -1};
+        hstr raw;
+        halc_try(load_file(&raw, &filename));
+        errc result = compare_raw_tokenize(&raw, &filename);
+        hstr_free(&raw);
+        halc_try(result);
+    }
+
+    const hstr filename = HSTR("no file");
+    const hstr crlf = HSTR("[start]\r\n    narrator: hello there   \r\n\t    > pick me # comment\r\n        @goto start\r\n@end");
+    const hstr badIndent = HSTR("[start]\n   narrator: three spaces\n");
+    halc_try(compare_raw_tokenize(&crlf, &filename));
+    halc_try(compare_raw_tokenize(&badIndent, &filename));
+
+    halc_end;
+}
+
 errc debug_print_sizes()
 {
     if(gPrintouts)
     {
-        printf("struct anode size = %" PRId64 "\n", (i64)sizeof(struct anode));
+        printf("struct anode size = %" PRId64 "\n", (i64)sizeof(struct anode));
+    }
+    halc_end;
+}
+
+
+// ====================== test registry ======================
+struct testEntry {
+    const char* testName;
+    errc (*testFunc)();
+};
+
+// decodes code points and checks their ranges, returns the offset of the first bad one or len
+static u32 naive_utf8_find_error(const u8* s, u32 len)
+{
+    u32 i = 0;
+    while(i < len)
+    {
+        u32 n = s[i] < 0x80 ? 1 : (s[i] >> 5) == 0x6 ? 2 : (s[i] >> 4) == 0xE ? 3 : (s[i] >> 3) == 0x1E ? 4 : 0;
+        if(!n || i + n > len)
+            return i;
+
+        u32 cp = n == 1 ? s[i] : s[i] & (0x7F >> n);
+        for(u32 k = 1; k < n; k += 1)
+        {
+            if((s[i + k] & 0xC0) != 0x80)
+                return i;
+            cp = (cp << 6) | (s[i + k] & 0x3F);
+        }
+
+        static const u32 minimum[5] = {0, 0, 0x80, 0x800, 0x10000};
+        if(cp < minimum[n] || cp > 0x10FFFF || (cp >= 0xD800 && cp <= 0xDFFF))
+            return i;
+
+        i += n;
+    }
+    return len;
+}
+
+static errc test_utf8_validation()
+{
+    struct utf8_case {
+        const char* bytes;
+        i32 badOffset; // -1 when valid
+    };
+
+    static const struct utf8_case cases[] = {
+        {"plain ascii", -1},
+        {"caf\xC3\xA9", -1},
+        {"\xE2\x82\xAC euro", -1},
+        {"\xF0\x9F\x98\x80 emoji", -1},
+        {"\xF4\x8F\xBF\xBF", -1},         // U+10FFFF
+        {"\xED\x9F\xBF", -1},             // U+D7FF
+        {"ab\x80", 2},                    // lone continuation
+        {"ab\xC3", 2},                    // truncated at the end
+        {"ab\xE2\x82", 2},
+        {"ab\xF0\x9F\x98", 2},
+        {"ab\xC3(", 2},                   // missing continuation
+        {"\xC0\xAF", 0},                  // overlong
+        {"\xE0\x80\xAF", 0},
+        {"\xF0\x80\x80\xAF", 0},
+        {"x\xED\xA0\x80", 1},             // surrogate
+        {"x\xF4\x90\x80\x80", 1},         // past U+10FFFF
+        {"xy\xF8\x88\x80\x80\x80", 2},    // 5 byte form
+        {"\xC3\xA9\xA9", 2},              // too many continuations
+    };
+
+    hstr text;
+    hstr_init(&text);
+    hstr filename = HSTR("testfiles/invalid_utf8.halc");
+    hstr content;
+    errc loadResult;
+    u32 seed = 1234;
+
+    // every case at every alignment around the block sizes, after a few lines
+    supress_errors();
+    for(u32 c = 0; c < arrayCount(cases); c += 1)
+    {
+        for(u32 pad = 0; pad < 70; pad += 1)
+        {
+            hstr_empty(&text);
+            halc_tryCleanup(hstr_printf(&text, "line one\nline \xC3\xA9two\n%.*s%s", pad, 
+                "...............................................................................", 
+                cases[c].bytes));
+
+            u32 prefix = text.len - (u32) strlen(cases[c].bytes);
+            struct utf8_error utf8Error;
+            errc result = hstr_validate_utf8(&text, &utf8Error);
+            halc_end_ok;
+
+            if(cases[c].badOffset < 0)
+            {
+                halc_assertCleanup(result == ERR_OK);
+            }
+            else
+            {
+                halc_assertCleanup(result == ERR_STR_INVALID_UTF8);
+                halc_assertCleanup(utf8Error.offset == prefix + cases[c].badOffset);
+                halc_assertCleanup(utf8Error.lineNumber == 3);
+            }
+        }
+    }
+
+    // random text leaning towards lead and continuation bytes so errors land everywhere
+    for(u32 round = 0; round < 2000; round += 1)
+    {
+        u8 bytes[200];
+        u32 len = round % 200;
+        for(u32 i = 0; i < len; i += 1)
+        {
+            seed = seed * 1103515245 + 12345;
+            u32 r = seed >> 16;
+            bytes[i] = (r & 3) == 0 ? (u8)(r >> 4) : (r & 3) == 1 ? (u8)(0x80 | ((r >> 4) & 0x3F)) : (u8)('a' + (r >> 4) % 26);
+        }
+
+        hstr view = {(hchar*) bytes, len, -1};
+        u32 expected = naive_utf8_find_error(bytes, len);
+        struct utf8_error utf8Error;
+        errc result = hstr_validate_utf8(&view, &utf8Error);
+        halc_end_ok;
+
+        halc_assertCleanup((result == ERR_OK) == (expected == len));
+        if(result != ERR_OK)
+        {
+            halc_assertCleanup(utf8Error.offset == expected);
+        }
+    }
+
+    // and loading refuses the file
+    loadResult = load_and_decode_from_file(&content, &filename);
+    halc_end_ok;
+    halc_assertCleanup(loadResult == ERR_STR_INVALID_UTF8);
+
+cleanup:
+    unsupress_errors();
+    hstr_free(&text);
+    halc_end;
+}
+
+static errc test_hstr_builder()
+{
+    hstr str;
+    hstr_init(&str);
+    char expected[320]; // room for every digit of 1e300
+    u32 seed = 77;
+    u32 growths = 0;
+    i32 lastCap = 0;
+
+    // integers against printf, including the edges
+    static const i64 edges[] = {0, 1, -1, 9, 10, 99, 100, -100, 123456789, INT64_MAX, INT64_MIN};
+    for(u32 i = 0; i < arrayCount(edges); i += 1)
+    {
+        hstr_empty(&str);
+        halc_tryCleanup(hstr_append_i64(&str, edges[i]));
+        snprintf(expected, sizeof(expected), "%lld", (long long) edges[i]);
+        halc_assertCleanup(strcmp(str.buffer, expected) == 0);
+    }
+
+    hstr_empty(&str);
+    halc_tryCleanup(hstr_append_u64(&str, UINT64_MAX));
+    halc_assertCleanup(strcmp(str.buffer, "18446744073709551615") == 0);
+
+    // floats, the fast path rounds on its own so allow for the last digit
+    for(u32 i = 0; i < 1000; i += 1)
+    {
+        seed = seed * 1103515245 + 12345;
+        f64 value = ((f64)(seed >> 8) - (f64)(1 << 23)) / (f64)(1 << (seed % 20));
+        u32 decimals = i % 7;
+
+        hstr_empty(&str);
+        halc_tryCleanup(hstr_append_f64(&str, value, decimals));
+
+        f64 parsed = strtod(str.buffer, NULL);
+        f64 error = parsed > value ? parsed - value : value - parsed;
+        halc_assertCleanup(error <= 0.51 * pow(10.0, -(f64) decimals));
+
+        const char* dot = strchr(str.buffer, '.');
+        halc_assertCleanup(decimals ? (dot && strlen(dot + 1) == decimals) : !dot);
+    }
+
+    hstr_empty(&str);
+    halc_tryCleanup(hstr_append_f64(&str, 1e300, 1));
+    snprintf(expected, sizeof(expected), "%.1f", 1e300);
+    halc_assertCleanup(strcmp(str.buffer, expected) == 0);
+
+    // views, characters and printf all land in the same buffer
+    hstr_empty(&str);
+    {
+        hstr name = HSTR("innkeeper and then some");
+        hstr view = {name.buffer, 9, -1};
+        halc_tryCleanup(hstr_append(&str, &view));
+        halc_tryCleanup(hstr_append_char(&str, ':'));
+        halc_tryCleanup(hstr_append_cstr(&str, " gold="));
+        halc_tryCleanup(hstr_append_i64(&str, -42));
+        halc_tryCleanup(hstr_printf(&str, " weight=%.2f", 1.5));
+        halc_tryCleanup(hstr_append_f64(&str, 0.125, 2));
+        hstr whole = HSTR("innkeeper: gold=-42 weight=1.500.13");
+        halc_assertCleanup(hstr_match(&str, &whole));
+        halc_assertCleanup(str.buffer[str.len] == 0);
+    }
+
+    // growth is geometric, a character at a time doesn't reallocate every time
+    hstr_free(&str);
+    for(u32 i = 0; i < 100000; i += 1)
+    {
+        halc_tryCleanup(hstr_append_char(&str, (hchar)('a' + i % 26)));
+        if(str.cap != lastCap)
+        {
+            growths += 1;
+            lastCap = str.cap;
+        }
+    }
+    halc_assertCleanup(str.len == 100000);
+    halc_assertCleanup(growths < 20);
+
+cleanup:
+    hstr_free(&str);
+    halc_end;
+}
+
+static errc test_hash()
+{
+    u8 bytes[512 + 8];
+    u64 hashes[257];
+    u32 seed = 99;
+    hstr label;
+    hstr_init(&label);
+    const u32 labelCount = 20000;
+    u32* labelHashes;
+    u32 collisions = 0;
+    for(u32 i = 0; i < sizeof(bytes); i += 1)
+    {
+        seed = seed * 1103515245 + 12345;
+        bytes[i] = (u8)(seed >> 16);
+    }
+
+    // known answers from the reference wyhash final v4, the first seven are its own test 
+    // vectors. 48 and 96 bytes sit right on the edge of the 48 byte rounds
+    {
+        static const char digits[] = "1234567890123456789012345678901234567890123456789012345678901234567890123456789012345678901234567890";
+        static const struct { const char* key; u32 len; u64 seed; u64 hash; } vectors[] = {
+            {"", 0, 0, 0x93228a4de0eec5a2ull},
+            {"a", 1, 1, 0xc5bac3db178713c4ull},
+            {"abc", 3, 2, 0xa97f2f7b1d9b3314ull},
+            {"message digest", 14, 3, 0x786d1f1df3801df4ull},
+            {"abcdefghijklmnopqrstuvwxyz", 26, 4, 0xdca5a8138ad37c87ull},
+            {"ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789", 62, 5, 0xb9e734f117cfaf70ull},
+            {digits, 80, 6, 0x6cc5eab49a92d617ull},
+            {digits, 16, 0, 0x01162f9042d951c0ull},
+            {digits, 17, 0, 0xfc7831f44b9e8ac9ull},
+            {digits, 47, 0, 0x684a7841924d64f4ull},
+            {digits, 48, 0, 0x5415d932c2a5c457ull},
+            {digits, 49, 0, 0x097895ffa7f342cfull},
+            {digits, 96, 0, 0x38ed13b4e05d232eull},
+            {digits, 97, 0, 0x54e3ad816e50b7b6ull},
+        };
+        for(u32 i = 0; i < arrayCount(vectors); i += 1)
+        {
+            halc_assert(halc_hash64(vectors[i].key, vectors[i].len, vectors[i].seed) == vectors[i].hash);
+        }
+    }
+
+    // every length hashes differently, and the same at any alignment
+    for(u32 len = 0; len <= 256; len += 1)
+    {
+        hashes[len] = halc_hash64(bytes, len, HALC_HASH_DEFAULT_SEED);
+        for(u32 j = 0; j < len; j += 1)
+        {
+            halc_assert(hashes[len] != hashes[j]);
+        }
+
+        u8 shifted[264];
+        memcpy(shifted + 3, bytes, len);
+        halc_assert(halc_hash64(shifted + 3, len, HALC_HASH_DEFAULT_SEED) == hashes[len]);
+        halc_assert(halc_hash64(bytes, len, 1) != hashes[len]);
+    }
+
+    // flipping any one input bit flips about half of the output bits
+    static const u32 lengths[] = {3, 8, 16, 40, 200};
+    for(u32 l = 0; l < arrayCount(lengths); l += 1)
+    {
+        u32 len = lengths[l];
+        u64 base = halc_hash64(bytes, len, HALC_HASH_DEFAULT_SEED);
+        u32 flipped = 0;
+        for(u32 bit = 0; bit < len * 8; bit += 1)
+        {
+            bytes[bit / 8] ^= (u8)(1 << (bit % 8));
+            u64 diff = base ^ halc_hash64(bytes, len, HALC_HASH_DEFAULT_SEED);
+            bytes[bit / 8] ^= (u8)(1 << (bit % 8));
+            for(u32 k = 0; k < 64; k += 1)
+            {
+                flipped += (u32)((diff >> k) & 1);
+            }
+        }
+        f64 average = (f64) flipped / (len * 8);
+        halc_assert(average > 28.0 && average < 36.0);
+    }
+
+    // label shaped keys don't collide in 32 bits
+    halloc(&labelHashes, labelCount * sizeof(u32));
+    for(u32 i = 0; i < labelCount; i += 1)
+    {
+        hstr_empty(&label);
+        halc_tryCleanup(hstr_append_cstr(&label, "chapter_"));
+        halc_tryCleanup(hstr_append_u64(&label, i));
+        labelHashes[i] = hstr_hash32(&label);
+    }
+    std::sort(labelHashes, labelHashes + labelCount);
+    for(u32 i = 1; i < labelCount; i += 1)
+    {
+        collisions += labelHashes[i] == labelHashes[i - 1];
+    }
+    // about count^2 / 2^33 expected by chance
+    halc_assertCleanup(collisions <= 2);
+
+cleanup:
+    hfree(labelHashes, labelCount * sizeof(u32));
+    hstr_free(&label);
+    halc_end;
+}
+
+// FNV-1a, what the symbol table hashed with before
+static u32 fnv1a_hash(const u8* bytes, usize len)
+{
+    u32 hash = 2166136261u;
+    for(usize i = 0; i < len; i += 1)
+    {
+        hash ^= bytes[i];
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static errc test_hash_speed()
+{
+    using namespace std::chrono;
+
+    usize bufferLen = 1 << 20;
+    u8* buffer;
+    halloc(&buffer, bufferLen);
+    for(usize i = 0; i < bufferLen; i += 1)
+    {
+        buffer[i] = (u8)(i * 131 + (i >> 7));
+    }
+
+    // the sink keeps the loops from being optimized out
+    volatile u64 sink = 0;
+    static const usize keyLens[] = {8, 16, 32, 64, 1 << 20};
+    for(u32 k = 0; k < arrayCount(keyLens); k += 1)
+    {
+        usize keyLen = keyLens[k];
+        usize iterations = keyLen >= 4096 ? 200 : 4000000;
+        usize mask = bufferLen - keyLen;
+
+        high_resolution_clock::time_point t1 = high_resolution_clock::now();
+        u64 acc = 0;
+        for(usize i = 0; i < iterations; i += 1)
+        {
+            acc += halc_hash64(buffer + ((i * 64) & mask), keyLen, acc);
+        }
+        high_resolution_clock::time_point t2 = high_resolution_clock::now();
+        u32 fnv = 0;
+        for(usize i = 0; i < iterations; i += 1)
+        {
+            fnv += fnv1a_hash(buffer + ((i * 64 + fnv) & mask), keyLen);
+        }
+        high_resolution_clock::time_point t3 = high_resolution_clock::now();
+        sink += acc + fnv;
+
+        f64 hashSeconds = duration_cast<duration<f64>>(t2 - t1).count();
+        f64 fnvSeconds = duration_cast<duration<f64>>(t3 - t2).count();
+        std::cout << "hash " << keyLen << " byte keys: " 
+            << hashSeconds / iterations * 1e9 << "ns per key, "
+            << (f64)(keyLen * iterations) / hashSeconds / 1e9 << " GB/s (fnv1a " 
+            << (f64)(keyLen * iterations) / fnvSeconds / 1e9 << " GB/s)" 
+            << std::endl;
+    }
+
+    hfree(buffer, bufferLen);
+    halc_end;
+}
+
+static errc test_map_file()
+{
+    const hstr filename = HSTR("testfiles/stress_easy.halc");
+    hstr loaded;
+    hstr decoded;
+    hstr mappedDecoded;
+    struct mapped_file file;
+    struct tokenStream ts;
+    errc result;
+
+    hstr_init(&decoded);
+    hstr_init(&mappedDecoded);
+    halc_try(load_file(&loaded, &filename));
+    halc_tryCleanup(map_file(&file, &filename));
+
+    // same bytes as reading it, but a view the string functions won't touch
+    halc_assertCleanup(file.contents.cap == -1);
+    halc_assertCleanup(hstr_match(&file.contents, &loaded));
+
+    // the tokenizer runs straight over the mapping
+    halc_tryCleanup(tokenize_raw(&ts, &file.contents, &filename, NULL));
+    halc_assertCleanup(ts.len > 0);
+    ts_free(&ts);
+
+    halc_tryCleanup(hstr_normalize(&loaded, &decoded));
+    halc_tryCleanup(load_and_decode_from_file(&mappedDecoded, &filename));
+    halc_assertCleanup(hstr_match(&decoded, &mappedDecoded));
+
+    unmap_file(&file);
+    halc_assertCleanup(file.contents.buffer == NULL && file.mapping == NULL);
+
+    // failures don't leave anything to unmap
+    {
+        const hstr missing = HSTR("testfiles/does_not_exist.halc");
+        const hstr invalid = HSTR("testfiles/invalid_utf8.halc");
+        supress_errors();
+        result = map_file(&file, &missing);
+        halc_end_ok;
+        halc_assertCleanup(result == ERR_UNABLE_TO_OPEN_FILE);
+        result = map_file(&file, &invalid);
+        halc_end_ok;
+        unsupress_errors();
+        halc_assertCleanup(result == ERR_STR_INVALID_UTF8);
+    }
+
+#if !defined(_WIN32)
+    // a file over 4GB (sparse, nothing is written) fails rather than wrapping to a 1 byte view
+    {
+        const hstr big = HSTR("halc_test_big.halc");
+        FILE* bigFile = h_fopen(big.buffer, "wb");
+        halc_assertCleanup(bigFile);
+        b8 written = fseeko(bigFile, (off_t) 1 << 32, SEEK_SET) == 0 && fputc('\n', bigFile) != EOF;
+        fclose(bigFile);
+        halc_assertCleanup(written);
+
+        supress_errors();
+        result = map_file_binary(&file, &big);
+        halc_end_ok;
+        unsupress_errors();
+        remove(big.buffer);
+        halc_assertCleanup(result == ERR_FILE_READ_ERROR);
+    }
+#endif
+
+cleanup:
+    unsupress_errors();
+    hstr_free(&loaded);
+    hstr_free(&decoded);
+    hstr_free(&mappedDecoded);
+    halc_end;
+}
+
+#define FILE_BATCH_TEST_FILES 120
+
+struct file_batch_results {
+    u32 deliveries[FILE_BATCH_TEST_FILES];
+    errc results[FILE_BATCH_TEST_FILES];
+    hstr contents[FILE_BATCH_TEST_FILES];
+};
+
+static void record_batch_file(void* ctx, u32 index, errc result, hstr* contents)
+{
+    struct file_batch_results* out = (struct file_batch_results*) ctx;
+    out->deliveries[index] += 1;
+    out->results[index] = result;
+    out->contents[index] = *contents;
+}
+
+static errc test_file_batch()
+{
+    // more files than the ring holds at once, with failures mixed in
+    static const hstr sources[] = {
+        HSTR("testfiles/stress_easy.halc"),
+        HSTR("testfiles/sample.halc"),
+        HSTR("testfiles/does_not_exist.halc"),
+        HSTR("testfiles/storySimple.halc"),
+        HSTR("testfiles/invalid_utf8.halc"),
+        HSTR("testfiles/test_story"),
+        HSTR("testfiles/terminals.halc"),
+        HSTR("testfiles/random_utf8.halc"),
+    };
+    hstr paths[FILE_BATCH_TEST_FILES];
+    struct file_batch_results* batch = NULL;
+    hstr loaded;
+    errc result;
+
+    for(u32 i = 0; i < FILE_BATCH_TEST_FILES; i += 1)
+    {
+        paths[i] = sources[i % arrayCount(sources)];
+    }
+
+    halloc(&batch, sizeof(*batch));
+    memset(batch, 0, sizeof(*batch));
+    hstr_init(&loaded);
+
+    supress_errors();
+    halc_tryCleanup(load_file_batch(paths, FILE_BATCH_TEST_FILES, record_batch_file, batch));
+    unsupress_errors();
+
+    if(gPrintouts)
+    {
+        printf("load_file_batch is using %s\n", file_batch_has_io_uring() ? "io_uring" : "load_file");
+    }
+
+    // every file arrives once, with what load_file makes of it
+    for(u32 i = 0; i < FILE_BATCH_TEST_FILES; i += 1)
+    {
+        halc_assertCleanup(batch->deliveries[i] == 1);
+
+        supress_errors();
+        result = load_file(&loaded, &paths[i]);
+        unsupress_errors();
+        halc_end_ok;
+
+        halc_assertCleanup(batch->results[i] == result);
+        if(result == ERR_OK)
+        {
+            halc_assertCleanup(hstr_match(&batch->contents[i], &loaded));
+            hstr_free(&loaded);
+        }
+        else
+        {
+            halc_assertCleanup(batch->contents[i].len == 0 && batch->contents[i].cap == 0);
+        }
+    }
+
+    // a single file and an empty batch
+    for(u32 i = 0; i < FILE_BATCH_TEST_FILES; i += 1)
+    {
+        hstr_free(&batch->contents[i]);
+    }
+    memset(batch, 0, sizeof(*batch));
+    halc_tryCleanup(load_file_batch(paths, 1, record_batch_file, batch));
+    halc_assertCleanup(batch->deliveries[0] == 1 && batch->results[0] == ERR_OK);
+    halc_tryCleanup(load_file_batch(paths, 0, record_batch_file, batch));
+    halc_assertCleanup(batch->deliveries[0] == 1);
+
+cleanup:
+    unsupress_errors();
+    hstr_free(&loaded);
+    if(batch)
+    {
+        for(u32 i = 0; i < FILE_BATCH_TEST_FILES; i += 1)
+        {
+            hstr_free(&batch->contents[i]);
+        }
+        hfree(batch, sizeof(*batch));
+    }
+    halc_end;
+}
+
+// streams the file with the given chunk and ring sizes and checks it against tokenize_raw's stream
+static errc compare_stream_tokenize(const hstr* filename, const struct tokenStream* expected, u32 chunkSize, u32 ringCapacity)
+{
+    struct stream_tokenizer st;
+    struct token tok;
+    b8 done = FALSE;
+    i32 count = 0;
+
+    halc_try(stream_tokenizer_open(&st, filename, chunkSize, ringCapacity, expected->symbols));
+    while(TRUE)
+    {
+        halc_tryCleanup(stream_tokenizer_next(&st, &tok, &done));
+        if(done)
+            break;
+
+        halc_assertCleanup(count < expected->len);
+        const struct token* other = &expected->tokens[count];
+        halc_assertCleanup(tok.tokenType == other->tokenType);
+        halc_assertCleanup(tok.lineNumber == other->lineNumber);
+        halc_assertCleanup(tok.symbol == other->symbol);
+        halc_assertCleanup(hstr_match(&tok.tokenView, &other->tokenView));
+        count += 1;
+    }
+    halc_assertCleanup(count == expected->len);
+
+cleanup:
+    stream_tokenizer_close(&st);
+    halc_end;
+}
+
+static errc test_stream_tokenizer()
+{
+    const char* files[] = {
+        "testfiles/sample.halc",
+        "testfiles/storySimple.halc",
+        "testfiles/stress_easy.halc",
+    };
+    static const u32 chunkSizes[] = {1, 7, 64, 4096};
+    static const u32 ringCapacities[] = {16, 1024};
+
+    struct symbol_table symbols;
+    halc_try(symbol_table_init(&symbols));
+
+    hstr raw;
+    hstr big;
+    struct tokenStream ts;
+    struct stream_tokenizer st;
+    struct memory_budget budget;
+    struct memory_budget_stats stats;
+    FILE* file = NULL;
+    errc result;
+    hstr_init(&raw);
+    hstr_init(&big);
+    ts.len = 0;
+    ts.capacity = 0;
+    ts.ownsSymbols = FALSE;
+
+    // every chunk and ring size gives the same tokens, chunks of a single byte split every token
+    for(u32 i = 0; i < arrayCount(files); i += 1)
+    {
+        hstr filename = {(char*) files[i], (u32) strlen(files[i]), -1};
+        halc_tryCleanup(load_file(&raw, &filename));
+        halc_tryCleanup(tokenize_raw(&ts, &raw, &filename, &symbols));
+
+        for(u32 c = 0; c < arrayCount(chunkSizes); c += 1)
+        {
+            for(u32 r = 0; r < arrayCount(ringCapacities); r += 1)
+            {
+                halc_tryCleanup(compare_stream_tokenize(&filename, &ts, chunkSizes[c], ringCapacities[r]));
+            }
+        }
+
+        ts_free(&ts);
+        hstr_free(&raw);
+    }
+
+    // a file many times the chunk size streams within a budget far smaller than it
+    {
+        const hstr filename = HSTR("testfiles/stress_easy.halc");
+        const hstr tmpName = HSTR("stream tmpfile");
+        halc_tryCleanup(load_file(&raw, &filename));
+        for(i32 i = 0; i < 300; i += 1)
+        {
+            halc_tryCleanup(hstr_append(&big, &raw));
+        }
+
+        file = tmpfile();
+        halc_assertCleanup(file);
+        halc_assertCleanup(fwrite(big.buffer, 1, big.len, file) == big.len);
+        rewind(file);
+
+        halc_tryCleanup(tokenize_raw(&ts, &big, &tmpName, &symbols));
+
+        memory_budget_init(&budget, "stream", 256 * 1024);
+        memory_budget_push(&budget);
+        result = stream_tokenizer_open_file(&st, file, &tmpName, 16 * 1024, 256, &symbols);
+        if(result == ERR_OK)
+        {
+            struct token tok;
+            b8 done = FALSE;
+            i32 count = 0;
+            while(result == ERR_OK)
+            {
+                result = stream_tokenizer_next(&st, &tok, &done);
+                if(done || result != ERR_OK)
+                    break;
+                if(count >= ts.len || tok.tokenType != ts.tokens[count].tokenType || tok.lineNumber != ts.tokens[count].lineNumber)
+                    result = ERR_ASSERTION_FAILED;
+                count += 1;
+            }
+            if(result == ERR_OK && count != ts.len)
+                result = ERR_ASSERTION_FAILED;
+            stream_tokenizer_close(&st);
+        }
+        memory_budget_pop();
+
+        halc_tryCleanup(result);
+        get_memory_budget_stats(&budget, &stats);
+        // the window and ring, not the 2MB file
+        halc_assertCleanup(stats.peak < 64 * 1024);
+        halc_assertCleanup(stats.current == 0);
+    }
+
+    // errors come out the same as loading the whole file
+    {
+        const hstr invalid = HSTR("testfiles/invalid_utf8.halc");
+        const hstr randomText = HSTR("testfiles/random_utf8.halc");
+        struct token tok;
+        b8 done = FALSE;
+
+        supress_errors();
+        halc_tryCleanup(stream_tokenizer_open(&st, &invalid, 16, 0, NULL));
+        do { result = stream_tokenizer_next(&st, &tok, &done); } while(result == ERR_OK && !done);
+        stream_tokenizer_close(&st);
+        halc_end_ok;
+        halc_assertCleanup(result == ERR_STR_INVALID_UTF8);
+
+        halc_tryCleanup(stream_tokenizer_open(&st, &randomText, 0, 0, NULL));
+        do { result = stream_tokenizer_next(&st, &tok, &done); } while(result == ERR_OK && !done);
+        stream_tokenizer_close(&st);
+        halc_end_ok;
+        halc_assertCleanup(result == ERR_UNRECOGNIZED_TOKEN);
+
+        // a file that can't be read from is a read error
+        const hstr writeOnly = HSTR("halc_test_stream.halc");
+        if(file)
+            fclose(file);
+        file = h_fopen(writeOnly.buffer, "wb");
+        halc_assertCleanup(file);
+        halc_tryCleanup(stream_tokenizer_open_file(&st, file, &writeOnly, 0, 0, NULL));
+        do { result = stream_tokenizer_next(&st, &tok, &done); } while(result == ERR_OK && !done);
+        stream_tokenizer_close(&st);
+        halc_end_ok;
+        fclose(file);
+        file = NULL;
+        remove(writeOnly.buffer);
+        halc_assertCleanup(result == ERR_FILE_READ_ERROR);
+    }
+
+cleanup:
+    unsupress_errors();
+    if(file)
+        fclose(file);
+    if(ts.capacity > 0)
+        ts_free(&ts);
+    hstr_free(&raw);
+    hstr_free(&big);
+    symbol_table_free(&symbols);
+    halc_end;
+}
+
+static void count_index(void* ctx, u32 index)
+{
+    volatile i64* counts = (volatile i64*) ctx;
+    halc_atomic_add_i64(&counts[index], 1);
+}
+
+// loads the region on a pool and on one thread, and checks both against loading every file by hand
+static errc compare_region_load(const hstr* root, struct region* region)
+{
+    struct region serial;
+    hstr source;
+    struct tokenStream ts;
+    errc result;
+
+    memset(&serial, 0, sizeof(serial));
+    supress_errors();
+    halc_tryCleanup(region_load(region, root, 4));
+    halc_tryCleanup(region_load(&serial, root, 1));
+    unsupress_errors();
+
+    halc_assertCleanup(serial.fileCount == region->fileCount);
+    for(u32 i = 0; i < region->fileCount; i += 1)
+    {
+        const struct region_file* file = &region->files[i];
+        if(i > 0)
+        {
+            halc_assertCleanup(strcmp(region->files[i - 1].path.buffer, file->path.buffer) < 0);
+        }
+
+        halc_assertCleanup(hstr_match(&file->path, &serial.files[i].path));
+        halc_assertCleanup(file->result == serial.files[i].result);
+
+        supress_errors();
+        result = load_file(&source, &file->path);
+        if(result == ERR_OK)
+        {
+            result = tokenize_raw(&ts, &source, &file->path, NULL);
+            if(result != ERR_OK)
+                hstr_free(&source);
+        }
+        unsupress_errors();
+        halc_end_ok;
+
+        halc_assertCleanup(result == file->result);
+        if(result == ERR_OK)
+        {
+            // every file interns into the region's table, the ids don't depend on the worker count
+            b8 same = ts.len == file->ts.len && file->ts.symbols == region->symbols && !file->ts.ownsSymbols;
+            for(i32 t = 0; same && t < ts.len; t += 1)
+            {
+                hstr name;
+                const struct token* tok = &file->ts.tokens[t];
+                symbol_get_string(region->symbols, tok->symbol, &name);
+                same = ts.tokens[t].tokenType == tok->tokenType && 
+                    hstr_match(&ts.tokens[t].tokenView, &tok->tokenView) &&
+                    tok->symbol == serial.files[i].ts.tokens[t].symbol &&
+                    (tok->tokenType == LABEL ? hstr_match(&name, &tok->tokenView) : tok->symbol == HALC_SYM_NONE);
+            }
+            ts_free(&ts);
+            hstr_free(&source);
+            halc_assertCleanup(same);
+        }
+    }
+    halc_assertCleanup(region->failedCount == serial.failedCount);
+    halc_assertCleanup(region->byteCount == serial.byteCount && region->tokenCount == serial.tokenCount);
+
+    if(gPrintouts)
+    {
+        region_print_diagnostics(region);
+    }
+
+cleanup:
+    unsupress_errors();
+    region_free(&serial);
+    halc_end;
+}
+
+static errc test_region_loader()
+{
+    // every index runs exactly once, whatever the worker count
+    {
+        static volatile i64 counts[1000];
+        static const u32 workerCounts[] = {0, 1, 3, 64};
+        for(u32 w = 0; w < arrayCount(workerCounts); w += 1)
+        {
+            memset((void*) counts, 0, sizeof(counts));
+            halc_try(halc_parallel_for(arrayCount(counts), workerCounts[w], count_index, (void*) counts));
+            for(u32 i = 0; i < arrayCount(counts); i += 1)
+            {
+                halc_assert(counts[i] == 1);
+            }
+        }
+        halc_try(halc_parallel_for(0, 4, count_index, (void*) counts));
     }
+
+    const hstr story = HSTR("testfiles/test_story/");
+    const hstr testfiles = HSTR("testfiles");
+    const hstr missing = HSTR("testfiles/no_such_region");
+    struct region region;
+    errc result;
+
+    halc_try(compare_region_load(&story, &region));
+    halc_assertCleanup(region.fileCount == 10 && region.failedCount == 0);
+    region_free(&region);
+
+    // broken files fail on their own and don't take the rest of the region with them
+    halc_try(compare_region_load(&testfiles, &region));
+    halc_assertCleanup(region.fileCount > 10 && region.failedCount >= 2);
+    region_free(&region);
+
+    // only a missing root fails the whole load
+    supress_errors();
+    result = region_load(&region, &missing, 0);
+    unsupress_errors();
+    halc_end_ok;
+    halc_assertCleanup(result == ERR_UNABLE_TO_OPEN_FILE);
+
+cleanup:
+    region_free(&region);
     halc_end;
 }
 
+static b8 same_tokens(const struct tokenStream* left, const struct tokenStream* right)
+{
+    if(left->len != right->len)
+        return FALSE;
 
-// ====================== test registry ======================
-struct testEntry {
-    const char* testName;
-    errc (*testFunc)();
-};
+    for(i32 i = 0; i < left->len; i += 1)
+    {
+        const struct token* a = &left->tokens[i];
+        const struct token* b = &right->tokens[i];
+        if(a->tokenType != b->tokenType || a->lineNumber != b->lineNumber || a->symbol != b->symbol || 
+            a->tokenView.len != b->tokenView.len || 
+            a->tokenView.buffer - left->source.buffer != b->tokenView.buffer - right->source.buffer)
+        {
+            return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static errc test_compile_cache()
+{
+    static const hstr files[] = {
+        HSTR("testfiles/stress_easy.halc"),
+        HSTR("testfiles/storySimple.halc"),
+        HSTR("testfiles/test_story/intro.halc"),
+        HSTR("testfiles/sample.halc"),
+    };
+    const hstr cacheDir = HSTR("halc_test_cache");
+    const hstr broken = HSTR("testfiles/random_utf8.halc");
+    const hstr story = HSTR("testfiles/test_story");
+    struct compile_cache cache;
+    struct tokenStream expected;
+    struct tokenStream ts;
+    struct region region;
+    hstr source;
+    b8 hit = FALSE;
+    u64 tokenCount = 0;
+    errc result;
+
+    memset(&region, 0, sizeof(region));
+    memset(&expected, 0, sizeof(expected));
+    memset(&ts, 0, sizeof(ts));
+    hstr_init(&source);
+
+    halc_set_parser_noprint();
+    halc_try(compile_cache_open(&cache, &cacheDir));
+    halc_tryCleanup(compile_cache_clear(&cache));
+
+    // the first compile misses and the second is a hit, both match tokenize_raw
+    for(u32 i = 0; i < arrayCount(files); i += 1)
+    {
+        halc_tryCleanup(load_file(&source, &files[i]));
+        halc_tryCleanup(tokenize_raw(&expected, &source, &files[i], NULL));
+
+        for(u32 pass = 0; pass < 2; pass += 1)
+        {
+            halc_tryCleanup(compile_cached(&cache, &ts, &source, &files[i], NULL, &hit));
+            halc_assertCleanup(hit == (pass == 1));
+            halc_assertCleanup(same_tokens(&ts, &expected));
+            ts_free(&ts);
+        }
+
+        ts_free(&expected);
+        hstr_free(&source);
+    }
+    halc_assertCleanup(cache.hits == arrayCount(files) && cache.misses == arrayCount(files));
+
+    // the same bytes under a new name are still a hit, the key is the content
+    halc_tryCleanup(load_file(&source, &files[0]));
+    halc_tryCleanup(compile_cached(&cache, &ts, &source, &cacheDir, NULL, &hit));
+    halc_assertCleanup(hit);
+    ts_free(&ts);
+
+    // a damaged artifact is a miss and gets rewritten
+    {
+        char path[128];
+        snprintf(path, sizeof(path), "%s/%016" PRIx64 ".htok", cacheDir.buffer, hstr_hash64(&source, cache.seed));
+        FILE* artifact = h_fopen(path, "wb");
+        halc_assertCleanup(artifact != NULL);
+        fputs("not an artifact", artifact);
+        fclose(artifact);
+    }
+    halc_tryCleanup(compile_cached(&cache, &ts, &source, &files[0], NULL, &hit));
+    halc_assertCleanup(!hit);
+    ts_free(&ts);
+    halc_tryCleanup(compile_cached(&cache, &ts, &source, &files[0], NULL, &hit));
+    halc_assertCleanup(hit);
+    ts_free(&ts);
+
+    // another compiler version doesn't see these artifacts
+    cache.seed += 1;
+    halc_tryCleanup(compile_cached(&cache, &ts, &source, &files[0], NULL, &hit));
+    halc_assertCleanup(!hit);
+    ts_free(&ts);
+    cache.seed -= 1;
+    hstr_free(&source);
+
+    // failures aren't cached, they fail the same way every time
+    halc_tryCleanup(load_file(&source, &broken));
+    for(u32 pass = 0; pass < 2; pass += 1)
+    {
+        supress_errors();
+        result = compile_cached(&cache, &ts, &source, &broken, NULL, &hit);
+        unsupress_errors();
+        halc_end_ok;
+        halc_assertCleanup(result == ERR_UNRECOGNIZED_TOKEN);
+    }
+    hstr_free(&source);
+
+    // a region loaded twice compiles nothing the second time. Its empty files share 
+    // an artifact, so the first load already has some hits
+    halc_tryCleanup(compile_cache_clear(&cache));
+    for(u32 pass = 0; pass < 2; pass += 1)
+    {
+        halc_tryCleanup(region_load_cached(&region, &story, 4, &cache));
+        halc_assertCleanup(region.fileCount == 10 && region.failedCount == 0);
+        halc_assertCleanup(pass ? region.cachedCount == region.fileCount : region.cachedCount < region.fileCount);
+        if(pass == 0)
+            tokenCount = region.tokenCount;
+        halc_assertCleanup(region.tokenCount == tokenCount);
+        region_free(&region);
+    }
+
+    // a failed run leaves its artifacts behind to look at
+    halc_tryCleanup(compile_cache_clear(&cache));
+
+cleanup:
+    unsupress_errors();
+    ts_free(&ts);
+    ts_free(&expected);
+    hstr_free(&source);
+    region_free(&region);
+    compile_cache_close(&cache);
+    halc_end;
+}
+
+#if defined(_WIN32)
+#include <direct.h>
+#define test_mkdir(path) _mkdir(path)
+#define test_rmdir(path) _rmdir(path)
+#else
+#include <sys/stat.h>
+#include <unistd.h>
+#define test_mkdir(path) mkdir(path, 0777)
+#define test_rmdir(path) rmdir(path)
+#endif
+
+static b8 write_test_file(const char* path, const char* contents)
+{
+    FILE* file = h_fopen(path, "wb");
+    if(!file)
+        return FALSE;
+    fputs(contents, file);
+    fclose(file);
+    return TRUE;
+}
+
+static struct story_file* find_story_file(struct story_version* version, const char* path)
+{
+    for(u32 i = 0; i < version->fileCount; i += 1)
+    {
+        if(strcmp(version->files[i]->file.path.buffer, path) == 0)
+            return version->files[i];
+    }
+    return NULL;
+}
+
+// every label in the version resolves against the version's table to its own text
+static b8 story_labels_resolve(struct story_version* version)
+{
+    for(u32 i = 0; i < version->fileCount; i += 1)
+    {
+        const struct story_file* file = version->files[i];
+        if(file->file.result != ERR_OK)
+            continue;
+        if(file->file.ts.symbols != file->symbols->table)
+            return FALSE;
+
+        for(i32 t = 0; t < file->file.ts.len; t += 1)
+        {
+            const struct token* tok = &file->file.ts.tokens[t];
+            hstr name;
+            if(tok->tokenType != LABEL)
+                continue;
+            if(tok->symbol >= version->symbols->table->len)
+                return FALSE;
+            symbol_get_string(version->symbols->table, tok->symbol, &name);
+            if(!hstr_match(&name, &tok->tokenView))
+                return FALSE;
+        }
+    }
+    return TRUE;
+}
+
+static errc test_story_reload()
+{
+    const hstr root = HSTR("halc_test_watch");
+    struct region region;
+    struct story story;
+    struct story_watch watch;
+    struct story_version* first = NULL;
+    struct story_version* next = NULL;
+    struct story_file* kept = NULL;
+    struct story_file* edited = NULL;
+    b8 storyOpen = FALSE;
+    b8 watchOpen = FALSE;
+    b8 published = FALSE;
+    b8 changed = FALSE;
+
+    memset(&region, 0, sizeof(region));
+
+    test_mkdir("halc_test_watch");
+    test_mkdir("halc_test_watch/events");
+    halc_assertCleanup(write_test_file("halc_test_watch/region.halc", "# the region\nmerchant: welcome\n"));
+    halc_assertCleanup(write_test_file("halc_test_watch/events/intro.halc", "# an intro\n"));
+    halc_assertCleanup(write_test_file("halc_test_watch/events/outro.halc", "# an outro\n"));
+    halc_assertCleanup(write_test_file("halc_test_watch/notes.txt", "not a story file\n"));
+
+    halc_tryCleanup(region_load(&region, &root, 2));
+    halc_assertCleanup(region.fileCount == 3 && region.failedCount == 0);
+    halc_tryCleanup(story_init(&story, &region, NULL));
+    storyOpen = TRUE;
+    halc_assertCleanup(region.fileCount == 0);
+
+    first = story_acquire(&story);
+    halc_assertCleanup(first->version == 1 && first->fileCount == 3);
+    kept = find_story_file(first, "halc_test_watch/region.halc");
+    edited = find_story_file(first, "halc_test_watch/events/intro.halc");
+    halc_assertCleanup(kept && edited);
+
+    halc_tryCleanup(story_watch_open(&watch, &story));
+    watchOpen = TRUE;
+
+    // nothing changed yet
+    halc_tryCleanup(story_watch_tick(&watch, 0, &published));
+    halc_assertCleanup(!published);
+
+    // a change that doesn't touch a .halc file doesn't publish
+    halc_assertCleanup(write_test_file("halc_test_watch/notes.txt", "still not a story file\n"));
+    for(u32 i = 0; i < 10 && !published; i += 1)
+        halc_tryCleanup(story_watch_tick(&watch, 50, &published));
+    halc_assertCleanup(!published);
+
+    // one edited, one added, one that doesn't tokenize and one deleted
+    halc_assertCleanup(write_test_file("halc_test_watch/events/intro.halc", "# a longer intro than before\nmerchant: back again\n"));
+    halc_assertCleanup(write_test_file("halc_test_watch/events/side.halc", "innkeeper: a side quest\n"));
+    halc_assertCleanup(write_test_file("halc_test_watch/events/broken.halc", "\xff\xfe\n"));
+    halc_assertCleanup(remove("halc_test_watch/events/outro.halc") == 0);
+
+    // the watcher can report the changes over a few ticks, keep going until they all landed
+    supress_errors();
+    for(u32 i = 0; i < 100 && !changed; i += 1)
+    {
+        halc_tryCleanup(story_watch_tick(&watch, 50, &published));
+        if(!published)
+            continue;
+
+        next = story_acquire(&story);
+        changed = next->fileCount == 4 && find_story_file(next, "halc_test_watch/events/side.halc") && 
+            find_story_file(next, "halc_test_watch/events/broken.halc") && 
+            find_story_file(next, "halc_test_watch/events/intro.halc") != edited;
+        if(!changed)
+        {
+            story_release(&story, next);
+            next = NULL;
+        }
+    }
+    unsupress_errors();
+    halc_assertCleanup(changed);
+
+    // untouched files are shared, the rest was recompiled
+    halc_assertCleanup(next->version > first->version);
+    halc_assertCleanup(next->symbols != first->symbols);
+    halc_assertCleanup(story_labels_resolve(first) && story_labels_resolve(next));
+    halc_assertCleanup(find_story_file(next, "halc_test_watch/region.halc") == kept);
+    halc_assertCleanup(find_story_file(next, "halc_test_watch/events/outro.halc") == NULL);
+    halc_assertCleanup(find_story_file(next, "halc_test_watch/events/broken.halc")->file.result == ERR_STR_INVALID_UTF8);
+    halc_assertCleanup(next->failedCount == 1);
+    for(u32 i = 1; i < next->fileCount; i += 1)
+        halc_assertCleanup(strcmp(next->files[i - 1]->file.path.buffer, next->files[i]->file.path.buffer) < 0);
+
+    // the first version is still whole for whoever holds it
+    halc_assertCleanup(first->fileCount == 3 && edited->file.result == ERR_OK);
+    halc_assertCleanup(find_story_file(first, "halc_test_watch/events/outro.halc") != NULL);
+    halc_assertCleanup(edited->file.source.len == strlen("# an intro\n"));
+    halc_assertCleanup(find_story_file(next, "halc_test_watch/events/intro.halc")->file.source.len == strlen("# a longer intro than before\nmerchant: back again\n"));
+    story_release(&story, first);
+    first = NULL;
+
+    // reloading the whole root recompiles everything into a new version
+    supress_errors();
+    halc_tryCleanup(story_reload(&story, &root, 1, &published));
+    unsupress_errors();
+    halc_assertCleanup(published);
+    halc_assertCleanup(story.current->recompiledCount == 4 && story.current->fileCount == 4);
+
+cleanup:
+    unsupress_errors();
+    if(watchOpen)
+        story_watch_close(&watch);
+    if(first)
+        story_release(&story, first);
+    if(next)
+        story_release(&story, next);
+    if(storyOpen)
+        story_free(&story);
+    region_free(&region);
+
+    remove("halc_test_watch/events/intro.halc");
+    remove("halc_test_watch/events/outro.halc");
+    remove("halc_test_watch/events/side.halc");
+    remove("halc_test_watch/events/broken.halc");
+    remove("halc_test_watch/region.halc");
+    remove("halc_test_watch/notes.txt");
+    test_rmdir("halc_test_watch/events");
+    test_rmdir("halc_test_watch");
+    halc_end;
+}
+
+static void count_watch_changes(void* ctx, const hstr* path)
+{
+    *(u32*) ctx += 1;
+}
+
+static errc test_file_watcher_moved_dir()
+{
+    const hstr root = HSTR("halc_test_moved");
+    struct file_watcher watcher;
+    b8 watcherOpen = FALSE;
+    u32 changes = 0;
+
+    test_mkdir("halc_test_moved");
+    test_mkdir("halc_test_moved/events");
+    test_mkdir("halc_test_moved/events/side");
+
+    halc_tryCleanup(file_watcher_open(&watcher, &root));
+    watcherOpen = TRUE;
+    halc_assertCleanup(watcher.polling || watcher.dirCount == 3);
+
+    // moving a directory out of the tree drops the watches on it and everything below it
+    halc_assertCleanup(rename("halc_test_moved/events", "halc_test_moved_away") == 0);
+    for(u32 i = 0; i < 100 && changes == 0; i += 1)
+        halc_tryCleanup(file_watcher_poll(&watcher, 50, count_watch_changes, &changes));
+    halc_assertCleanup(changes > 0);
+    halc_assertCleanup(watcher.polling || watcher.dirCount == 1);
+
+    // and moving it back watches it again
+    halc_assertCleanup(rename("halc_test_moved_away", "halc_test_moved/events") == 0);
+    changes = 0;
+    for(u32 i = 0; i < 100 && changes == 0; i += 1)
+        halc_tryCleanup(file_watcher_poll(&watcher, 50, count_watch_changes, &changes));
+    halc_assertCleanup(changes > 0);
+    halc_assertCleanup(watcher.polling || watcher.dirCount == 3);
+
+cleanup:
+    if(watcherOpen)
+        file_watcher_close(&watcher);
+    test_rmdir("halc_test_moved/events/side");
+    test_rmdir("halc_test_moved/events");
+    test_rmdir("halc_test_moved_away/side");
+    test_rmdir("halc_test_moved_away");
+    test_rmdir("halc_test_moved");
+    halc_end;
+}
+
+// overwrites part of a file in place
+static b8 patch_test_file(const char* path, usize offset, const void* data, usize len)
+{
+    FILE* file = h_fopen(path, "r+b");
+    if(!file)
+        return FALSE;
+    b8 ok = fseek(file, (long) offset, SEEK_SET) == 0 && fwrite(data, 1, len, file) == len;
+    return fclose(file) == 0 && ok;
+}
+
+static errc test_story_pack()
+{
+    const hstr root = HSTR("testfiles/test_story");
+    const hstr packPath = HSTR("halc_test" HALC_PACK_EXTENSION);
+    const hstr missing = HSTR("events/not_there.halc");
+    struct pack pack;
+    struct region loose;
+    struct region packed;
+    hstr path;
+    hstr contents;
+    hstr found;
+    hstr expected;
+    b8 packOpen = FALSE;
+    errc result;
+    struct pack_entry firstEntry;
+    struct pack_entry damaged;
+    usize entriesOffset = 0;
+
+    memset(&pack, 0, sizeof(pack));
+    memset(&loose, 0, sizeof(loose));
+    memset(&packed, 0, sizeof(packed));
+    hstr_init(&path);
+    hstr_init(&expected);
+
+    halc_tryCleanup(pack_write(&root, &packPath));
+    halc_tryCleanup(pack_open(&pack, &packPath));
+    packOpen = TRUE;
+    halc_assertCleanup(pack.entryCount == 10);
+
+    // every entry is the file it came from, and finding it by path lands on the same bytes
+    for(u32 i = 0; i < pack.entryCount; i += 1)
+    {
+        hstr entryPath;
+        pack_entry_path(&pack, i, &entryPath);
+        pack_entry_contents(&pack, i, &contents);
+        halc_assertCleanup(((usize) contents.buffer & 63) == 0 || pack.file.mapping == NULL);
+
+        halc_tryCleanup(hstr_printf(&path, "%s/%s", root.buffer, entryPath.buffer));
+        halc_tryCleanup(load_file(&expected, &path));
+        halc_assertCleanup(contents.len == expected.len && (expected.len == 0 || memcmp(contents.buffer, expected.buffer, expected.len) == 0));
+        hstr_free(&expected);
+        hstr_free(&path);
+
+        halc_assertCleanup(pack_find(&pack, &entryPath, &found));
+        halc_assertCleanup(found.buffer == contents.buffer && found.len == contents.len && found.cap == -1);
+    }
+    halc_assertCleanup(!pack_find(&pack, &missing, &found));
+
+    // a region out of the pack is the same region as the loose files
+    halc_tryCleanup(region_load(&loose, &root, 2));
+    halc_tryCleanup(region_load_pack(&packed, &pack, &packPath, 2, NULL));
+    halc_assertCleanup(packed.fileCount == loose.fileCount && packed.failedCount == 0);
+    halc_assertCleanup(packed.tokenCount == loose.tokenCount && packed.byteCount == loose.byteCount);
+    for(u32 i = 0; i < packed.fileCount; i += 1)
+    {
+        halc_assertCleanup(strcmp(packed.files[i].path.buffer + packPath.len, loose.files[i].path.buffer + root.len) == 0);
+        halc_assertCleanup(same_tokens(&packed.files[i].ts, &loose.files[i].ts));
+    }
+    region_free(&packed);
+    region_free(&loose);
+
+    firstEntry = pack.entries[0];
+    entriesOffset = (usize) ((const char*) pack.entries - pack.file.contents.buffer);
+    pack_close(&pack);
+    packOpen = FALSE;
+
+    // an entry whose end wraps around past 2^64 would land back inside the pack
+    damaged = firstEntry;
+    damaged.offset = ~(u64) 0 - 15;
+    damaged.size = 32;
+    halc_assertCleanup(patch_test_file(packPath.buffer, entriesOffset, &damaged, sizeof(damaged)));
+    supress_errors();
+    result = pack_open(&pack, &packPath);
+    unsupress_errors();
+    halc_end_ok;
+    halc_assertCleanup(result == ERR_INCONSISTENT_FILE_FORMAT);
+
+    // and the same path can't be in there twice
+    halc_tryCleanup(pack_write(&root, &packPath));
+    halc_assertCleanup(patch_test_file(packPath.buffer, entriesOffset + sizeof(struct pack_entry), &firstEntry, sizeof(firstEntry)));
+    supress_errors();
+    result = pack_open(&pack, &packPath);
+    unsupress_errors();
+    halc_end_ok;
+    halc_assertCleanup(result == ERR_INCONSISTENT_FILE_FORMAT);
+
+    // anything that isn't a whole pack is turned away
+    halc_assertCleanup(write_test_file(packPath.buffer, "not a pack at all, just some words"));
+    supress_errors();
+    result = pack_open(&pack, &packPath);
+    unsupress_errors();
+    halc_end_ok;
+    halc_assertCleanup(result == ERR_INCONSISTENT_FILE_FORMAT);
+
+cleanup:
+    unsupress_errors();
+    region_free(&packed);
+    region_free(&loose);
+    if(packOpen)
+        pack_close(&pack);
+    hstr_free(&path);
+    hstr_free(&expected);
+    remove(packPath.buffer);
+    halc_end;
+}
+
+// every byte inside a directive, against the first terminal that matches it the way
+// the tokenizer used to look them up
+static errc test_char_class_table()
+{
+    char buffer[4];
+    struct tokenStream ts;
+    errc result;
+
+    memset(&ts, 0, sizeof(ts));
+
+    for(u32 b = 0; b < 256; b += 1)
+    {
+        buffer[0] = '(';
+        buffer[1] = (char) b;
+        buffer[2] = ')';
+        hstr source = {buffer, 3, -1};
+        hstr name = HSTR("char_class");
+
+        i32 expected = -1;
+        for(i32 i = 0; i < LABEL && expected < 0; i += 1) // every terminal comes before LABEL
+        {
+            if(Terminals[i].len == 1 && (u8) Terminals[i].buffer[0] == b)
+                expected = i;
+        }
+        if((b >= 'a' && b <= 'z') || (b >= 'A' && b <= 'Z') || (b >= '0' && b <= '9') || b == '_')
+            expected = LABEL;
+
+        // a comment takes the rest of the line
+        if(b == '#')
+            continue;
+
+        supress_errors();
+        result = tokenize(&ts, &source, &name);
+        unsupress_errors();
+        halc_end_ok;
+
+        if(expected < 0)
+        {
+            halc_assertCleanup(result == ERR_UNRECOGNIZED_TOKEN);
+            continue;
+        }
+
+        halc_assertCleanup(result == ERR_OK && ts.len == 3);
+        halc_assertCleanup(ts.tokens[1].tokenType == expected && ts.tokens[1].tokenView.len == 1);
+        halc_assertCleanup(b != '_' || ts.tokens[1].symbol != HALC_SYM_NONE);
+        ts_free(&ts);
+    }
+
+    // the two character terminals, and their first character alone at the end
+    for(i32 i = NOT_EQUIV; i <= GREATER_EQ; i += 1)
+    {
+        hstr name = HSTR("char_class");
+        buffer[0] = '(';
+        buffer[1] = Terminals[i].buffer[0];
+        buffer[2] = '=';
+        buffer[3] = ')';
+        hstr source = {buffer, 4, -1};
+
+        halc_tryCleanup(tokenize(&ts, &source, &name));
+        halc_assertCleanup(ts.len == 3 && ts.tokens[1].tokenType == i && ts.tokens[1].tokenView.len == 2);
+        ts_free(&ts);
+
+        source.len = 2;
+        halc_tryCleanup(tokenize(&ts, &source, &name));
+        halc_assertCleanup(ts.len == 2 && ts.tokens[1].tokenType != i && ts.tokens[1].tokenView.len == 1);
+        ts_free(&ts);
+    }
+
+cleanup:
+    unsupress_errors();
+    ts_free(&ts);
+    halc_end;
+}
+
+// runs of every length up to a few blocks, so the block scanners stop at every lane
+// and on the scalar tail
+static errc test_simd_token_scan()
+{
+    static const char stops[] = {'#', '\n', '\r', 0};
+    static const char labelEdges[] = {'@', '[', '{', ':', ']'};
+    const hstr name = HSTR("simd_scan");
+    char buffer[160];
+    struct tokenStream ts;
+
+    memset(&ts, 0, sizeof(ts));
+
+    for(u32 len = 1; len < 100; len += 1)
+    {
+        // story text up to a comment, a line break or the end. Spaces before the stop
+        // aren't part of it
+        for(u32 s = 0; s < arrayCount(stops); s += 1)
+        {
+            u32 n = 0;
+            buffer[n++] = ':';
+            buffer[n++] = ' ';
+            for(u32 i = 0; i < len; i += 1)
+                buffer[n++] = (i % 7 == 3) ? ' ' : "ab,!'?"[i % 6];
+            buffer[n - 1] = 'z';
+            buffer[n++] = ' ';
+            if(stops[s])
+                buffer[n++] = stops[s];
+            hstr source = {buffer, n, -1};
+
+            halc_tryCleanup(tokenize(&ts, &source, &name));
+            halc_assertCleanup(ts.len >= 2 && ts.tokens[1].tokenType == STORY_TEXT && ts.tokens[1].tokenView.len == len);
+            if(stops[s] == '#')
+                halc_assertCleanup(ts.len == 3 && ts.tokens[2].tokenType == COMMENT && ts.tokens[2].tokenView.len == 1);
+            ts_free(&ts);
+
+            // and the same run as a comment
+            buffer[0] = '#';
+            halc_tryCleanup(tokenize(&ts, &source, &name));
+            halc_assertCleanup(ts.tokens[0].tokenType == COMMENT);
+            halc_assertCleanup(ts.tokens[0].tokenView.len == (stops[s] && stops[s] != '#' ? n - 1 : n));
+            ts_free(&ts);
+        }
+
+        // labels up to every byte that ends one, including the ones just outside 
+        // each range of label characters
+        for(u32 e = 0; e <= arrayCount(labelEdges); e += 1)
+        {
+            u32 n = 0;
+            buffer[n++] = '[';
+            for(u32 i = 0; i < len; i += 1)
+                buffer[n++] = "aZ9_zA0"[i % 7];
+            if(e < arrayCount(labelEdges))
+                buffer[n++] = labelEdges[e];
+            hstr source = {buffer, n, -1};
+
+            halc_tryCleanup(tokenize(&ts, &source, &name));
+            halc_assertCleanup(ts.len >= 2 && ts.tokens[1].tokenType == LABEL && ts.tokens[1].tokenView.len == len);
+            ts_free(&ts);
+        }
+    }
+
+    // nothing but spaces after the colon is empty text, not a run backwards
+    {
+        hstr source = HSTR(":   \n");
+        halc_tryCleanup(tokenize(&ts, &source, &name));
+        halc_assertCleanup(ts.len == 3 && ts.tokens[1].tokenType == STORY_TEXT && ts.tokens[1].tokenView.len == 0);
+        ts_free(&ts);
+    }
+
+cleanup:
+    ts_free(&ts);
+    halc_end;
+}
 
 // test imports
 
@@ -448,7 +2783,34 @@ static struct testEntry gTests[] = {
     TEST_IMPL(test_parser_directives, "parsing tokens into a graph, specificially testing cases for directives"),
     TEST_IMPL(test_parser_story_simple, "parses tokens into a graph and starts walking recursively"),
     TEST_IMPL(test_parser_recursive_choices, "parses a recursive graph"),
-    TEST_IMPL(test_parser_speed, "parses tokens into a graph, specifically measuring speed")
+    TEST_IMPL(test_parser_speed, "parses tokens into a graph, specifically measuring speed"),
+    TEST_IMPL(test_arena_compile, "compiling a file repeatedly inside a single arena"),
+    TEST_IMPL(test_custom_allocator, "custom allocator vtable with realloc, aligned alloc and a context pointer"),
+    TEST_IMPL(test_pool_allocator, "fixed size pool allocator, stable addresses and free list reuse"),
+    TEST_IMPL(test_allocation_profiler, "per call site allocation profile and report"),
+    TEST_IMPL(test_debug_heap, "debug heap catches double frees, bad free sizes and reports leaks"),
+    TEST_IMPL(test_threaded_allocator_stats, "allocating from several threads keeps the statistics exact"),
+    TEST_IMPL(test_scratch_allocator, "scratch stack mark/rewind, growth and release"),
+    TEST_IMPL(test_memory_budgets, "per world memory budgets, usage queries and out of memory"),
+    TEST_IMPL(test_string_allocator, "size class allocator for hstr buffers"),
+    TEST_IMPL(test_symbol_table, "interning labels into symbol ids shared between token streams"),
+    TEST_IMPL(test_simd_string_compare, "vectorized hstr_match and hstr_contains agree with a byte by byte compare"),
+    TEST_IMPL(test_normalize_fast_path, "normalizing long lines, crlf endings and space indentation"),
+    TEST_IMPL(test_tokenize_raw, "tokenizing raw files matches normalizing then tokenizing"),
+    TEST_IMPL(test_utf8_validation, "utf8 validation catches malformed sequences and reports where"),
+    TEST_IMPL(test_hstr_builder, "appending views, integers and floats to a growing string"),
+    TEST_IMPL(test_hash, "hash spreads every length, alignment and seed"),
+    TEST_IMPL(test_hash_speed, "hash throughput on label sized keys and large buffers"),
+    TEST_IMPL(test_map_file, "memory mapped files, the read fallback and normalizing from the mapping"),
+    TEST_IMPL(test_file_batch, "loading a batch of files matches loading them one at a time"),
+    TEST_IMPL(test_stream_tokenizer, "streaming a file through the tokenizer in chunks"),
+    TEST_IMPL(test_region_loader, "loading and tokenizing a region directory on a worker pool"),
+    TEST_IMPL(test_compile_cache, "compiled token streams are reused across runs until the source changes"),
+    TEST_IMPL(test_story_reload, "changed files are recompiled into a new story version while readers keep the old one"),
+    TEST_IMPL(test_file_watcher_moved_dir, "a directory moved out of a watched tree stops being watched"),
+    TEST_IMPL(test_story_pack, "packing a region into one archive and loading it back without copying"),
+    TEST_IMPL(test_char_class_table, "the byte class table picks the same token as trying every terminal"),
+    TEST_IMPL(test_simd_token_scan, "story text, comments and labels end on the right byte at every length")
 };
 
 static i32 runAllTests()
@@ -521,6 +2883,8 @@ int main(int argc, char** argv)
     const hstr trackAllocs = HSTR("-a");
     const hstr doPrintouts = HSTR("--printout");
     const hstr testOut = HSTR("--printout");
+    const hstr memReport = HSTR("--memreport");
+    const hstr debugHeap = HSTR("--debugheap");
     gPrintouts = FALSE;
 
     for(i32 i = 0; i < argc; i += 1)
@@ -535,10 +2899,26 @@ int main(int argc, char** argv)
         {
             gPrintouts = TRUE;
         }
+
+        if(hstr_match(&arg, &memReport))
+        {
+            enable_allocation_profiling();
+        }
+
+        if(hstr_match(&arg, &debugHeap))
+        {
+            enable_debug_heap();
+        }
     }
 
     i32 results = runAllTests();
 
+    if(allocation_profiling_enabled())
+    {
+        print_memory_statistics();
+        disable_allocation_profiling();
+    }
+
     return results;
 }
 #endif